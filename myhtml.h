@@ -11,3 +11,6 @@
 #include "myhtml_select.h"
 #endif
 
+#ifndef _MYHTML_FLAT_H_
+#include "myhtml_flat.h"
+#endif
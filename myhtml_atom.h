@@ -0,0 +1,269 @@
+#ifndef _MYHTML_ATOM_H_
+#define _MYHTML_ATOM_H_
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+
+// Atoms of names
+//
+// known HTML tag and attribute names have fixed ids by a static perfect hash,
+// other names get ids from the document parsing them, so names are compared as integers
+//
+// ids of HTML_ATOM_DYNAMIC and above are only unique in their document,
+// HTML_ATOM_DYNAMIC itself is a name without id, they are compared by strings
+
+
+typedef enum HtmlAtom {
+	HTML_ATOM_NONE,
+	HTML_ATOM_A, HTML_ATOM_ABBR, HTML_ATOM_ADDRESS, HTML_ATOM_AREA, HTML_ATOM_ARTICLE,
+	HTML_ATOM_ASIDE, HTML_ATOM_AUDIO, HTML_ATOM_B, HTML_ATOM_BASE, HTML_ATOM_BDI, HTML_ATOM_BDO,
+	HTML_ATOM_BLOCKQUOTE, HTML_ATOM_BODY, HTML_ATOM_BR, HTML_ATOM_BUTTON, HTML_ATOM_CANVAS,
+	HTML_ATOM_CAPTION, HTML_ATOM_CITE, HTML_ATOM_CODE, HTML_ATOM_COL, HTML_ATOM_COLGROUP,
+	HTML_ATOM_DATA, HTML_ATOM_DATALIST, HTML_ATOM_DD, HTML_ATOM_DEL, HTML_ATOM_DETAILS, HTML_ATOM_DFN,
+	HTML_ATOM_DIALOG, HTML_ATOM_DIV, HTML_ATOM_DL, HTML_ATOM_DT, HTML_ATOM_EM, HTML_ATOM_EMBED,
+	HTML_ATOM_FIELDSET, HTML_ATOM_FIGCAPTION, HTML_ATOM_FIGURE, HTML_ATOM_FOOTER, HTML_ATOM_FORM,
+	HTML_ATOM_H1, HTML_ATOM_H2, HTML_ATOM_H3, HTML_ATOM_H4, HTML_ATOM_H5, HTML_ATOM_H6,
+	HTML_ATOM_HEAD, HTML_ATOM_HEADER, HTML_ATOM_HGROUP, HTML_ATOM_HR, HTML_ATOM_HTML, HTML_ATOM_I,
+	HTML_ATOM_IFRAME, HTML_ATOM_IMG, HTML_ATOM_INPUT, HTML_ATOM_INS, HTML_ATOM_KBD, HTML_ATOM_LABEL,
+	HTML_ATOM_LEGEND, HTML_ATOM_LI, HTML_ATOM_LINK, HTML_ATOM_MAIN, HTML_ATOM_MAP, HTML_ATOM_MARK,
+	HTML_ATOM_MENU, HTML_ATOM_META, HTML_ATOM_METER, HTML_ATOM_NAV, HTML_ATOM_NOSCRIPT,
+	HTML_ATOM_OBJECT, HTML_ATOM_OL, HTML_ATOM_OPTGROUP, HTML_ATOM_OPTION, HTML_ATOM_OUTPUT,
+	HTML_ATOM_P, HTML_ATOM_PARAM, HTML_ATOM_PICTURE, HTML_ATOM_PRE, HTML_ATOM_PROGRESS, HTML_ATOM_Q,
+	HTML_ATOM_RP, HTML_ATOM_RT, HTML_ATOM_RUBY, HTML_ATOM_S, HTML_ATOM_SAMP, HTML_ATOM_SCRIPT,
+	HTML_ATOM_SEARCH, HTML_ATOM_SECTION, HTML_ATOM_SELECT, HTML_ATOM_SLOT, HTML_ATOM_SMALL,
+	HTML_ATOM_SOURCE, HTML_ATOM_SPAN, HTML_ATOM_STRONG, HTML_ATOM_STYLE, HTML_ATOM_SUB,
+	HTML_ATOM_SUMMARY, HTML_ATOM_SUP, HTML_ATOM_SVG, HTML_ATOM_TABLE, HTML_ATOM_TBODY, HTML_ATOM_TD,
+	HTML_ATOM_TEMPLATE, HTML_ATOM_TEXTAREA, HTML_ATOM_TFOOT, HTML_ATOM_TH, HTML_ATOM_THEAD,
+	HTML_ATOM_TIME, HTML_ATOM_TITLE, HTML_ATOM_TR, HTML_ATOM_TRACK, HTML_ATOM_U, HTML_ATOM_UL,
+	HTML_ATOM_VAR, HTML_ATOM_VIDEO, HTML_ATOM_WBR, HTML_ATOM_MATH, HTML_ATOM_PATH, HTML_ATOM_CENTER,
+	HTML_ATOM_FONT, HTML_ATOM_FRAME, HTML_ATOM_FRAMESET, HTML_ATOM_NOFRAMES, HTML_ATOM_BIG,
+	HTML_ATOM_TT, HTML_ATOM_STRIKE, HTML_ATOM_ACCEPT, HTML_ATOM_ACCEPT_CHARSET, HTML_ATOM_ACCESSKEY,
+	HTML_ATOM_ACTION, HTML_ATOM_ALIGN, HTML_ATOM_ALLOW, HTML_ATOM_ALT, HTML_ATOM_ASYNC,
+	HTML_ATOM_AUTOCAPITALIZE, HTML_ATOM_AUTOCOMPLETE, HTML_ATOM_AUTOFOCUS, HTML_ATOM_AUTOPLAY,
+	HTML_ATOM_BACKGROUND, HTML_ATOM_BGCOLOR, HTML_ATOM_BORDER, HTML_ATOM_CHARSET, HTML_ATOM_CHECKED,
+	HTML_ATOM_CLASS, HTML_ATOM_COLOR, HTML_ATOM_COLS, HTML_ATOM_COLSPAN, HTML_ATOM_CONTENT,
+	HTML_ATOM_CONTENTEDITABLE, HTML_ATOM_CONTROLS, HTML_ATOM_COORDS, HTML_ATOM_CROSSORIGIN,
+	HTML_ATOM_DATETIME, HTML_ATOM_DECODING, HTML_ATOM_DEFAULT, HTML_ATOM_DEFER, HTML_ATOM_DIR,
+	HTML_ATOM_DIRNAME, HTML_ATOM_DISABLED, HTML_ATOM_DOWNLOAD, HTML_ATOM_DRAGGABLE, HTML_ATOM_ENCTYPE,
+	HTML_ATOM_ENTERKEYHINT, HTML_ATOM_FOR, HTML_ATOM_FORMACTION, HTML_ATOM_HEADERS, HTML_ATOM_HEIGHT,
+	HTML_ATOM_HIDDEN, HTML_ATOM_HIGH, HTML_ATOM_HREF, HTML_ATOM_HREFLANG, HTML_ATOM_HTTP_EQUIV,
+	HTML_ATOM_ID, HTML_ATOM_INERT, HTML_ATOM_INPUTMODE, HTML_ATOM_INTEGRITY, HTML_ATOM_ISMAP,
+	HTML_ATOM_ITEMPROP, HTML_ATOM_ITEMSCOPE, HTML_ATOM_ITEMTYPE, HTML_ATOM_KIND, HTML_ATOM_LANG,
+	HTML_ATOM_LIST, HTML_ATOM_LOADING, HTML_ATOM_LOOP, HTML_ATOM_LOW, HTML_ATOM_MAX,
+	HTML_ATOM_MAXLENGTH, HTML_ATOM_MEDIA, HTML_ATOM_METHOD, HTML_ATOM_MIN, HTML_ATOM_MINLENGTH,
+	HTML_ATOM_MULTIPLE, HTML_ATOM_MUTED, HTML_ATOM_NAME, HTML_ATOM_NONCE, HTML_ATOM_NOVALIDATE,
+	HTML_ATOM_OPEN, HTML_ATOM_OPTIMUM, HTML_ATOM_PATTERN, HTML_ATOM_PING, HTML_ATOM_PLACEHOLDER,
+	HTML_ATOM_PLAYSINLINE, HTML_ATOM_POSTER, HTML_ATOM_PRELOAD, HTML_ATOM_READONLY,
+	HTML_ATOM_REFERRERPOLICY, HTML_ATOM_REL, HTML_ATOM_REQUIRED, HTML_ATOM_REVERSED, HTML_ATOM_ROLE,
+	HTML_ATOM_ROWS, HTML_ATOM_ROWSPAN, HTML_ATOM_SANDBOX, HTML_ATOM_SCOPE, HTML_ATOM_SELECTED,
+	HTML_ATOM_SHAPE, HTML_ATOM_SIZE, HTML_ATOM_SIZES, HTML_ATOM_SPELLCHECK, HTML_ATOM_SRC,
+	HTML_ATOM_SRCDOC, HTML_ATOM_SRCLANG, HTML_ATOM_SRCSET, HTML_ATOM_START, HTML_ATOM_STEP,
+	HTML_ATOM_TABINDEX, HTML_ATOM_TARGET, HTML_ATOM_TRANSLATE, HTML_ATOM_TYPE, HTML_ATOM_USEMAP,
+	HTML_ATOM_VALUE, HTML_ATOM_WIDTH, HTML_ATOM_WRAP, HTML_ATOM_XMLNS, HTML_ATOM_ONCLICK,
+	HTML_ATOM_ONLOAD, HTML_ATOM_ONERROR, HTML_ATOM_ONCHANGE, HTML_ATOM_ONSUBMIT, HTML_ATOM_ONINPUT,
+	HTML_ATOM_PROPERTY, HTML_ATOM_VIEWBOX, HTML_ATOM_D, HTML_ATOM_FILL, HTML_ATOM_STROKE,
+	HTML_ATOM_ARIA_LABEL, HTML_ATOM_ARIA_HIDDEN, HTML_ATOM_ARIA_EXPANDED, HTML_ATOM_ARIA_CONTROLS,
+	HTML_ATOM_ARIA_DESCRIBEDBY, HTML_ATOM_ARIA_LABELLEDBY, HTML_ATOM_DATA_ID,
+
+	HTML_ATOM_STATIC_COUNT,
+	HTML_ATOM_DYNAMIC = 0x8000		// not a known name, ids above are given by document
+} HtmlAtom;
+
+
+// static perfect hash (hash and displace), made from HtmlLibAtomNames
+//
+// slot = mix(hash ^ displacement[hash % buckets]), the displacement of each bucket
+// is chosen to give its names free slots
+
+#define HTML_ATOM_SLOT_COUNT 512
+#define HTML_ATOM_BUCKET_COUNT 128
+#define HTML_ATOM_NAME_MAX 16		// length of the longest static name
+
+const char* HtmlLibAtomNames[HTML_ATOM_STATIC_COUNT] = {
+	NULL,
+	"a", "abbr", "address", "area", "article", "aside", "audio", "b", "base", "bdi", "bdo",
+	"blockquote", "body", "br", "button", "canvas", "caption", "cite", "code", "col", "colgroup",
+	"data", "datalist", "dd", "del", "details", "dfn", "dialog", "div", "dl", "dt", "em", "embed",
+	"fieldset", "figcaption", "figure", "footer", "form", "h1", "h2", "h3", "h4", "h5", "h6", "head",
+	"header", "hgroup", "hr", "html", "i", "iframe", "img", "input", "ins", "kbd", "label", "legend",
+	"li", "link", "main", "map", "mark", "menu", "meta", "meter", "nav", "noscript", "object", "ol",
+	"optgroup", "option", "output", "p", "param", "picture", "pre", "progress", "q", "rp", "rt",
+	"ruby", "s", "samp", "script", "search", "section", "select", "slot", "small", "source", "span",
+	"strong", "style", "sub", "summary", "sup", "svg", "table", "tbody", "td", "template", "textarea",
+	"tfoot", "th", "thead", "time", "title", "tr", "track", "u", "ul", "var", "video", "wbr", "math",
+	"path", "center", "font", "frame", "frameset", "noframes", "big", "tt", "strike", "accept",
+	"accept-charset", "accesskey", "action", "align", "allow", "alt", "async", "autocapitalize",
+	"autocomplete", "autofocus", "autoplay", "background", "bgcolor", "border", "charset", "checked",
+	"class", "color", "cols", "colspan", "content", "contenteditable", "controls", "coords",
+	"crossorigin", "datetime", "decoding", "default", "defer", "dir", "dirname", "disabled",
+	"download", "draggable", "enctype", "enterkeyhint", "for", "formaction", "headers", "height",
+	"hidden", "high", "href", "hreflang", "http-equiv", "id", "inert", "inputmode", "integrity",
+	"ismap", "itemprop", "itemscope", "itemtype", "kind", "lang", "list", "loading", "loop", "low",
+	"max", "maxlength", "media", "method", "min", "minlength", "multiple", "muted", "name", "nonce",
+	"novalidate", "open", "optimum", "pattern", "ping", "placeholder", "playsinline", "poster",
+	"preload", "readonly", "referrerpolicy", "rel", "required", "reversed", "role", "rows", "rowspan",
+	"sandbox", "scope", "selected", "shape", "size", "sizes", "spellcheck", "src", "srcdoc",
+	"srclang", "srcset", "start", "step", "tabindex", "target", "translate", "type", "usemap",
+	"value", "width", "wrap", "xmlns", "onclick", "onload", "onerror", "onchange", "onsubmit",
+	"oninput", "property", "viewbox", "d", "fill", "stroke", "aria-label", "aria-hidden",
+	"aria-expanded", "aria-controls", "aria-describedby", "aria-labelledby", "data-id",
+};
+
+
+unsigned char HtmlLibAtomDisplacements[HTML_ATOM_BUCKET_COUNT] = {
+	  0,   0,   0,   0,   2,   1,   0,   1,   0,   1,   0,   0,   0,   0,   0,   0,
+	  0,   0,   0,   3,   2,   0,   0,   0,   0,   3,   0,   4,   2,   0,   0,   2,
+	  0,   0,   0,   0,   2,   0,   0,   1,   0,   0,   0,   0,   1,   0,   0,   0,
+	  0,   2,   0,   0,   0,   3,   0,   0,   0,   1,   1,   0,   0,   0,   5,   1,
+	  0,   5,   1,   3,   0,   0,   0,   0,   0,   0,   1,   0,   0,   2,   0,   3,
+	  0,   0,   0,   1,   0,   2,   3,   1,   0,   1,   0,   0,   4,   3,   0,   1,
+	  1,   7,   0,   0,   4,   0,   0,   2,   5,   3,   0,   6,   0,   0,   0,   5,
+	  0,   1,   3,   0,   0,   2,   3,   1,   0,   0,   2,   0,   0,   0,   0,   1,
+};
+
+unsigned short HtmlLibAtomSlots[HTML_ATOM_SLOT_COUNT] = {
+	128, 227,   0,   0,  49,   0,   0, 206,  14,   0, 159,   0,  28,   0, 236, 119,
+	  0,   0,   0,   0, 124,   1, 165,   0,   0, 238, 189,   0,   0,  24,   0,   0,
+	  0,   0, 142,   0,   0,  83,   0,  36, 108,   0, 156,  38,  82,  34, 240, 105,
+	 16,  78,  32,   0,   0,  55,   0,  21,   0,  98, 174,   0, 225,   0, 178,   0,
+	  0,  91,  26, 168,   0,   0,  51,  99,   0, 191, 242,   0,  81,   0,   0, 170,
+	  0,  60,   0,   0,   0,   0,   0, 141,   0, 226,   0,  46,   0,   0,  80,   0,
+	 74,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  56,   0,   0,   0,
+	195, 188,  27, 180,   0, 169,   0,   0,  96,  73, 139,   0,   0,   0,   0,   0,
+	239, 127, 246,   0,   0,  92,   0,   0,   0, 196,   0, 107,   0, 160, 136,   0,
+	247, 200,  37, 125,  43,   0,  15,  95,   0, 157,   0, 133,   0, 154,   0,   0,
+	  0,   0,   0,   0,   9,  77,   0,  39, 166,   0,   0,   0, 235,   0, 173, 223,
+	  0, 243,   6,   0,   0, 145,   2, 214, 201, 158,   0,  48,   0,   0,   0,   3,
+	233,   0, 183,   0,   0,   0,   0, 219,   0,   0,   0,  45,   0,  11,   0, 222,
+	181,   0, 101, 176,   0,   0, 241,  69, 248,   0,   0,  70,  42,   0,   0, 234,
+	 64,   0,  12, 161,  90,   0, 182,   0,  54, 194,   0,   0,   0, 213,   0,   0,
+	  0,  29,  67,   4,   0, 199,   0,   0,  22, 204, 100, 209,   0,  50, 138, 116,
+	230,   0,   0,  20,   0,   0,  68,   7, 150,  94,  63, 134, 104, 109,   0,  44,
+	110,   0,   0,   0,   0,   0,   0,   0,   0, 122,  25,   0,   0,   0, 117, 175,
+	126,   0,   0,   0,   5,   0,   0,  89,   0,   0,   0,   0,   0, 111,   0, 228,
+	179,   0, 121, 221,  79, 149, 153,   0,  61,   0, 244, 164, 187,   0,   0, 186,
+	  0,   0, 207, 112, 192,   0,   0,   0, 249,   0, 197,   0, 229,   0, 146,   0,
+	 19,   0,   0,   0,   0, 216,  33, 217,   0, 171,  31,   0,   0, 167,  93,   0,
+	193,   0,   0, 143,   0,   0,   8,   0, 135,   0,  66,  65, 131,   0,  84, 190,
+	  0,   0, 163,   0,   0,  35, 147,   0,   0, 115,  97,   0, 155,   0,  23,  30,
+	130,   0, 215, 251,   0,  58, 232,   0,  17,   0,   0,   0, 132,   0,   0,   0,
+	237,   0,   0,   0,   0,   0,  18,   0,   0,  52, 205, 211,   0,  41,   0,   0,
+	220,   0, 162, 224, 184,  72,   0,   0,  57,   0, 208,   0, 250,   0,   0,   0,
+	218,  47, 140, 106, 144,   0, 120,  85,   0,   0,   0,   0,   0, 123,  88, 203,
+	 62, 245,   0,  10,   0,   0,  87,   0,   0, 198, 177, 151,   0,   0,  59, 114,
+	  0,  53,   0, 152, 210,   0, 103, 185,   0, 113,   0,   0,   0,   0, 172,   0,
+	  0, 118,   0,   0,   0, 129,  40, 231,   0,   0,   0,   0,  76,  71,   0,  86,
+	  0, 212, 202,   0,   0, 137,   0,   0,   0, 102,   0,   0, 148,  13,  75,   0,
+};
+
+
+
+
+// FNV-1a
+unsigned int HtmlLibHashName(const char* name, size_t length) {
+	unsigned int hash = 2166136261u;
+
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+	}
+	return hash;
+}
+
+#define HtmlLibGetAtomSlot(hash) \
+	((((hash) ^ HtmlLibAtomDisplacements[(hash) % HTML_ATOM_BUCKET_COUNT]) * 0x9E3779B1u) >> 23 & (HTML_ATOM_SLOT_COUNT - 1))
+
+#define HtmlLibIsAtomName(atomName, name, length) \
+	(strncmp((atomName), (name), (length)) == 0 && (atomName)[length] == 0)
+
+
+// static atom of `name`, or HTML_ATOM_DYNAMIC
+unsigned short HtmlLibLookupAtom(const char* name, size_t length) {
+	unsigned int hash = HtmlLibHashName(name, length);
+	unsigned short atom = HtmlLibAtomSlots[HtmlLibGetAtomSlot(hash)];
+
+	return atom && HtmlLibIsAtomName(HtmlLibAtomNames[atom], name, length) ? atom : HTML_ATOM_DYNAMIC;
+}
+
+
+// same names, ids given by different documents are compared by strings
+#define HtmlLibIsSameAtom(atom1, name1, atom2, name2) \
+	((atom1) < HTML_ATOM_DYNAMIC || (atom2) < HTML_ATOM_DYNAMIC ? (atom1) == (atom2) : strcmp((name1), (name2)) == 0)
+
+
+
+
+// Dynamic Atoms //
+//
+// open addressing table of names not known, owned by a document
+
+typedef struct HtmlLibDynamicAtom {
+	const char* name;		// string in document memory
+	size_t length;
+	unsigned short atom;
+} HtmlLibDynamicAtom;
+
+typedef struct HtmlLibAtomTable {
+	HtmlLibDynamicAtom* entries;
+	size_t capacity;		// power of 2
+	size_t count;
+} HtmlLibAtomTable;
+
+
+HtmlLibDynamicAtom* HtmlLibProbeAtomTable(HtmlLibAtomTable* table, const char* name, size_t length) {
+	size_t i = HtmlLibHashName(name, length) & (table->capacity - 1);
+
+	while (table->entries[i].name && (table->entries[i].length != length || memcmp(table->entries[i].name, name, length) != 0)) {
+		i = (i + 1) & (table->capacity - 1);
+	}
+	return &table->entries[i];
+}
+
+
+// dynamic atom of `name` in `table`, or HTML_ATOM_DYNAMIC
+unsigned short HtmlLibFindDynamicAtom(HtmlLibAtomTable* table, const char* name, size_t length) {
+	if (table->count == 0) {
+		return HTML_ATOM_DYNAMIC;
+	}
+
+	HtmlLibDynamicAtom* entry = HtmlLibProbeAtomTable(table, name, length);
+	return entry->name ? entry->atom : HTML_ATOM_DYNAMIC;
+}
+
+// dynamic atom of `name`, new id is given if not found
+// `name` is kept by the table, it must live as long as the table
+// return HTML_ATOM_DYNAMIC if no more ids or out of memory
+unsigned short HtmlLibInternDynamicAtom(HtmlLibAtomTable* table, const char* name, size_t length) {
+	// keep the table half empty
+	if ((table->count + 1) * 2 > table->capacity) {
+		if (HTML_ATOM_DYNAMIC + table->count + 1 > 0xFFFF) {
+			return HtmlLibFindDynamicAtom(table, name, length);
+		}
+
+		HtmlLibAtomTable grown = {(HtmlLibDynamicAtom*)calloc(table->capacity ? table->capacity * 2 : 64, sizeof(HtmlLibDynamicAtom)), table->capacity ? table->capacity * 2 : 64, table->count};
+		if (grown.entries == NULL) {
+			return HtmlLibFindDynamicAtom(table, name, length);
+		}
+
+		for (size_t i = 0; i < table->capacity; i++) {
+			if (table->entries[i].name) {
+				*HtmlLibProbeAtomTable(&grown, table->entries[i].name, table->entries[i].length) = table->entries[i];
+			}
+		}
+		free(table->entries);
+		*table = grown;
+	}
+
+	HtmlLibDynamicAtom* entry = HtmlLibProbeAtomTable(table, name, length);
+	if (entry->name == NULL) {
+		*entry = (HtmlLibDynamicAtom){name, length, (unsigned short)(HTML_ATOM_DYNAMIC + ++table->count)};
+	}
+	return entry->atom;
+}
+
+#define HtmlLibDestroyAtomTable(table) (free((table)->entries))
+
+
+#endif /* _MYHTML_ATOM_H_ */
@@ -0,0 +1,721 @@
+#ifndef _MYHTML_FLAT_H_
+#define _MYHTML_FLAT_H_
+
+#ifndef _MYHTML_WRITER_H_
+#include "myhtml_writer.h"
+#endif
+
+#ifndef _MYHTML_SELECT_H_
+#include "myhtml_select.h"
+#endif
+
+
+// Flat Documents //
+//
+// a read-only copy of a tree in one memory block: nodes in document order linked by 32-bit
+// indices, attributes in one array and every string in one text blob
+//
+// the subtree of a node is the nodes up to its `end`, so its first child is the next node and
+// its next sibling is `end`, walking a subtree is a scan over the array
+//
+// the tree is not changed by flattening, its HtmlObject* stay valid, and it can be destroyed
+// when only the flat copy is needed
+//
+// nodes are selected only by CSS selectors (HtmlNextFlatCssSelect), the patterns of HtmlSelect()
+// and HtmlFindAllObjects() work on HtmlObject* and are not run on flat documents, select on the
+// tree before flattening or keep it for them
+
+
+#define HTML_FLAT_NONE 0xFFFFFFFFu
+
+
+typedef struct HtmlFlatNode {
+    unsigned char type;         // HtmlObjectType
+    unsigned short atom;        // static HtmlAtom of name, or HTML_ATOM_DYNAMIC
+
+    unsigned int parent;        // HTML_FLAT_NONE for the first node
+    unsigned int prev;          // previous sibling, or HTML_FLAT_NONE
+    unsigned int end;           // node after the subtree
+
+    unsigned int attribute;     // first attribute, the ones before the next node's first are of this node
+
+    // offsets in text, 0 for NULL, name is not kept for static atoms
+    unsigned int name;
+    unsigned int innerText;
+    unsigned int afterText;
+} HtmlFlatNode;
+
+
+typedef struct HtmlFlatAttribute {
+    unsigned short atom;        // static HtmlAtom of name, or HTML_ATOM_DYNAMIC
+    unsigned int name;          // offset in text, 0 for a static atom
+    unsigned int value;         // offset in text, 0 for no value
+} HtmlFlatAttribute;
+
+
+typedef struct HtmlFlatDocument {
+    const HtmlFlatNode* nodes;      // the first is the object flattened
+    unsigned int count;
+
+    const HtmlFlatAttribute* attributes;
+    unsigned int attributeCount;
+
+    const char* text;               // NUL terminated strings, text[0] is empty
+    size_t textLength;
+} HtmlFlatDocument;
+
+
+
+
+// Accessing //
+
+#define HtmlLibIsFlatElement(node) \
+    ((node)->type == HTML_TYPE_TAG || (node)->type == HTML_TYPE_SINGLE || (node)->type == HTML_TYPE_SCRIPT)
+
+#define HtmlLibGetFlatAttributeEnd(flat, index) \
+    ((index) + 1 < (flat)->count ? (flat)->nodes[(index) + 1].attribute : (flat)->attributeCount)
+
+// name of atom, or the string at offset, NULL for none
+#define HtmlLibGetFlatName(flat, atom, offset) \
+    ((atom) && (atom) < HTML_ATOM_DYNAMIC ? HtmlLibAtomNames[atom] : (offset) ? (flat)->text + (offset) : NULL)
+
+// HtmlLibIsSameAtom() for names that can be NULL, a name without string is not the same as any
+bool HtmlLibIsSameFlatAtom(unsigned short atom1, const char* name1, unsigned short atom2, const char* name2) {
+    if (atom1 < HTML_ATOM_DYNAMIC || atom2 < HTML_ATOM_DYNAMIC) {
+        return atom1 == atom2;
+    }
+    return name1 && name2 && strcmp(name1, name2) == 0;
+}
+
+
+#define HtmlGetFlatParent(flat, index) ((flat)->nodes[index].parent)
+
+#define HtmlGetFlatPrev(flat, index) ((flat)->nodes[index].prev)
+
+#define HtmlGetFlatFirstChild(flat, index) \
+    ((flat)->nodes[index].end > (index) + 1 ? (index) + 1 : HTML_FLAT_NONE)
+
+#define HtmlGetFlatNext(flat, index) \
+    ((flat)->nodes[index].parent != HTML_FLAT_NONE && (flat)->nodes[index].end < (flat)->nodes[(flat)->nodes[index].parent].end ? \
+        (flat)->nodes[index].end : HTML_FLAT_NONE)
+
+#define HtmlGetFlatName(flat, index) \
+    HtmlLibGetFlatName(flat, (flat)->nodes[index].atom, (flat)->nodes[index].name)
+
+#define HtmlGetFlatInnerText(flat, index) ((flat)->text + (flat)->nodes[index].innerText)
+
+#define HtmlGetFlatAfterText(flat, index) ((flat)->text + (flat)->nodes[index].afterText)
+
+
+// attribute of node by name, or NULL
+const HtmlFlatAttribute* HtmlLibFindFlatAttribute(const HtmlFlatDocument* flat, unsigned int index, unsigned short atom, const char* name) {
+    for (unsigned int i = flat->nodes[index].attribute, end = HtmlLibGetFlatAttributeEnd(flat, index); i < end; i++) {
+        const HtmlFlatAttribute* attr = &flat->attributes[i];
+
+        if (HtmlLibIsSameFlatAtom(atom, name, attr->atom, HtmlLibGetFlatName(flat, attr->atom, attr->name))) {
+            return attr;
+        }
+    }
+    return NULL;
+}
+
+
+const char* HtmlGetFlatAttrValue(const HtmlFlatDocument* flat, unsigned int index, const char* attrName) {
+    HtmlHandleNullError(flat, NULL);
+    HtmlHandleEmptyStringError(attrName, NULL);
+    HtmlHandleError(index >= flat->count, NULL, "node %u out of %u nodes", index, flat->count);
+
+    unsigned short atom = HtmlLibLookupAtom(attrName, strlen(attrName));
+    const HtmlFlatAttribute* attr = HtmlLibFindFlatAttribute(flat, index, atom, attrName);
+    return attr && attr->value ? flat->text + attr->value : NULL;
+}
+
+
+
+
+// Flattening //
+
+typedef struct HtmlLibFlatBuilder {
+    HtmlFlatNode* nodes;
+    HtmlFlatAttribute* attributes;
+    char* text;
+
+    unsigned int count;
+    unsigned int attributeCount;
+    size_t textLength;
+} HtmlLibFlatBuilder;
+
+
+#define HtmlLibGetFlatAtom(atom) ((atom) < HTML_ATOM_DYNAMIC ? (atom) : HTML_ATOM_DYNAMIC)
+
+// size of a string in text
+#define HtmlLibGetFlatStringSize(str) ((str) ? strlen(str) + 1 : 0)
+
+// copy str to text, its offset or 0 for NULL
+unsigned int HtmlLibAddFlatString(HtmlLibFlatBuilder* builder, const char* str) {
+    if (str == NULL) {
+        return 0;
+    }
+
+    size_t size = strlen(str) + 1;
+    unsigned int offset = (unsigned int)builder->textLength;
+
+    memcpy(builder->text + offset, str, size);
+    builder->textLength += size;
+    return offset;
+}
+
+
+/* オブジェクトを平らなドキュメントにコピーする
+
+ノードはドキュメントの順の配列で、32 ビットの番号でつながり、文字列は一つのテキストにまとめられる
+一つのメモリブロックなので、HtmlObject のツリーより小さく、ノードを順に読むだけで辿れる
+ツリーは変更されず、コピーした後は削除しても良い
+
+@param object コピーするオブジェクト、結果のノード 0 になる
+@return 平らなドキュメント、HtmlDestroyFlatDocument() で解放する、失敗したら NULL
+*/
+HtmlFlatDocument* HtmlFlattenObject(const HtmlObject* object) {
+    HtmlHandleNullError(object, NULL);
+
+    // sizes
+    size_t count = 0, attributeCount = 0, textLength = 1;
+
+    for (const HtmlObject* node = object; node; node = HtmlLibNextIndexObject(node, object)) {
+        count++;
+        textLength += (node->atom && node->atom < HTML_ATOM_DYNAMIC ? 0 : HtmlLibGetFlatStringSize(node->name)) +
+            HtmlLibGetFlatStringSize(node->innerText) + HtmlLibGetFlatStringSize(node->afterText);
+
+        for (const HtmlAttribute* attr = node->attributes; attr < node->attributes + node->attributeCount; attr++) {
+            attributeCount++;
+            textLength += (attr->atom < HTML_ATOM_DYNAMIC ? 0 : HtmlLibGetFlatStringSize(attr->name)) + HtmlLibGetFlatStringSize(attr->value);
+        }
+    }
+
+    HtmlHandleError(count >= HTML_FLAT_NONE || attributeCount >= HTML_FLAT_NONE || textLength >= HTML_FLAT_NONE, NULL,
+        "object too large to flatten (%zu nodes, %zu bytes of text)", count, textLength);
+
+    // one block of document, nodes, attributes and text
+    HtmlFlatDocument* flat = (HtmlFlatDocument*)malloc(sizeof(HtmlFlatDocument) + count * sizeof(HtmlFlatNode) +
+        attributeCount * sizeof(HtmlFlatAttribute) + textLength);
+    HtmlHandleOutOfMemoryError(flat, NULL);
+
+    // objects of nodes while flattening, to find parents
+    const HtmlObject** objects = (const HtmlObject**)malloc(count * sizeof(HtmlObject*));
+    if (objects == NULL) {
+        free(flat);
+        HtmlHandleOutOfMemoryError(NULL, NULL);
+    }
+
+    HtmlLibFlatBuilder builder = {0};
+    builder.nodes = (HtmlFlatNode*)(flat + 1);
+    builder.attributes = (HtmlFlatAttribute*)(builder.nodes + count);
+    builder.text = (char*)(builder.attributes + attributeCount);
+    builder.text[builder.textLength++] = 0;
+
+    for (const HtmlObject* node = object; node; node = HtmlLibNextIndexObject(node, object)) {
+        unsigned int index = builder.count++;
+        unsigned int parent = index ? index - 1 : HTML_FLAT_NONE;
+        unsigned int prev = HTML_FLAT_NONE;
+
+        // subtrees before node end here, the last one closed is its previous sibling
+        while (index && objects[parent] != node->parent) {
+            builder.nodes[parent].end = index;
+            prev = parent;
+            parent = builder.nodes[parent].parent;
+        }
+        objects[index] = node;
+
+        HtmlFlatNode* flatNode = &builder.nodes[index];
+        flatNode->type = (unsigned char)node->type;
+        flatNode->atom = HtmlLibGetFlatAtom(node->atom);
+        flatNode->parent = parent;
+        flatNode->prev = prev;
+        flatNode->attribute = builder.attributeCount;
+
+        flatNode->name = node->atom && node->atom < HTML_ATOM_DYNAMIC ? 0 : HtmlLibAddFlatString(&builder, node->name);
+        flatNode->innerText = HtmlLibAddFlatString(&builder, node->innerText);
+        flatNode->afterText = HtmlLibAddFlatString(&builder, node->afterText);
+
+        for (const HtmlAttribute* attr = node->attributes; attr < node->attributes + node->attributeCount; attr++) {
+            HtmlFlatAttribute* flatAttr = &builder.attributes[builder.attributeCount++];
+
+            flatAttr->atom = HtmlLibGetFlatAtom(attr->atom);
+            flatAttr->name = attr->atom < HTML_ATOM_DYNAMIC ? 0 : HtmlLibAddFlatString(&builder, attr->name);
+            flatAttr->value = HtmlLibAddFlatString(&builder, attr->value);
+        }
+    }
+
+    // subtrees still open end at the last node
+    for (unsigned int parent = builder.count - 1; parent != HTML_FLAT_NONE; parent = builder.nodes[parent].parent) {
+        builder.nodes[parent].end = builder.count;
+    }
+    free(objects);
+
+    flat->nodes = builder.nodes;
+    flat->count = builder.count;
+    flat->attributes = builder.attributes;
+    flat->attributeCount = builder.attributeCount;
+    flat->text = builder.text;
+    flat->textLength = builder.textLength;
+    return flat;
+}
+
+
+void HtmlDestroyFlatDocument(HtmlFlatDocument* flat) {
+    free(flat);
+}
+
+
+
+
+// Text and Writing //
+
+// called entering a node, returns true to visit its children, or leaving it
+typedef bool (*HtmlLibFlatVisitor)(const HtmlFlatDocument* flat, unsigned int index, HtmlStream* stream);
+
+
+// visit the subtree of root in document order without recursion, root is left only if `leaveRoot`
+void HtmlLibWalkFlat(const HtmlFlatDocument* flat, unsigned int root, bool leaveRoot, HtmlLibFlatVisitor enter, HtmlLibFlatVisitor leave, HtmlStream* stream) {
+    const HtmlFlatNode* nodes = flat->nodes;
+    unsigned int index = root;
+
+    while (true) {
+        if (enter(flat, index, stream) && nodes[index].end > index + 1) {
+            index++;
+            continue;
+        }
+
+        // leave node, and its parents it is the last child of
+        while (index != root) {
+            leave(flat, index, stream);
+
+            unsigned int parent = nodes[index].parent;
+            if (nodes[index].end != nodes[parent].end) {
+                break;
+            }
+            index = parent;
+        }
+
+        if (index == root) {
+            if (leaveRoot) {
+                leave(flat, root, stream);
+            }
+            return;
+        }
+        index = nodes[index].end;
+    }
+}
+
+
+#define HtmlLibWriteFlatString(flat, offset, stream) \
+    if (offset) (stream)->write((void*)((flat)->text + (offset)), strlen((flat)->text + (offset)), 1, (stream)->data)
+
+
+// text like HtmlLibGetObjectText()
+bool HtmlLibEnterFlatText(const HtmlFlatDocument* flat, unsigned int index, HtmlStream* stream) {
+    const HtmlFlatNode* node = &flat->nodes[index];
+
+    if (node->atom == HTML_ATOM_BR) {
+        stream->write((void*)"\n", 1, 1, stream->data);
+        return false;
+    }
+    if (node->atom == HTML_ATOM_HR) {
+        stream->write((void*)"\n\n", 2, 1, stream->data);
+        return false;
+    }
+    if (HtmlLibIsIntegerIn(node->type, HTML_TYPE_SINGLE, HTML_TYPE_COMMENT, HTML_TYPE_DOCTYPE, HTML_TYPE_SCRIPT, -1)) {
+        return false;
+    }
+
+    HtmlLibWriteFlatString(flat, node->innerText, stream);
+    return true;
+}
+
+bool HtmlLibLeaveFlatText(const HtmlFlatDocument* flat, unsigned int index, HtmlStream* stream) {
+    HtmlLibWriteFlatString(flat, flat->nodes[index].afterText, stream);
+    return true;
+}
+
+
+// HTML like HtmlLibWriteObjectToStream()
+bool HtmlLibEnterFlatHtml(const HtmlFlatDocument* flat, unsigned int index, HtmlStream* stream) {
+    const HtmlFlatNode* node = &flat->nodes[index];
+
+    switch (node->type) {
+        case HTML_TYPE_DOCUMENT:
+            return true;
+
+        case HTML_TYPE_COMMENT:
+            stream->write((void*)"<!--", 4, 1, stream->data);
+            HtmlLibWriteFlatString(flat, node->innerText, stream);
+            stream->write((void*)"-->", 3, 1, stream->data);
+            return false;
+
+        case HTML_TYPE_DOCTYPE:
+            stream->write((void*)"<!DOCTYPE ", 10, 1, stream->data);
+            HtmlLibWriteFlatString(flat, node->innerText, stream);
+            stream->putchar('>', stream->data);
+            return false;
+
+        default:
+            break;
+    }
+
+    const char* name = HtmlGetFlatName(flat, index);
+    stream->putchar('<', stream->data);
+    stream->write((void*)name, strlen(name), 1, stream->data);
+
+    for (unsigned int i = node->attribute, end = HtmlLibGetFlatAttributeEnd(flat, index); i < end; i++) {
+        const HtmlFlatAttribute* attr = &flat->attributes[i];
+        const char* attrName = HtmlLibGetFlatName(flat, attr->atom, attr->name);
+
+        stream->putchar(' ', stream->data);
+        stream->write((void*)attrName, strlen(attrName), 1, stream->data);
+
+        if (attr->value) {
+            stream->putchar('=', stream->data);
+            HtmlLibWriteFormattedStringToStream(flat->text + attr->value, stream);
+        }
+    }
+
+    stream->putchar('>', stream->data);
+    HtmlLibWriteFlatString(flat, node->innerText, stream);
+    return true;
+}
+
+bool HtmlLibLeaveFlatHtml(const HtmlFlatDocument* flat, unsigned int index, HtmlStream* stream) {
+    const HtmlFlatNode* node = &flat->nodes[index];
+
+    if (node->type == HTML_TYPE_DOCUMENT) {
+        return true;
+    }
+    if (!HtmlLibIsIntegerIn(node->type, HTML_TYPE_SINGLE, HTML_TYPE_COMMENT, HTML_TYPE_DOCTYPE, -1)) {
+        const char* name = HtmlGetFlatName(flat, index);
+
+        stream->write((void*)"</", 2, 1, stream->data);
+        stream->write((void*)name, strlen(name), 1, stream->data);
+        stream->putchar('>', stream->data);
+    }
+
+    HtmlLibWriteFlatString(flat, node->afterText, stream);
+    return true;
+}
+
+
+
+
+/* ノードの下のテキストを取得する
+
+HtmlGetObjectTextToBuffer() と同じテキストになり、ドキュメントを変更しないので複数のスレッドから使える
+snprintf() と同じく size - 1 文字までで切られ、size が 0 でなければ NUL 終端される
+
+@param flat 平らなドキュメント
+@param index ノード
+@param buffer 呼び出し側のバッファ、size が 0 なら NULL でも良い
+@param size buffer のサイズ
+@return テキスト全体の長さ、size 以上なら切られている
+*/
+size_t HtmlGetFlatTextToBuffer(const HtmlFlatDocument* flat, unsigned int index, char* buffer, size_t size) {
+    HtmlLibFixedBuffer fixed = {buffer, size, 0};
+    HtmlStream stream = HtmlLibInitStreamFixedBuffer(&fixed);
+
+    if (flat && index < flat->count && (flat->nodes[index].type == HTML_TYPE_TAG || flat->nodes[index].type == HTML_TYPE_DOCUMENT)) {
+        HtmlLibWalkFlat(flat, index, false, HtmlLibEnterFlatText, HtmlLibLeaveFlatText, &stream);
+    }
+    return HtmlLibFinishFixedBuffer(&fixed);
+}
+
+
+HtmlCode HtmlGetFlatTextEx(const HtmlFlatDocument* flat, unsigned int index, HtmlStream* stream) {
+    HtmlHandleNullError(flat, HTML_NULL_POINTER);
+    HtmlHandleNullError(stream, HTML_NULL_POINTER);
+    HtmlHandleError(index >= flat->count, HTML_NULL_POINTER, "node %u out of %u nodes", index, flat->count);
+
+    if (flat->nodes[index].type == HTML_TYPE_TAG || flat->nodes[index].type == HTML_TYPE_DOCUMENT) {
+        HtmlLibWalkFlat(flat, index, false, HtmlLibEnterFlatText, HtmlLibLeaveFlatText, stream);
+    }
+    return HTML_OK;
+}
+
+
+HtmlCode HtmlWriteFlatToStream(const HtmlFlatDocument* flat, unsigned int index, HtmlStream* stream) {
+    HtmlHandleNullError(flat, HTML_NULL_POINTER);
+    HtmlHandleNullError(stream, HTML_NULL_POINTER);
+    HtmlHandleError(index >= flat->count, HTML_NULL_POINTER, "node %u out of %u nodes", index, flat->count);
+
+    HtmlLibWalkFlat(flat, index, true, HtmlLibEnterFlatHtml, HtmlLibLeaveFlatHtml, stream);
+    return HTML_OK;
+}
+
+
+/* ノードを HTML としてバッファに書き込む
+
+HtmlWriteObjectToBuffer() と同じ HTML になる
+
+@param flat 平らなドキュメント
+@param index ノード
+@param buffer 呼び出し側のバッファ、size が 0 なら NULL でも良い
+@param size buffer のサイズ
+@return HTML 全体の長さ、size 以上なら切られている
+*/
+size_t HtmlWriteFlatToBuffer(const HtmlFlatDocument* flat, unsigned int index, char* buffer, size_t size) {
+    HtmlLibFixedBuffer fixed = {buffer, size, 0};
+    HtmlStream stream = HtmlLibInitStreamFixedBuffer(&fixed);
+
+    if (flat && index < flat->count) {
+        HtmlLibWalkFlat(flat, index, true, HtmlLibEnterFlatHtml, HtmlLibLeaveFlatHtml, &stream);
+    }
+    return HtmlLibFinishFixedBuffer(&fixed);
+}
+
+
+
+
+// Selecting //
+//
+// the ops of a HtmlCssSelector run on nodes like HtmlLibRunCssOps(), a select is a scan of
+// the subtree range, class tokens are read from the class value as there are no class lists
+
+// parent element of node, documents between are passed through
+unsigned int HtmlLibGetFlatCssParent(const HtmlFlatDocument* flat, unsigned int index) {
+    for (index = flat->nodes[index].parent; index != HTML_FLAT_NONE; index = flat->nodes[index].parent) {
+        if (flat->nodes[index].type == HTML_TYPE_TAG) {
+            return index;
+        }
+    }
+    return HTML_FLAT_NONE;
+}
+
+unsigned int HtmlLibGetFlatCssSibling(const HtmlFlatDocument* flat, unsigned int index, bool previous) {
+    do {
+        index = previous ? flat->nodes[index].prev : HtmlGetFlatNext(flat, index);
+    } while (index != HTML_FLAT_NONE && !HtmlLibIsFlatElement(&flat->nodes[index]));
+
+    return index;
+}
+
+
+// position of node from 1 in its sibling elements, the ones of its name if `ofType`
+int HtmlLibGetFlatCssPosition(const HtmlFlatDocument* flat, unsigned int index, bool last, bool ofType) {
+    const HtmlFlatNode* node = &flat->nodes[index];
+    int position = 1;
+
+    for (unsigned int sibling = index; (sibling = HtmlLibGetFlatCssSibling(flat, sibling, !last)) != HTML_FLAT_NONE; ) {
+        if (!ofType || HtmlLibIsSameFlatAtom(node->atom, HtmlGetFlatName(flat, index), flat->nodes[sibling].atom, HtmlGetFlatName(flat, sibling))) {
+            position++;
+        }
+    }
+    return position;
+}
+
+
+// `name` of `length` is a word of the class value of node
+bool HtmlLibHasFlatClass(const HtmlFlatDocument* flat, unsigned int index, const char* name, size_t length) {
+    const HtmlFlatAttribute* attr = HtmlLibFindFlatAttribute(flat, index, HTML_ATOM_CLASS, "class");
+    if (attr == NULL || attr->value == 0) {
+        return false;
+    }
+
+    for (const char* p = flat->text + attr->value; *p; ) {
+        while (HtmlLibIsSpaceByte(*p)) p++;
+
+        const char* word = p;
+        while (*p && !HtmlLibIsSpaceByte(*p)) p++;
+
+        if ((size_t)(p - word) == length && memcmp(word, name, length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool HtmlLibRunFlatCssList(const HtmlCssOp* op, const HtmlCssOp* end, const HtmlFlatDocument* flat, unsigned int index, const char* strings);
+
+// run ops of a selector on an element node until HTML_CSS_MATCH
+HtmlLibCssResult HtmlLibRunFlatCssOps(const HtmlCssOp* op, const HtmlFlatDocument* flat, unsigned int index, const char* strings) {
+    const HtmlFlatAttribute* attr = NULL;
+    const HtmlFlatNode* node = &flat->nodes[index];
+    HtmlLibCssResult result;
+
+    for (;; op++) {
+        switch (op->code) {
+            case HTML_CSS_MATCH:
+                return HTML_CSS_MATCHED;
+
+            case HTML_CSS_NAME:
+                if (!HtmlLibIsSameFlatAtom(op->atom, strings + op->string, node->atom, HtmlGetFlatName(flat, index))) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+
+            case HTML_CSS_CLASS:
+                if (!HtmlLibHasFlatClass(flat, index, strings + op->string, (size_t)op->b)) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+
+            case HTML_CSS_ID:
+                attr = HtmlLibFindFlatAttribute(flat, index, HTML_ATOM_ID, "id");
+                if (attr == NULL || attr->value == 0 || strcmp(flat->text + attr->value, strings + op->string) != 0) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+
+            case HTML_CSS_ATTRIBUTE:
+                attr = HtmlLibFindFlatAttribute(flat, index, op->atom, strings + op->string);
+                if (attr == NULL) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+
+            case HTML_CSS_VALUE_EQUAL:
+            case HTML_CSS_VALUE_INCLUDE:
+            case HTML_CSS_VALUE_DASH:
+            case HTML_CSS_VALUE_PREFIX:
+            case HTML_CSS_VALUE_SUFFIX:
+            case HTML_CSS_VALUE_SUBSTRING:
+                if (!HtmlLibIsCssValueSuit(op, flat->text + attr->value, strings + op->string)) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+
+            case HTML_CSS_NTH_CHILD:
+            case HTML_CSS_NTH_LAST_CHILD:
+            case HTML_CSS_NTH_OF_TYPE:
+            case HTML_CSS_NTH_LAST_OF_TYPE: {
+                int position = HtmlLibGetFlatCssPosition(flat, index,
+                    op->code == HTML_CSS_NTH_LAST_CHILD || op->code == HTML_CSS_NTH_LAST_OF_TYPE,
+                    op->code == HTML_CSS_NTH_OF_TYPE || op->code == HTML_CSS_NTH_LAST_OF_TYPE);
+
+                if (!HtmlLibIsCssNth(position, op->a, op->b)) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+            }
+
+            case HTML_CSS_EMPTY:
+                // no text and no children but comments
+                if (flat->text[node->innerText]) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                for (unsigned int child = index + 1; child < node->end; child = flat->nodes[child].end) {
+                    if (flat->nodes[child].type != HTML_TYPE_COMMENT || flat->text[flat->nodes[child].afterText]) {
+                        return HTML_CSS_FAILED_HERE;
+                    }
+                }
+                break;
+
+            case HTML_CSS_ROOT:
+                if (HtmlLibGetFlatCssParent(flat, index) != HTML_FLAT_NONE) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+
+            case HTML_CSS_NOT:
+                if (HtmlLibRunFlatCssList(op + 1, op + 1 + op->a, flat, index, strings)) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                op += op->a;
+                break;
+
+            case HTML_CSS_IS:
+                if (!HtmlLibRunFlatCssList(op + 1, op + 1 + op->a, flat, index, strings)) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                op += op->a;
+                break;
+
+            case HTML_CSS_PARENT:
+                if ((index = HtmlLibGetFlatCssParent(flat, index)) == HTML_FLAT_NONE) {
+                    return HTML_CSS_FAILED_ALL;
+                }
+                node = &flat->nodes[index];
+                break;
+
+            case HTML_CSS_PREV:
+                if ((index = HtmlLibGetFlatCssSibling(flat, index, true)) == HTML_FLAT_NONE) {
+                    return HTML_CSS_FAILED_SIBLINGS;
+                }
+                node = &flat->nodes[index];
+                break;
+
+            case HTML_CSS_ANCESTOR:
+                while ((index = HtmlLibGetFlatCssParent(flat, index)) != HTML_FLAT_NONE) {
+                    result = HtmlLibRunFlatCssOps(op + 1, flat, index, strings);
+                    if (result == HTML_CSS_MATCHED || result == HTML_CSS_FAILED_ALL) {
+                        return result;
+                    }
+                }
+                return HTML_CSS_FAILED_ALL;
+
+            case HTML_CSS_PREV_ANY:
+                while ((index = HtmlLibGetFlatCssSibling(flat, index, true)) != HTML_FLAT_NONE) {
+                    result = HtmlLibRunFlatCssOps(op + 1, flat, index, strings);
+                    if (result != HTML_CSS_FAILED_HERE) {
+                        return result;
+                    }
+                }
+                return HTML_CSS_FAILED_SIBLINGS;
+
+            default:
+                return HTML_CSS_FAILED_ALL;
+        }
+    }
+}
+
+
+// true if a selector in [op, end) matches
+bool HtmlLibRunFlatCssList(const HtmlCssOp* op, const HtmlCssOp* end, const HtmlFlatDocument* flat, unsigned int index, const char* strings) {
+    for (; op < end; op += op->a + 1) {
+        if (HtmlLibRunFlatCssOps(op + 1, flat, index, strings) == HTML_CSS_MATCHED) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool HtmlMatchFlatCssSelector(const HtmlFlatDocument* flat, unsigned int index, const HtmlCssSelector* selector) {
+    HtmlHandleNullError(flat, false);
+    HtmlHandleNullError(selector, false);
+
+    return index < flat->count && HtmlLibIsFlatElement(&flat->nodes[index]) &&
+        HtmlLibRunFlatCssList(selector->ops, selector->ops + selector->length, flat, index, selector->strings);
+}
+
+
+/* 次に CSS セレクターに合うノードを返す
+
+root の下のノードを順に調べるだけなので、状態はいらない
+
+for (unsigned int i = HtmlNextFlatCssSelect(flat, 0, 0, selector); i != HTML_FLAT_NONE; i = HtmlNextFlatCssSelect(flat, 0, i, selector)) {
+    // do something ...
+}
+
+@param flat 平らなドキュメント
+@param root 検索するノード
+@param index 前の結果、最初は root
+@param selector HtmlCompileCssSelector() の結果
+@return 次のノード、なければ HTML_FLAT_NONE
+*/
+unsigned int HtmlNextFlatCssSelect(const HtmlFlatDocument* flat, unsigned int root, unsigned int index, const HtmlCssSelector* selector) {
+    HtmlHandleNullError(flat, HTML_FLAT_NONE);
+    HtmlHandleNullError(selector, HTML_FLAT_NONE);
+
+    if (root >= flat->count || index < root) {
+        return HTML_FLAT_NONE;
+    }
+
+    for (index++; index < flat->nodes[root].end; index++) {
+        if (HtmlLibIsFlatElement(&flat->nodes[index]) &&
+                HtmlLibRunFlatCssList(selector->ops, selector->ops + selector->length, flat, index, selector->strings)) {
+            return index;
+        }
+    }
+    return HTML_FLAT_NONE;
+}
+
+
+#endif /* _MYHTML_FLAT_H_ */
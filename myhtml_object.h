@@ -11,6 +11,11 @@
 #include <stdbool.h>
 #include <stdarg.h>
 
+#ifndef _MYHTML_ATOM_H_
+#include "myhtml_atom.h"
+#include "myhtml_scan.h"
+#endif
+
 
 // Enums //
 
@@ -60,6 +65,21 @@ typedef enum HtmlObjectType {
 } HtmlObjectType;
 
 
+// marks strings that point into memory owned by the document (e.g. in-situ source)
+// instead of being malloc'd one by one, these are never passed to free()
+typedef enum HtmlMemoryFlag {
+	HTML_BORROWED_NAME = 0x01,
+	HTML_BORROWED_INNER_TEXT = 0x02,
+	HTML_BORROWED_AFTER_TEXT = 0x04,
+	HTML_BORROWED_OBJECT = 0x08,			// the HtmlObject itself
+	HTML_BORROWED_CLASS_LIST = 0x10,
+	HTML_BORROWED_ATTRIBUTES = 0x20,		// the array of attributes
+
+	HTML_BORROWED_ATTR_NAME = 0x01,			// also set for names of static atoms
+	HTML_BORROWED_ATTR_VALUE = 0x02,
+} HtmlMemoryFlag;
+
+
 
 // Pre-Defines //
 
@@ -69,6 +89,9 @@ typedef size_t (*HtmlCallbackRead)(void* buf, size_t n, size_t size, void* strea
 typedef int (*HtmlCallbackPutchar)(int c, void* streamData);
 typedef size_t (*HtmlCallbackWrite)(void* buf, size_t size, size_t n, void* streamData);
 
+typedef const char* (*HtmlCallbackPeek)(void* streamData, size_t* length);
+typedef void (*HtmlCallbackConsume)(void* streamData, size_t n);
+
 typedef int (*HtmlCallbackSeek)(void* streamData, long move, int seek);
 typedef size_t (*HtmlCallbackTell)(void* streamData);
 typedef void (*HtmlCallbackDestroy)(void* streamData);
@@ -87,26 +110,93 @@ typedef struct HtmlObject HtmlObject;
 typedef struct HtmlAttribute {
 	char* name;
 	char* value;
-	
-	HtmlAttribute* prev, *next;
+	unsigned short flags;	// HtmlMemoryFlag
+	unsigned short atom;	// HtmlAtom of name
 } HtmlAttribute;
 
 
+// class tokens of an element, made from its first class attribute when it is parsed or set
+typedef struct HtmlLibClassToken {
+	unsigned int hash;		// HtmlLibHashName() of token
+	unsigned int offset;	// token in value
+	unsigned int length;
+} HtmlLibClassToken;
+
+typedef struct HtmlLibClassList {
+	unsigned long long bloom;	// HtmlLibGetClassBloom() of all tokens
+	const char* value;			// value of class attribute
+	unsigned int count;
+	HtmlLibClassToken* tokens;	// in the same memory after the list
+} HtmlLibClassList;
+
+#define HtmlLibGetClassBloom(hash) ((1ULL << ((hash) & 63)) | (1ULL << ((hash) >> 6 & 63)))
+
+
+// text of HtmlGetObjectText(), it is old when generation is not the one of its object
+typedef struct HtmlLibTextCache {
+	unsigned int generation;
+	size_t length;
+	char text[];
+} HtmlLibTextCache;
+
+
 typedef struct HtmlObject {
 	HtmlObjectType type;
+	unsigned short flags;	// HtmlMemoryFlag
+	unsigned short atom;	// HtmlAtom of name
 	
 	char* name;
 	char* innerText;
 	char* afterText;
 	
 	HtmlObject* firstChild, *lastChild;
-	HtmlAttribute* firstAttribute, *lastAttribute;
+	HtmlAttribute* attributes;	// attributeCount in a row, moved when they grow over attributeCapacity
+	unsigned short attributeCount, attributeCapacity;
+	unsigned int generation;		// bumped when text under the object changes
+	HtmlLibClassList* classList;	// tokens of class, or NULL
+	unsigned long long subtreeBloom;	// HtmlLibGetKeyBloom() of names, classes and ids under the object
 	
+	HtmlLibTextCache* textCache;	// malloc'd, or NULL
+
 	HtmlObject* parent;
 	HtmlObject* prev, *next;
 } HtmlObject;
 
 
+// bump allocator, memory is only given back by destroying the whole arena
+typedef struct HtmlArenaChunk HtmlArenaChunk;
+
+typedef struct HtmlArenaChunk {
+	HtmlArenaChunk* prev;
+	size_t used;
+	size_t capacity;
+	// chunk data follows
+} HtmlArenaChunk;
+
+typedef struct HtmlArena {
+	HtmlArenaChunk* chunk;
+	size_t nextCapacity;
+} HtmlArena;
+
+
+// every HTML_TYPE_DOCUMENT object is allocated as HtmlDocument
+// so that it can own memory shared by its objects
+//
+// objects, attributes and strings created under a document come from its arena,
+// they stay valid until the document is destroyed even after moved to another tree
+typedef struct HtmlDocument {
+	HtmlObject object;		// must be first, (HtmlObject*)document == &document->object
+
+	HtmlArena arena;		// memory of objects, attributes and strings
+	char* source;			// in-situ source buffer, freed with the document
+	HtmlLibAtomTable atoms;	// ids of names not known
+
+	bool mixed;				// malloc'd objects or strings were attached, destroy has to walk the tree
+
+	struct HtmlLibDocumentIndex* index;	// made by HtmlIndexDocument(), or NULL
+} HtmlDocument;
+
+
 
 
 // Useful Macros //
@@ -130,32 +220,36 @@ int HtmlLibLowerChar(int c)	{
 		p = NULL;\
 	}
 
-#define HtmlSetText(var, text) \
-	HtmlLibDestroyPointer(var);\
-	if (text) {\
-		var = (char*)malloc(strlen(text) + 1);\
-		strcpy(var, text);\
+// deprecated: it frees `var` by free() but strings of objects can be in document memory or input of in-situ parsing,
+// use HtmlSetObjectName(), HtmlSetObjectInnerText() or HtmlSetObjectAfterText() for objects
+#ifdef __GNUC__
+__attribute__((deprecated("use HtmlSetObjectName(), HtmlSetObjectInnerText() or HtmlSetObjectAfterText()")))
+#endif
+char* HtmlLibReplaceText(char* var, const char* text) {
+	free(var);
+	if (text == NULL) {
+		return NULL;
 	}
 
+	char* str = (char*)malloc(strlen(text) + 1);
+	return str ? strcpy(str, text) : NULL;
+}
 
-void HtmlLibSetTextLowered(char** var, const char* text) {
-	if (*var) {
-		HtmlLibDestroyPointer((*var));
-	}
-	if (text) {
-		*var = (char*)malloc(strlen(text) + 1);
+#define HtmlSetText(var, text) ((var) = HtmlLibReplaceText((var), (text)))
 
-		int c;
-		char* p = *var;
-		while ((c = *text++)) {
-			*p++ = HtmlLibLowerChar(c);
-		}
-		*p++ = 0;
+
+// free a string unless it is borrowed from document memory
+void HtmlLibReleaseString(char** var, unsigned short* flags, unsigned short borrowFlag) {
+	if ((*flags & borrowFlag) == 0) {
+		free(*var);
 	}
+	*var = NULL;
+	*flags &= ~borrowFlag;
 }
 
 
 
+
 // Error Handle without debug message
 #ifdef HTML_NO_DEBUG
 #define HtmlHandleError(check, retValue, ...) \
@@ -233,45 +327,137 @@ bool HtmlLibIsIntegerIn(int compareValue, ...) {
 
 
 
+// HtmlArena //
+
+#define HTML_ARENA_FIRST_CHUNK 8192
+#define HTML_ARENA_MAX_CHUNK (1 << 20)
+
+
+void* HtmlLibAllocArena(HtmlArena* arena, size_t size, size_t align) {
+	HtmlArenaChunk* chunk = arena->chunk;
+
+	// bump in current chunk
+	if (chunk) {
+		size_t offset = (chunk->used + align - 1) & ~(align - 1);
+
+		if (offset + size <= chunk->capacity) {
+			chunk->used = offset + size;
+			return (char*)(chunk + 1) + offset;
+		}
+	}
+
+	// big memory takes a chunk for itself, placed behind current chunk to keep its free space
+	size_t capacity = arena->nextCapacity ? arena->nextCapacity : HTML_ARENA_FIRST_CHUNK;
+	bool dedicated = size > capacity / 2;
+	if (dedicated) {
+		capacity = size;
+	}
+
+	HtmlArenaChunk* newChunk = (HtmlArenaChunk*)malloc(sizeof(HtmlArenaChunk) + capacity);
+	HtmlHandleOutOfMemoryError(newChunk, NULL);
+
+	newChunk->used = size;
+	newChunk->capacity = capacity;
+
+	if (dedicated && chunk) {
+		newChunk->prev = chunk->prev;
+		chunk->prev = newChunk;
+	}
+	else {
+		newChunk->prev = chunk;
+		arena->chunk = newChunk;
+	}
+
+	if (!dedicated) {
+		arena->nextCapacity = MIN(capacity * 2, HTML_ARENA_MAX_CHUNK);
+	}
+	return newChunk + 1;
+}
+
+// grow the last block of current chunk in place, false if another block is after it or the chunk is full
+bool HtmlLibExtendArena(HtmlArena* arena, void* block, size_t size, size_t newSize) {
+	HtmlArenaChunk* chunk = arena->chunk;
+	char* data = chunk ? (char*)(chunk + 1) : NULL;
+
+	if (chunk == NULL || (char*)block < data || (char*)block + size != data + chunk->used ||
+			(size_t)((char*)block - data) + newSize > chunk->capacity) {
+		return false;
+	}
+	chunk->used = (size_t)((char*)block - data) + newSize;
+	return true;
+}
+
+
+void HtmlLibDestroyArena(HtmlArena* arena) {
+	HtmlArenaChunk* prev;
+
+	while (arena->chunk) {
+		prev = arena->chunk->prev;
+		free(arena->chunk);
+		arena->chunk = prev;
+	}
+	arena->nextCapacity = 0;
+}
+
+// move chunks of `from` to `arena`, placed behind current chunk to keep its free space
+void HtmlLibMergeArena(HtmlArena* arena, HtmlArena* from) {
+	HtmlArenaChunk* last = from->chunk;
+	if (last == NULL) {
+		return;
+	}
+	while (last->prev) {
+		last = last->prev;
+	}
+
+	if (arena->chunk) {
+		last->prev = arena->chunk->prev;
+		arena->chunk->prev = from->chunk;
+	}
+	else {
+		arena->chunk = from->chunk;
+		arena->nextCapacity = from->nextCapacity;
+	}
+	from->chunk = NULL;
+	from->nextCapacity = 0;
+}
+
+
+
+
 // HtmlAttributeIterator //
 
+// attributes are read by index from the object, adding one while iterating is safe,
+// removing the current one makes the next step skip the attribute after it
 typedef struct HtmlAttributeIterator {
-	HtmlAttribute* prev, *now, *next;
+	const HtmlObject* object;
+	int index;				// of now, -1 before the first and count after the last
+	HtmlAttribute* now;
 } HtmlAttributeIterator;
 
 
 
 
-#define HtmlBeginAttribute(object) (HtmlAttributeIterator){NULL, NULL, object ? object->firstAttribute : NULL}
+#define HtmlBeginAttribute(object) (HtmlAttributeIterator){object, -1, NULL}
 
-#define HtmlEndAttribute(object) (HtmlAttributeIterator){object ? object->lastAttribute : NULL, NULL, NULL}
+#define HtmlEndAttribute(object) (HtmlAttributeIterator){object, object ? (object)->attributeCount : 0, NULL}
 
 
-bool HtmlNextAttribute(HtmlAttributeIterator* iter, const char** attrName, const char** attrValue) {
-	iter->prev = iter->now;
-	iter->now = iter->next;
-	
+bool HtmlLibSetAttributeIterator(HtmlAttributeIterator* iter, int index, const char** attrName, const char** attrValue) {
+	int count = iter->object ? iter->object->attributeCount : 0;
+
+	iter->index = MAX(-1, MIN(index, count));
+	iter->now = iter->index >= 0 && iter->index < count ? &iter->object->attributes[iter->index] : NULL;
+
 	if (iter->now) {
-		iter->next = iter->now->next;
-        
         *attrName = iter->now->name;
         *attrValue = iter->now->value;
 	}
 	return iter->now;
 }
 
-bool HtmlPrevAttribute(HtmlAttributeIterator* iter, const char** attrName, const char** attrValue) {
-	iter->next = iter->now;
-	iter->now = iter->prev;
-	
-	if (iter->now) {
-		iter->prev = iter->now->prev;
+#define HtmlNextAttribute(iter, attrName, attrValue) HtmlLibSetAttributeIterator(iter, (iter)->index + 1, attrName, attrValue)
 
-        *attrName = iter->now->name;
-        *attrValue = iter->now->value;
-	}
-	return iter->now;
-}
+#define HtmlPrevAttribute(iter, attrName, attrValue) HtmlLibSetAttributeIterator(iter, (iter)->index - 1, attrName, attrValue)
 
 
 #define HtmlForeachObjectAttributes(object, attrName, attrValue) \
@@ -330,6 +516,11 @@ typedef struct HtmlStream {
 	HtmlCallbackWrite write;
 	HtmlCallbackSeek seek;
 	HtmlCallbackTell tell;
+
+	// optional buffered window for reading without a call per byte
+	// `peek` gives the next contiguous span without moving, `consume` moves forward n bytes
+	HtmlCallbackPeek peek;
+	HtmlCallbackConsume consume;
 } HtmlStream;
 
 typedef struct HtmlStreamString {
@@ -351,7 +542,8 @@ void HtmlDestroyStream(HtmlStream* stream) {
 	}
 }
 
-#define HtmlIsStreamReadable(stream) (stream && stream->getchar && stream->read)
+#define HtmlIsStreamReadable(stream) (stream && (stream->getchar || stream->read || HtmlIsStreamBuffered(stream)))
+#define HtmlIsStreamBuffered(stream) (stream && stream->peek && stream->consume)
 #define HtmlIsStreamWritable(stream) (stream && stream->putchar && stream->write)
 #define HtmlIsStreamSeekable(stream) (stream && stream->seek)
 
@@ -443,6 +635,16 @@ size_t HtmlLibWriteStreamString(void* content, size_t size, size_t n, HtmlStream
 }
 
 
+const char* HtmlLibPeekStreamString(HtmlStreamString* streamData, size_t* length) {
+	*length = streamData->length - streamData->position;
+	return streamData->buffer + streamData->position;
+}
+
+void HtmlLibConsumeStreamString(HtmlStreamString* streamData, size_t n) {
+	streamData->position += MIN(n, streamData->length - streamData->position);
+}
+
+
 int HtmlLibSeekStreamString(HtmlStreamString* streamData, long move, int seek) {
 	if (seek == SEEK_SET) {
 		streamData->position = move;
@@ -487,7 +689,9 @@ void HtmlLibDestroyStringStream(HtmlStreamString* streamData) {
 		.putchar = (HtmlCallbackPutchar)HtmlLibPutcharToStreamString,\
 		.write = (HtmlCallbackWrite)HtmlLibWriteStreamString,\
 		.seek = (HtmlCallbackSeek)HtmlLibSeekStreamString,\
-		.tell = (HtmlCallbackTell)HtmlLibTellStreamString\
+		.tell = (HtmlCallbackTell)HtmlLibTellStreamString,\
+		.peek = (HtmlCallbackPeek)HtmlLibPeekStreamString,\
+		.consume = (HtmlCallbackConsume)HtmlLibConsumeStreamString\
 	}
 
 HtmlStream HtmlCreateStreamBuffer(size_t blockSize) {
@@ -566,6 +770,49 @@ HtmlCode HtmlClearStreamBuffer(HtmlStream* stream) {
 
 
 
+// fixed buffer of caller, bytes after its size are counted but dropped
+
+typedef struct HtmlLibFixedBuffer {
+	char* buffer;
+	size_t size;
+	size_t length;		// length of whole output
+} HtmlLibFixedBuffer;
+
+
+size_t HtmlLibWriteFixedBuffer(void* content, size_t size, size_t n, HtmlLibFixedBuffer* fixed) {
+	size_t total = size * n;
+
+	if (fixed->length + 1 < fixed->size) {
+		memcpy(fixed->buffer + fixed->length, content, MIN(total, fixed->size - fixed->length - 1));
+	}
+	fixed->length += total;
+	return total;
+}
+
+int HtmlLibPutcharToFixedBuffer(int c, HtmlLibFixedBuffer* fixed) {
+	char ch = (char)c;
+	HtmlLibWriteFixedBuffer(&ch, 1, 1, fixed);
+	return c;
+}
+
+// terminate the buffer, return length of whole output
+size_t HtmlLibFinishFixedBuffer(HtmlLibFixedBuffer* fixed) {
+	if (fixed->size) {
+		fixed->buffer[MIN(fixed->length, fixed->size - 1)] = 0;
+	}
+	return fixed->length;
+}
+
+#define HtmlLibInitStreamFixedBuffer(fixed) \
+	(HtmlStream){\
+		.data = fixed,\
+		.putchar = (HtmlCallbackPutchar)HtmlLibPutcharToFixedBuffer,\
+		.write = (HtmlCallbackWrite)HtmlLibWriteFixedBuffer\
+	}
+
+
+
+
 // StreamFile
 
 HtmlStream HtmlCreateStreamFileObject(FILE* file) {
@@ -601,19 +848,469 @@ HtmlStream HtmlCreateStreamFile(const char* filename, const char* mode) {
 
 HtmlObject* HtmlLibAddObjectChild(HtmlObject* parent, HtmlObject* child);
 
-HtmlObject* HtmlLibCreateObject(HtmlObjectType type, const char* name, HtmlObject* parent) {
-	// assign memory
-	HtmlObject* object = (HtmlObject*)calloc(1, sizeof(HtmlObject));
-    HtmlHandleOutOfMemoryError(object, NULL);
 
-	// set value
+// document at the root of object, or NULL if the object is not in a document
+HtmlDocument* HtmlLibGetObjectDocument(HtmlObject* object) {
+	while (object && object->parent) {
+		object = object->parent;
+	}
+	return object && object->type == HTML_TYPE_DOCUMENT ? (HtmlDocument*)object : NULL;
+}
+
+
+// atom of `name`, names not known are found in the document
+unsigned short HtmlLibFindAtom(HtmlDocument* document, const char* name, size_t length) {
+	unsigned short atom = HtmlLibLookupAtom(name, length);
+
+	if (atom == HTML_ATOM_DYNAMIC && document) {
+		atom = HtmlLibFindDynamicAtom(&document->atoms, name, length);
+	}
+	return atom;
+}
+
+// static atom of `name` in any case, HTML_ATOM_DYNAMIC if not known
+unsigned short HtmlLibLookupAtomLowered(const char* name, size_t length) {
+	char lowered[HTML_ATOM_NAME_MAX] = {0};
+
+	if (length > HTML_ATOM_NAME_MAX) {
+		return HTML_ATOM_DYNAMIC;
+	}
+	for (size_t i = 0; i < length; i++) {
+		lowered[i] = (char)HtmlLibLowerChar(name[i]);
+	}
+	return HtmlLibLookupAtom(lowered, length);
+}
+
+// atom of `name`, names not known get ids from the document
+// `name` must be in document memory
+unsigned short HtmlLibInternAtom(HtmlDocument* document, const char* name, size_t length) {
+	unsigned short atom = HtmlLibLookupAtom(name, length);
+
+	if (atom == HTML_ATOM_DYNAMIC && document) {
+		atom = HtmlLibInternDynamicAtom(&document->atoms, name, length);
+	}
+	return atom;
+}
+
+
+// memory from document arena, or malloc() without document
+void* HtmlLibAllocMemory(HtmlDocument* document, size_t size, size_t align) {
+	return document ? HtmlLibAllocArena(&document->arena, size, align) : malloc(size);
+}
+
+// copy string to document memory, `*flags` gets `borrowFlag` when it is in document
+char* HtmlLibCopyString(HtmlDocument* document, const char* text, size_t length, unsigned short* flags, unsigned short borrowFlag) {
+	char* str = (char*)HtmlLibAllocMemory(document, length + 1, 1);
+	HtmlHandleOutOfMemoryError(str, NULL);
+
+	memcpy(str, text, length);
+	str[length] = 0;
+
+	if (document) {
+		*flags |= borrowFlag;
+	}
+	else {
+		*flags &= ~borrowFlag;
+	}
+	return str;
+}
+
+// text under object changed, cached texts of it and its ancestors are old
+void HtmlLibChangeObjectText(HtmlObject* object) {
+	for (; object; object = object->parent) {
+		object->generation++;
+	}
+}
+
+// the document of object gets memory not from its arena
+void HtmlLibMarkObjectMixed(HtmlObject* object) {
+	HtmlDocument* document = HtmlLibGetObjectDocument(object);
+
+	if (document) {
+		document->mixed = true;
+	}
+}
+
+
+// replace a string of object, new string comes from its document
+// the old one is freed only if it is not borrowed (document memory, input of in-situ parsing, static atom name)
+void HtmlLibSetObjectString(HtmlObject* object, char** var, unsigned short borrowFlag, const char* text) {
+	HtmlLibReleaseString(var, &object->flags, borrowFlag);
+
+	if (text) {
+		*var = HtmlLibCopyString(HtmlLibGetObjectDocument(object), text, strlen(text), &object->flags, borrowFlag);
+	}
+	if (*var && (object->flags & borrowFlag) == 0) {
+		HtmlLibMarkObjectMixed(object);
+	}
+	HtmlLibChangeObjectText(object);
+}
+
+// element by a key, lists are sorted by key, then document order
+typedef struct HtmlLibIndexEntry {
+	HtmlObject* object;
+	unsigned int order;		// position of object in document
+	unsigned int key;		// name atom, or HtmlLibHashName() of id or class
+} HtmlLibIndexEntry;
+
+typedef struct HtmlLibIndexList {
+	HtmlLibIndexEntry* entries;
+	size_t count;
+	size_t capacity;
+} HtmlLibIndexList;
+
+typedef struct HtmlLibDocumentIndex {
+	bool stale;					// tree, ids or classes changed after building, built again by the next select
+
+	HtmlLibIndexList names;
+	HtmlLibIndexList ids;
+	HtmlLibIndexList classes;	// one entry for each class token
+	bool uninterned;			// some names have no atom of document, they can not be looked up
+} HtmlLibDocumentIndex;
+
+
+void HtmlLibDestroyDocumentIndex(HtmlLibDocumentIndex* index) {
+	if (index == NULL) {
+		return;
+	}
+
+	free(index->names.entries);
+	free(index->ids.entries);
+	free(index->classes.entries);
+	free(index);
+}
+
+// tree, ids or classes of document changed, its index has to be built again
+// (not updated here on purpose, see Document Index in myhtml_select.h)
+void HtmlLibChangeDocumentTree(HtmlDocument* document) {
+	if (document && document->index) {
+		document->index->stale = true;
+	}
+}
+
+
+HtmlObject* HtmlLibAllocObject(HtmlDocument* document, HtmlObjectType type) {
+	HtmlObject* object = (HtmlObject*)HtmlLibAllocMemory(document, sizeof(HtmlObject), sizeof(void*));
+	HtmlHandleOutOfMemoryError(object, NULL);
+
+	memset(object, 0, sizeof(HtmlObject));
 	object->type = type;
-	HtmlLibSetTextLowered(&object->name, name);
-	
+	object->flags = document ? HTML_BORROWED_OBJECT : 0;
+	return object;
+}
+
+#define HTML_ATTRIBUTE_FIRST_CAPACITY 4
+
+// room for `more` attributes after the ones of object, the array moves when it grows
+// so an HtmlAttribute* is valid until another attribute of the object is added or removed
+bool HtmlLibReserveObjectAttributes(HtmlDocument* document, HtmlObject* object, size_t more) {
+	size_t needed = object->attributeCount + more;
+	size_t size = object->attributeCapacity * sizeof(HtmlAttribute);
+	bool borrowed = object->flags & HTML_BORROWED_ATTRIBUTES;
+
+	if (needed <= object->attributeCapacity) {
+		return true;
+	}
+	HtmlHandleError(needed > 0xFFFF, false, "too many attributes in '%s'", object->name ? object->name : "");
+
+	// attributes put one after another in document memory (in-situ parsing) grow in place, exactly as many as there are
+	if (document && borrowed && size && HtmlLibExtendArena(&document->arena, object->attributes, size, needed * sizeof(HtmlAttribute))) {
+		object->attributeCapacity = (unsigned short)needed;
+		return true;
+	}
+
+	size_t capacity = object->attributeCapacity == 0 && document ? needed : MAX(needed, MAX(object->attributeCapacity * 2u, HTML_ATTRIBUTE_FIRST_CAPACITY));
+	capacity = MIN(capacity, 0xFFFF);
+
+	HtmlAttribute* attributes;
+	if (document == NULL && borrowed == false) {
+		attributes = (HtmlAttribute*)realloc(object->attributes, capacity * sizeof(HtmlAttribute));
+		HtmlHandleOutOfMemoryError(attributes, false);
+	}
+	else {
+		attributes = (HtmlAttribute*)HtmlLibAllocMemory(document, capacity * sizeof(HtmlAttribute), sizeof(void*));
+		HtmlHandleOutOfMemoryError(attributes, false);
+
+		// an array in document memory is left to the document
+		if (object->attributeCount) {
+			memcpy(attributes, object->attributes, object->attributeCount * sizeof(HtmlAttribute));
+		}
+		if (borrowed == false) {
+			free(object->attributes);
+		}
+	}
+
+	object->attributes = attributes;
+	object->attributeCapacity = (unsigned short)capacity;
+	object->flags = document ? object->flags | HTML_BORROWED_ATTRIBUTES : object->flags & ~HTML_BORROWED_ATTRIBUTES;
+	return true;
+}
+
+// empty attribute at the end of object
+HtmlAttribute* HtmlLibAddObjectAttribute(HtmlDocument* document, HtmlObject* object) {
+	if (HtmlLibReserveObjectAttributes(document, object, 1) == false) {
+		return NULL;
+	}
+
+	HtmlAttribute* attr = &object->attributes[object->attributeCount++];
+	memset(attr, 0, sizeof(HtmlAttribute));
+	return attr;
+}
+
+
+// attributes of a start tag while it is read, strings copied to document memory come between them
+// so they are put to the tag at once in an array of the exact size
+#define HTML_PENDING_ATTRIBUTES 32
+
+typedef struct HtmlLibPendingAttributes {
+	HtmlAttribute attributes[HTML_PENDING_ATTRIBUTES];
+	unsigned int count;
+} HtmlLibPendingAttributes;
+
+// move pending attributes to the end of object
+bool HtmlLibFlushPendingAttributes(HtmlDocument* document, HtmlObject* object, HtmlLibPendingAttributes* pending) {
+	if (pending->count == 0) {
+		return true;
+	}
+
+	unsigned int count = pending->count;
+	pending->count = 0;
+
+	if (HtmlLibReserveObjectAttributes(document, object, count) == false) {
+		return false;
+	}
+	memcpy(object->attributes + object->attributeCount, pending->attributes, count * sizeof(HtmlAttribute));
+	object->attributeCount += count;
+	return true;
+}
+
+// empty pending attribute of object, the full ones are moved to it first
+HtmlAttribute* HtmlLibAddPendingAttribute(HtmlDocument* document, HtmlObject* object, HtmlLibPendingAttributes* pending) {
+	if (pending->count == HTML_PENDING_ATTRIBUTES && HtmlLibFlushPendingAttributes(document, object, pending) == false) {
+		return NULL;
+	}
+
+	HtmlAttribute* attr = &pending->attributes[pending->count++];
+	memset(attr, 0, sizeof(HtmlAttribute));
+	return attr;
+}
+
+// set name of a new attribute, a static atom gives its name, other names are copied to document memory
+bool HtmlLibSetAttributeName(HtmlDocument* document, HtmlAttribute* attr, unsigned short atom, const char* name, size_t length) {
+	if (atom != HTML_ATOM_DYNAMIC) {
+		attr->name = (char*)HtmlLibAtomNames[atom];
+		attr->flags |= HTML_BORROWED_ATTR_NAME;
+		attr->atom = atom;
+		return true;
+	}
+
+	attr->name = HtmlLibCopyString(document, name, length, &attr->flags, HTML_BORROWED_ATTR_NAME);
+	HtmlHandleOutOfMemoryError(attr->name, false);
+
+	attr->atom = document ? HtmlLibInternDynamicAtom(&document->atoms, attr->name, length) : HTML_ATOM_DYNAMIC;
+	return true;
+}
+
+// attribute of `atom` (`name` for names not known), or NULL
+HtmlAttribute* HtmlLibFindObjectAttribute(const HtmlObject* object, unsigned short atom, const char* name) {
+	HtmlAttribute* attr = object->attributes, *end = attr + object->attributeCount;
+
+	// known names are compared by atom only, others by name with the ones not known
+	if (atom < HTML_ATOM_DYNAMIC) {
+		for (; attr < end; attr++) {
+			if (attr->atom == atom) {
+				return attr;
+			}
+		}
+		return NULL;
+	}
+
+	for (; attr < end; attr++) {
+		if (attr->atom >= HTML_ATOM_DYNAMIC && strcmp(attr->name, name) == 0) {
+			return attr;
+		}
+	}
+	return NULL;
+}
+
+
+void HtmlLibReleaseClassList(HtmlObject* object) {
+	if ((object->flags & HTML_BORROWED_CLASS_LIST) == 0) {
+		free(object->classList);
+	}
+	object->classList = NULL;
+	object->flags &= ~HTML_BORROWED_CLASS_LIST;
+}
+
+// make class list of object from its class attribute again, memory comes from document
+bool HtmlLibSetObjectClassList(HtmlDocument* document, HtmlObject* object) {
+	HtmlLibReleaseClassList(object);
+
+	HtmlAttribute* attr = HtmlLibFindObjectAttribute(object, HTML_ATOM_CLASS, "class");
+	if (attr == NULL || attr->value == NULL) {
+		return true;
+	}
+
+	// count tokens
+	unsigned int count = 0;
+	for (const char* p = attr->value; *p; ) {
+		if (HtmlLibIsSpaceByte(*p)) {
+			p++;
+			continue;
+		}
+		count++;
+		while (*p && !HtmlLibIsSpaceByte(*p)) {
+			p++;
+		}
+	}
+	if (count == 0) {
+		return true;
+	}
+
+	HtmlLibClassList* list = (HtmlLibClassList*)HtmlLibAllocMemory(document, sizeof(HtmlLibClassList) + count * sizeof(HtmlLibClassToken), sizeof(void*));
+	HtmlHandleOutOfMemoryError(list, false);
+
+	list->bloom = 0;
+	list->value = attr->value;
+	list->count = 0;
+	list->tokens = (HtmlLibClassToken*)(list + 1);
+
+	for (const char* p = attr->value; *p; ) {
+		if (HtmlLibIsSpaceByte(*p)) {
+			p++;
+			continue;
+		}
+
+		const char* begin = p;
+		while (*p && !HtmlLibIsSpaceByte(*p)) {
+			p++;
+		}
+
+		unsigned int hash = HtmlLibHashName(begin, p - begin);
+		list->tokens[list->count++] = (HtmlLibClassToken){hash, (unsigned int)(begin - attr->value), (unsigned int)(p - begin)};
+		list->bloom |= HtmlLibGetClassBloom(hash);
+	}
+
+	object->classList = list;
+	if (document) {
+		object->flags |= HTML_BORROWED_CLASS_LIST;
+	}
+	return true;
+}
+
+// true if object has the class `name` of `length`, `hash` is HtmlLibHashName() of it
+bool HtmlLibHasObjectClass(const HtmlObject* object, unsigned int hash, const char* name, size_t length) {
+	const HtmlLibClassList* list = object->classList;
+	unsigned long long bloom = HtmlLibGetClassBloom(hash);
+
+	if (list == NULL || (list->bloom & bloom) != bloom) {
+		return false;
+	}
+
+	for (unsigned int i = 0; i < list->count; i++) {
+		const HtmlLibClassToken* token = &list->tokens[i];
+
+		if (token->hash == hash && token->length == length && memcmp(list->value + token->offset, name, length) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// Subtree Blooms //
+//
+// every object has the keys of elements under it, a select skips a subtree not having all
+// keys of a pattern, bits are only added so removing objects leaves some bits set
+
+// bit of a key in the bloom
+#define HtmlLibGetKeyBloom(key) (1ULL << ((unsigned int)(key) * 0x9E3779B1u >> 26))
+
+// key of a name, static atoms are the same in all documents, other names are hashed
+#define HtmlLibGetNameKey(atom, name) ((atom) < HTML_ATOM_DYNAMIC ? (unsigned int)(atom) : HtmlLibHashName((name), strlen(name)))
+
+
+// bits of name, classes and id of an element
+unsigned long long HtmlLibGetObjectBloom(const HtmlObject* object) {
+	if (object->name == NULL || !HtmlLibIsIntegerIn(object->type, HTML_TYPE_TAG, HTML_TYPE_SINGLE, HTML_TYPE_SCRIPT, -1)) {
+		return 0;
+	}
+
+	unsigned long long bloom = HtmlLibGetKeyBloom(HtmlLibGetNameKey(object->atom, object->name));
+
+	for (unsigned int i = 0; object->classList && i < object->classList->count; i++) {
+		bloom |= HtmlLibGetKeyBloom(object->classList->tokens[i].hash);
+	}
+
+	HtmlAttribute* id = HtmlLibFindObjectAttribute(object, HTML_ATOM_ID, "id");
+	if (id && id->value) {
+		bloom |= HtmlLibGetKeyBloom(HtmlLibHashName(id->value, strlen(id->value)));
+	}
+	return bloom;
+}
+
+// add `bloom` to `parent` and its ancestors, an ancestor having the bits already has them above too
+void HtmlLibSpreadSubtreeBloom(HtmlObject* parent, unsigned long long bloom) {
+	for (; parent && (parent->subtreeBloom & bloom) != bloom; parent = parent->parent) {
+		parent->subtreeBloom |= bloom;
+	}
+}
+
+// object was put under its parent, or its keys changed
+#define HtmlLibSpreadObjectBloom(object) \
+	HtmlLibSpreadSubtreeBloom((object)->parent, (object)->subtreeBloom | HtmlLibGetObjectBloom(object))
+
+
+
+
+// set lowered `name` and its atom, a name of static atom is shared instead of copied
+void HtmlLibSetObjectName(HtmlObject* object, const char* name) {
+	HtmlLibReleaseString(&object->name, &object->flags, HTML_BORROWED_NAME);
+	object->atom = HtmlLibLookupAtomLowered(name, strlen(name));
+
+	if (object->atom != HTML_ATOM_DYNAMIC) {
+		object->name = (char*)HtmlLibAtomNames[object->atom];
+		object->flags |= HTML_BORROWED_NAME;
+		return;
+	}
+
+	HtmlLibSetObjectString(object, &object->name, HTML_BORROWED_NAME, name);
+	for (char* p = object->name; p && *p; p++) {
+		*p = HtmlLibLowerChar(*p);
+	}
+
+	// name in document memory can take a dynamic atom
+	HtmlDocument* document = object->flags & HTML_BORROWED_NAME ? HtmlLibGetObjectDocument(object) : NULL;
+	object->atom = object->name ? HtmlLibInternAtom(document, object->name, strlen(object->name)) : HTML_ATOM_NONE;
+}
+
+
+HtmlObject* HtmlLibCreateObject(HtmlObjectType type, const char* name, HtmlObject* parent) {
+	HtmlObject* object;
+
+	// assign memory, documents carry HtmlDocument data after the object
+	if (type == HTML_TYPE_DOCUMENT) {
+		object = (HtmlObject*)calloc(1, sizeof(HtmlDocument));
+	    HtmlHandleOutOfMemoryError(object, NULL);
+		object->type = type;
+	}
+	else {
+		object = HtmlLibAllocObject(HtmlLibGetObjectDocument(parent), type);
+	    HtmlHandleOutOfMemoryError(object, NULL);
+	}
+
 	// set relationship
 	if (parent) {
 		HtmlLibAddObjectChild(parent, object);
+		HtmlLibChangeDocumentTree(HtmlLibGetObjectDocument(parent));
+		HtmlLibChangeObjectText(parent);
+	}
+
+	if (name) {
+		HtmlLibSetObjectName(object, name);
 	}
+
+	HtmlLibSpreadObjectBloom(object);
 	return object;
 }
 
@@ -621,14 +1318,14 @@ HtmlObject* HtmlLibCreateObject(HtmlObjectType type, const char* name, HtmlObjec
 HtmlObject* HtmlCreateObjectDocument() {
 	return HtmlLibCreateObject(HTML_TYPE_DOCUMENT, NULL, NULL);
 }
-#define HtmlCreateObjectDocument HtmlCreateObjectDocument
+#define HtmlCreateDocument HtmlCreateObjectDocument
 
 
 HtmlObject* HtmlCreateObjectDoctype(HtmlObject* parent, const char* innerText) {
 	HtmlHandleNullError(innerText, NULL);
 	
 	HtmlObject* doctype = HtmlLibCreateObject(HTML_TYPE_DOCTYPE, NULL, parent);
-	HtmlSetText(doctype->innerText, innerText);
+	HtmlLibSetObjectString(doctype, &doctype->innerText, HTML_BORROWED_INNER_TEXT, innerText);
 	return doctype;
 }
 
@@ -651,8 +1348,8 @@ HtmlObject* HtmlCreateObjectTagEx(HtmlObject* parent, const char* tagName, const
 	HtmlHandleNullError(tagName, NULL);
 	
 	HtmlObject* tag = HtmlLibCreateObject(HTML_TYPE_TAG, tagName, parent);
-	HtmlSetText(tag->innerText, innerText);
-	HtmlSetText(tag->afterText, afterText);
+	HtmlLibSetObjectString(tag, &tag->innerText, HTML_BORROWED_INNER_TEXT, innerText);
+	HtmlLibSetObjectString(tag, &tag->afterText, HTML_BORROWED_AFTER_TEXT, afterText);
 	return tag;
 }
 
@@ -669,25 +1366,27 @@ HtmlObject* HtmlCreateObjectSingle(HtmlObject* parent, const char* name) {
 // input text to be script content, or NULL to create empty script
 HtmlObject* HtmlCreateObjectScript(HtmlObject* parent, const char* content) {
 	HtmlObject* script = HtmlLibCreateObject(HTML_TYPE_SCRIPT, "script", parent);
-	HtmlSetText(script->innerText, content);
+	HtmlLibSetObjectString(script, &script->innerText, HTML_BORROWED_INNER_TEXT, content);
 	return script;
 }
 
 
 HtmlObject* HtmlCreateObjectStyle(HtmlObject* parent, const char* content) {
 	HtmlObject* script = HtmlLibCreateObject(HTML_TYPE_SCRIPT, "style", parent);
-	HtmlSetText(script->innerText, content);
+	HtmlLibSetObjectString(script, &script->innerText, HTML_BORROWED_INNER_TEXT, content);
 	return script;	
 }
 
 
 HtmlObject* HtmlCreateObjectComment(HtmlObject* parent, const char* text) {
 	HtmlObject* comment = HtmlLibCreateObject(HTML_TYPE_COMMENT, NULL, parent);
-	HtmlSetText(comment->innerText, text);
+	HtmlLibSetObjectString(comment, &comment->innerText, HTML_BORROWED_INNER_TEXT, text);
 	return comment;
 }
 
 
+HtmlCode HtmlSetObjectAttrValue(HtmlObject* object, const char* attrName, const char* attrValue);
+
 // A html document that having <html> <head> <meta> <title> and <body>
 HtmlObject* HtmlCreateDocumentTemplate(const char* title) {
   HtmlObject* doc = HtmlCreateDocument();
@@ -698,10 +1397,10 @@ HtmlObject* HtmlCreateDocumentTemplate(const char* title) {
   HtmlObject* tagMeta = HtmlCreateObjectSingle(tagHead, "meta");
   HtmlSetObjectAttrValue(tagMeta, "charset", "utf-8");
 
-  HtmlCreateObjectTag(tagHead, "title", title, NULL);
+  HtmlCreateObjectTagEx(tagHead, "title", title, NULL);
 
   // body
-  HtmlObject* tagBody = HtmlCreateObjectTag(tagBody, "body");
+  HtmlCreateObjectTag(tagHtml, "body");
 
   return doc;
 }
@@ -732,25 +1431,33 @@ void HtmlLibClearObjectRelationship(HtmlObject* object) {
 
 
 
+void HtmlLibClearObjectAttributes(HtmlObject* object) {
+	HtmlLibReleaseClassList(object);
+
+	for (unsigned int i = 0; i < object->attributeCount; i++) {
+        HtmlLibReleaseString(&object->attributes[i].name, &object->attributes[i].flags, HTML_BORROWED_ATTR_NAME);
+        HtmlLibReleaseString(&object->attributes[i].value, &object->attributes[i].flags, HTML_BORROWED_ATTR_VALUE);
+	}
+	if ((object->flags & HTML_BORROWED_ATTRIBUTES) == 0) {
+		free(object->attributes);
+	}
+
+	object->attributes = NULL;
+	object->attributeCount = 0;
+	object->attributeCapacity = 0;
+	object->flags &= ~HTML_BORROWED_ATTRIBUTES;
+}
+
 void HtmlClearObjectAttributes(HtmlObject* object) {
-	HtmlAttributeIterator iter = HtmlBeginAttribute(object);
-    object->firstAttribute = NULL;
-    object->lastAttribute = NULL;
-	
-    while ((iter.now = iter.next)) {
-		if (iter.next) {
-			iter.next = iter.next->next;
-		}
+	HtmlHandleNullError(object, );
 
-        free(iter.now->name);
-        free(iter.now->value);
-        free(iter.now);
-    }
+	HtmlLibChangeDocumentTree(HtmlLibGetObjectDocument(object));
+	HtmlLibClearObjectAttributes(object);
 }
 
 void HtmlLibDestroyObject(HtmlObject* object);
 
-void HtmlClearObjectChildren(HtmlObject* object) {
+void HtmlLibClearObjectChildren(HtmlObject* object) {
 	HtmlObjectIterator iter = HtmlBeginObject(object);
 	object->firstChild = NULL;
 	object->lastChild = NULL;
@@ -761,8 +1468,16 @@ void HtmlClearObjectChildren(HtmlObject* object) {
     }
 }
 
+void HtmlClearObjectChildren(HtmlObject* object) {
+	HtmlHandleNullError(object, );
+
+	HtmlLibChangeDocumentTree(HtmlLibGetObjectDocument(object));
+	HtmlLibChangeObjectText(object);
+	HtmlLibClearObjectChildren(object);
+}
+
 
-const char* HtmlGetObjectTypeString(HtmlObject* object);
+const char* HtmlGetObjectTypeString(const HtmlObject* object);
 
 void HtmlLibDestroyObject(HtmlObject* object) {
 	// printf("Destroying object: %s (%s)\n", object->name ? object->name : "Unnamed", HtmlGetObjectTypeString(object));
@@ -770,20 +1485,40 @@ void HtmlLibDestroyObject(HtmlObject* object) {
 	// Clear relationships
 	HtmlLibClearObjectRelationship(object);
 
-	// Clear children and attributes
-	HtmlClearObjectChildren(object);
-    HtmlClearObjectAttributes(object);
-	
-	free(object->name);
-	free(object->innerText);
-	free(object->afterText);
+	// a document having only arena memory is freed by chunks without walking the tree
+	HtmlDocument* document = object->type == HTML_TYPE_DOCUMENT ? (HtmlDocument*)object : NULL;
+
+	if (document == NULL || document->mixed) {
+		// Clear children and attributes
+		HtmlLibClearObjectChildren(object);
+	    HtmlLibClearObjectAttributes(object);
+		
+		HtmlLibReleaseString(&object->name, &object->flags, HTML_BORROWED_NAME);
+		HtmlLibReleaseString(&object->innerText, &object->flags, HTML_BORROWED_INNER_TEXT);
+		HtmlLibReleaseString(&object->afterText, &object->flags, HTML_BORROWED_AFTER_TEXT);
+		HtmlLibDestroyPointer(object->textCache);
+	}
 
-    free(object);
+	// document memory goes last, objects above may borrow from it
+	if (document) {
+		HtmlLibDestroyArena(&document->arena);
+		HtmlLibDestroyAtomTable(&document->atoms);
+		HtmlLibDestroyDocumentIndex(document->index);
+		free(document->source);
+	}
+
+	if ((object->flags & HTML_BORROWED_OBJECT) == 0) {
+	    free(object);
+	}
 }
 
 void HtmlDestroyObject(HtmlObject* object) {
 	if (object == NULL) return;
 
+	if (object->parent) {
+		HtmlLibChangeDocumentTree(HtmlLibGetObjectDocument(object));
+		HtmlLibChangeObjectText(object->parent);
+	}
     HtmlLibClearObjectRelationship(object);
 	HtmlLibDestroyObject(object);
 }
@@ -810,14 +1545,65 @@ HtmlObject* HtmlLibAddObjectChild(HtmlObject* parent, HtmlObject* child) {
 	return child;
 }
 
+// dynamic atoms of object and its subtree are ids of the document it came from, they get the ids
+// of `document` for the same names, or HTML_ATOM_DYNAMIC for names `document` does not know
+// (not interned here as the table would keep names the moved objects can free)
+void HtmlLibAdoptObjectAtoms(HtmlDocument* document, HtmlObject* root) {
+	HtmlObject* object = root;
+
+	while (object) {
+		if (object->atom > HTML_ATOM_DYNAMIC) {
+			object->atom = document ? HtmlLibFindDynamicAtom(&document->atoms, object->name, strlen(object->name)) : HTML_ATOM_DYNAMIC;
+		}
+		for (HtmlAttribute* attr = object->attributes; attr < object->attributes + object->attributeCount; attr++) {
+			if (attr->atom > HTML_ATOM_DYNAMIC) {
+				attr->atom = document ? HtmlLibFindDynamicAtom(&document->atoms, attr->name, strlen(attr->name)) : HTML_ATOM_DYNAMIC;
+			}
+		}
+
+		// next in pre-order
+		if (object->firstChild) {
+			object = object->firstChild;
+			continue;
+		}
+		while (object != root && object->next == NULL) {
+			object = object->parent;
+		}
+		object = object == root ? NULL : object->next;
+	}
+}
+
+// object moved in from outside of the document may have malloc'd memory and atoms of another document
+// trees of both documents change, and texts of both parents
+void HtmlLibMarkForeignObject(HtmlObject* parent, HtmlObject* object) {
+	HtmlDocument* document = HtmlLibGetObjectDocument(parent);
+	HtmlDocument* from = HtmlLibGetObjectDocument(object);
+
+	if (from != document) {
+		HtmlLibAdoptObjectAtoms(document, object);
+	}
+	if (document && from != document) {
+		document->mixed = true;
+	}
+
+	HtmlLibChangeDocumentTree(document);
+	HtmlLibChangeDocumentTree(from);
+	HtmlLibChangeObjectText(object->parent);
+	HtmlLibChangeObjectText(parent);
+}
+
 HtmlObject* HtmlAddObjectChild(HtmlObject* parent, HtmlObject* child) {
 	// Check invalid parameter
     HtmlHandleNullError(parent, NULL);
     HtmlHandleNullError(child, NULL);
 	
 	// clear old relationship
+	HtmlLibMarkForeignObject(parent, child);
 	HtmlLibClearObjectRelationship(child);
-	return HtmlLibAddObjectChild(parent, child);
+	HtmlLibAddObjectChild(parent, child);
+
+	HtmlLibSpreadObjectBloom(child);
+	return child;
 }
 
 HtmlObject* HtmlInsertObjectChildBefore(HtmlObject* parent, HtmlObject* target, HtmlObject* object) {
@@ -830,6 +1616,7 @@ HtmlObject* HtmlInsertObjectChildBefore(HtmlObject* parent, HtmlObject* target,
 	}
 
 	// Clear old relationship
+	HtmlLibMarkForeignObject(parent, object);
 	HtmlLibClearObjectRelationship(object);
 
 	// Set new relationship
@@ -846,13 +1633,15 @@ HtmlObject* HtmlInsertObjectChildBefore(HtmlObject* parent, HtmlObject* target,
 
 		object->prev = target->prev;
 		target->prev = object;
-		return object;
+	}
+	else {
+		// parent is empty, so that init parent children
+		parent->firstChild = object;
+		parent->lastChild = object;
+		object->prev = NULL;
 	}
 
-	// parent is empty, so that init parent children
-	parent->firstChild = object;
-	parent->lastChild = object;
-	object->prev = NULL;
+	HtmlLibSpreadObjectBloom(object);
 	return object;
 }
 
@@ -866,6 +1655,7 @@ HtmlObject* HtmlInsertObjectChildAfter(HtmlObject* parent, HtmlObject* target, H
 	}
 
 	// Clear old relationship
+	HtmlLibMarkForeignObject(parent, object);
 	HtmlLibClearObjectRelationship(object);
 
 	// Set new relationship
@@ -882,13 +1672,15 @@ HtmlObject* HtmlInsertObjectChildAfter(HtmlObject* parent, HtmlObject* target, H
 
 		object->next = target->next;
 		target->next = object;
-		return object;
+	}
+	else {
+		// parent is empty, so that init parent children
+		parent->firstChild = object;
+		parent->lastChild = object;
+		object->next = NULL;
 	}
 
-	// parent is empty, so that init parent children
-	parent->firstChild = object;
-	parent->lastChild = object;
-	object->next = NULL;
+	HtmlLibSpreadObjectBloom(object);
 	return object;
 }
 
@@ -896,10 +1688,56 @@ HtmlObject* HtmlInsertObjectChildAfter(HtmlObject* parent, HtmlObject* target, H
 
 // Set
 
+/* タグ名を変更する
+
+古い名前は借りたもの (ドキュメントのメモリ、in-situ の入力) なら解放されない
+
+@param object タグ、シングルタグかスクリプト
+@param name 新しい名前、小文字にされる
+@return HTML_OK または エラーコード
+*/
+HtmlCode HtmlSetObjectName(HtmlObject* object, const char* name) {
+    HtmlHandleNullError(object, HTML_NULL_POINTER);
+    HtmlHandleNullError(name, HTML_NULL_POINTER);
+    HtmlHandleError((object->type & HTML_HAS_NAME) == 0, HTML_FAILED, "object has no name!");
+
+    HtmlLibSetObjectName(object, name);
+    HtmlHandleOutOfMemoryError(object->name, HTML_OUT_OF_MEMORY);
+
+    // br and hr are text, any rename can change the text of ancestors
+    HtmlLibChangeObjectText(object);
+    HtmlLibChangeDocumentTree(HtmlLibGetObjectDocument(object));
+    HtmlLibSpreadObjectBloom(object);
+    return HTML_OK;
+}
+
+/* 内部テキストを変更する (最初の子の前のテキスト)
+
+古いテキストは借りたもの (ドキュメントのメモリ、in-situ の入力) なら解放されない
+
+@param object オブジェクト
+@param text 新しいテキスト、NULL で消す
+@return HTML_OK または エラーコード
+*/
 HtmlCode HtmlSetObjectInnerText(HtmlObject* object, const char* text) {
     HtmlHandleNullError(object, HTML_NULL_POINTER);
 
-    HtmlSetText(object->innerText, text);
+    HtmlLibSetObjectString(object, &object->innerText, HTML_BORROWED_INNER_TEXT, text);
+    HtmlHandleError(text && object->innerText == NULL, HTML_OUT_OF_MEMORY, "Out of memory!");
+    return HTML_OK;
+}
+
+/* オブジェクトの後ろのテキストを変更する (次のオブジェクトの前まで)
+
+@param object オブジェクト
+@param text 新しいテキスト、NULL で消す
+@return HTML_OK または エラーコード
+*/
+HtmlCode HtmlSetObjectAfterText(HtmlObject* object, const char* text) {
+    HtmlHandleNullError(object, HTML_NULL_POINTER);
+
+    HtmlLibSetObjectString(object, &object->afterText, HTML_BORROWED_AFTER_TEXT, text);
+    HtmlHandleError(text && object->afterText == NULL, HTML_OUT_OF_MEMORY, "Out of memory!");
     return HTML_OK;
 }
 
@@ -909,46 +1747,53 @@ HtmlCode HtmlSetObjectAttrValue(HtmlObject* object, const char* attrName, const
     HtmlHandleNullError(attrName, HTML_NULL_POINTER);
 
     // moidfy attrValue if attribute exists
-    const char* _attrName, *_attrValue;
-    HtmlForeachObjectAttributes(object, _attrName, _attrValue) {
-        if (strcmp(attrName, _attrName) == 0) {
-            // Update existing attribute
-            HtmlSetText(objectAttrIter.now->value, attrValue);
-            return HTML_OK;
+    size_t attrNameLength = strlen(attrName);
+    unsigned short atom = HtmlLibLookupAtom(attrName, attrNameLength);
+    HtmlAttribute* attr = HtmlLibFindObjectAttribute(object, atom, attrName);
+
+    if (atom == HTML_ATOM_ID || atom == HTML_ATOM_CLASS) {
+        HtmlLibChangeDocumentTree(HtmlLibGetObjectDocument(object));
+    }
+    if (attr) {
+        // Update existing attribute
+        HtmlLibReleaseString(&attr->value, &attr->flags, HTML_BORROWED_ATTR_VALUE);
+
+        if (attrValue) {
+            attr->value = HtmlLibCopyString(HtmlLibGetObjectDocument(object), attrValue, strlen(attrValue), &attr->flags, HTML_BORROWED_ATTR_VALUE);
+            HtmlHandleOutOfMemoryError(attr->value, HTML_OUT_OF_MEMORY);
+        }
+        if (atom == HTML_ATOM_CLASS && HtmlLibSetObjectClassList(HtmlLibGetObjectDocument(object), object) == false) {
+            return HTML_OUT_OF_MEMORY;
         }
+        if (atom == HTML_ATOM_ID || atom == HTML_ATOM_CLASS) {
+            HtmlLibSpreadObjectBloom(object);
+        }
+        return HTML_OK;
     }
 
     // Create new attribute if attribute not exists
-    HtmlAttribute* attr = (HtmlAttribute*)malloc(sizeof(HtmlAttribute));
+    HtmlDocument* document = HtmlLibGetObjectDocument(object);
+
+    attr = HtmlLibAddObjectAttribute(document, object);
     HtmlHandleOutOfMemoryError(attr, HTML_OUT_OF_MEMORY);
     
     // Set attribute name
-    attr->name = (char*)malloc(strlen(attrName) + 1);
-    HtmlHandleOutOfMemoryError(attr->name, HTML_OUT_OF_MEMORY);
-    strcpy(attr->name, attrName);
+    if (HtmlLibSetAttributeName(document, attr, atom, attrName, attrNameLength) == false) {
+        object->attributeCount--;
+        return HTML_OUT_OF_MEMORY;
+    }
 
     // Set attribute value
     if (attrValue && attrValue[0] != '\0') {
-        attr->value = (char*)malloc(strlen(attrValue) + 1);
+        attr->value = HtmlLibCopyString(document, attrValue, strlen(attrValue), &attr->flags, HTML_BORROWED_ATTR_VALUE);
         HtmlHandleOutOfMemoryError(attr->value, HTML_OUT_OF_MEMORY);
-
-		strcpy(attr->value, attrValue);
     }
-    else {
-        attr->value = NULL;
-    }
-    
-    // Setup relationship
-    attr->prev = object->lastAttribute;
-    attr->next = NULL;
 
-    if (object->lastAttribute) {
-        object->lastAttribute->next = attr;
+    if (atom == HTML_ATOM_CLASS && HtmlLibSetObjectClassList(document, object) == false) {
+        return HTML_OUT_OF_MEMORY;
     }
-    object->lastAttribute = attr;
-
-    if (object->firstAttribute == NULL) {
-        object->firstAttribute = attr;
+    if (atom == HTML_ATOM_ID || atom == HTML_ATOM_CLASS) {
+        HtmlLibSpreadObjectBloom(object);
     }
     return HTML_OK;
 }
@@ -959,7 +1804,7 @@ HtmlCode HtmlSetObjectAttrValue(HtmlObject* object, const char* attrName, const
 
 // Get
 
-const char* HtmlGetObjectName(HtmlObject* object) {
+const char* HtmlGetObjectName(const HtmlObject* object) {
 	HtmlHandleNullError(object, "(null pointer)");
 	
 	switch (object->type) {
@@ -976,16 +1821,17 @@ const char* HtmlGetObjectName(HtmlObject* object) {
 	}
 }
 
-const char* HtmlGetObjectInnerText(HtmlObject* object) {
+const char* HtmlGetObjectInnerText(const HtmlObject* object) {
 	HtmlHandleNullError(object, NULL);
 	return object->innerText ? object->innerText : "";
 }
 
-HtmlCode HtmlLibGetObjectText(HtmlObject* object, HtmlStream* stream) {
+// writes nothing to `object`, threads can get text of the same tree
+// a write callback returns 0 on failure (fwrite() returns count of blocks, others bytes)
+HtmlCode HtmlLibGetObjectText(const HtmlObject* object, HtmlStream* stream) {
 	// Write innerText
-	if (object->innerText) {
-		size_t len = strlen(object->innerText);
-		if (stream->write(object->innerText, len, 1, stream->data) != len) {
+	if (object->innerText && *object->innerText) {
+		if (stream->write(object->innerText, strlen(object->innerText), 1, stream->data) == 0) {
 			return HTML_OUT_OF_MEMORY;
 		}
 	}
@@ -993,30 +1839,19 @@ HtmlCode HtmlLibGetObjectText(HtmlObject* object, HtmlStream* stream) {
 	// Write object children's text
 	HtmlObject* child;
 	HtmlForeachObjectChildren(object, child) {
-		// Skip writing afterText for COMMENT, DOCTYPE, and SCRIPT types
-		if (HtmlLibIsIntegerIn(child->type, HTML_TYPE_COMMENT, HTML_TYPE_DOCTYPE, HTML_TYPE_SCRIPT, -1)) {
-			continue;
-		}
-
-		// Special case (br or hr)
-		if (strcmp(child->name, "br") == 0) {
-			// Write a newline for <br> and <hr> tags
-			if (stream->putchar('\n', stream->data)) {
+		// Special case (br or hr), write newlines then its afterText
+		if (child->atom == HTML_ATOM_BR) {
+			if (stream->write((void*)"\n", 1, 1, stream->data) == 0) {
 				return HTML_OUT_OF_MEMORY;
 			}
-			continue;
 		}
-		if (strcmp(child->name, "hr") == 0) {
-			// Write a newline for <br> and <hr> tags
-			if (stream->write((void*)"\n\n", 2, 1, stream->data) != 2) {
+		else if (child->atom == HTML_ATOM_HR) {
+			if (stream->write((void*)"\n\n", 2, 1, stream->data) == 0) {
 				return HTML_OUT_OF_MEMORY;
 			}
-			continue;
 		}
-
-
-		// Write child's text unless its type SINGLE
-		if (child->type != HTML_TYPE_SINGLE) {
+		// Write child's text unless its type SINGLE, text of COMMENT, DOCTYPE, and SCRIPT types is not shown
+		else if (!HtmlLibIsIntegerIn(child->type, HTML_TYPE_SINGLE, HTML_TYPE_COMMENT, HTML_TYPE_DOCTYPE, HTML_TYPE_SCRIPT, -1)) {
 			HtmlCode code = HtmlLibGetObjectText(child, stream);
 			if (code != HTML_OK) {
 				return code;
@@ -1024,9 +1859,8 @@ HtmlCode HtmlLibGetObjectText(HtmlObject* object, HtmlStream* stream) {
 		}
 
 		// Write child's afterText to stream
-		if (child->afterText) {
-			size_t len = strlen(child->afterText);
-			if (stream->write(child->afterText, len, 1, stream->data) != len) {
+		if (child->afterText && *child->afterText) {
+			if (stream->write(child->afterText, strlen(child->afterText), 1, stream->data) == 0) {
 				return HTML_OUT_OF_MEMORY;
 			}
 		}
@@ -1043,7 +1877,7 @@ object の下にあるすべてのタグからテキストを取得し、stream
 @param stream HtmlStream to write the text to
 @return HTML_OK on success, or an error code on failure
 */
-HtmlCode HtmlGetObjectTextEx(HtmlObject* object, HtmlStream* stream) {
+HtmlCode HtmlGetObjectTextEx(const HtmlObject* object, HtmlStream* stream) {
 	// checks parameter useable
 	HtmlHandleNullError(object, HTML_NULL_POINTER);
 	HtmlHandleNullError(stream, HTML_NULL_POINTER);
@@ -1054,17 +1888,104 @@ HtmlCode HtmlGetObjectTextEx(HtmlObject* object, HtmlStream* stream) {
 	}
 
 	// Check if stream is writeable
-	HtmlHandleError(HtmlIsStreamWritable(stream), HTML_STREAM_NOT_WRITEABLE,
+	HtmlHandleError(HtmlIsStreamWritable(stream) == false, HTML_STREAM_NOT_WRITEABLE,
 		"HtmlStream is not writeable, please setup the write callback function!");
 	
 	return HtmlLibGetObjectText(object, stream);
 }
 
 
-// -- 内部すべてのタグのテキストを取得 --
-// 新メモリを作るため、通常ではストリームを作成してそこに書くだが、
-// それは EX 版に移し、メモリの余剰空間を使用する HtmlGetObjectText となった
-// その空間の具体的な場所は `object->name + strlen(object->name) + 1`
+/* 内部すべてのタグのテキストをバッファに取得
+
+HtmlGetObjectText() と違ってオブジェクトを変更しないので、複数のスレッドから同じツリーに使える
+snprintf() と同じく size - 1 文字までで切られ、size が 0 でなければ NUL 終端される
+
+@param object HtmlObject to get text from
+@param buffer 呼び出し側のバッファ、size が 0 なら NULL でも良い
+@param size buffer のサイズ
+@return テキスト全体の長さ、size 以上なら切られている
+*/
+size_t HtmlGetObjectTextToBuffer(const HtmlObject* object, char* buffer, size_t size) {
+	HtmlLibFixedBuffer fixed = {buffer, size, 0};
+	HtmlStream stream = HtmlLibInitStreamFixedBuffer(&fixed);
+
+	if (object && HtmlLibIsIntegerIn(object->type, HTML_TYPE_DOCUMENT, HTML_TYPE_TAG, -1)) {
+		HtmlLibGetObjectText(object, &stream);
+	}
+	return HtmlLibFinishFixedBuffer(&fixed);
+}
+
+
+#define HtmlLibHasTextCache(object) ((object)->textCache && (object)->textCache->generation == (object)->generation)
+
+// length of the text of HtmlLibGetObjectText(), cached texts of children are used
+size_t HtmlLibMeasureObjectText(const HtmlObject* object) {
+	size_t length = object->innerText ? strlen(object->innerText) : 0;
+
+	HtmlObject* child;
+	HtmlForeachObjectChildren(object, child) {
+		if (child->atom == HTML_ATOM_BR) {
+			length += 1;
+		}
+		else if (child->atom == HTML_ATOM_HR) {
+			length += 2;
+		}
+		else if (HtmlLibHasTextCache(child)) {
+			length += child->textCache->length;
+		}
+		else if (!HtmlLibIsIntegerIn(child->type, HTML_TYPE_SINGLE, HTML_TYPE_COMMENT, HTML_TYPE_DOCTYPE, HTML_TYPE_SCRIPT, -1)) {
+			length += HtmlLibMeasureObjectText(child);
+		}
+
+		length += child->afterText ? strlen(child->afterText) : 0;
+	}
+	return length;
+}
+
+// write the text measured by HtmlLibMeasureObjectText() to `p`, returns the end of it
+char* HtmlLibCopyObjectText(const HtmlObject* object, char* p) {
+	size_t length;
+
+	if (object->innerText && (length = strlen(object->innerText))) {
+		memcpy(p, object->innerText, length);
+		p += length;
+	}
+
+	HtmlObject* child;
+	HtmlForeachObjectChildren(object, child) {
+		if (child->atom == HTML_ATOM_BR) {
+			*p++ = '\n';
+		}
+		else if (child->atom == HTML_ATOM_HR) {
+			*p++ = '\n';
+			*p++ = '\n';
+		}
+		else if (HtmlLibHasTextCache(child)) {
+			memcpy(p, child->textCache->text, child->textCache->length);
+			p += child->textCache->length;
+		}
+		else if (!HtmlLibIsIntegerIn(child->type, HTML_TYPE_SINGLE, HTML_TYPE_COMMENT, HTML_TYPE_DOCTYPE, HTML_TYPE_SCRIPT, -1)) {
+			p = HtmlLibCopyObjectText(child, p);
+		}
+
+		if (child->afterText && (length = strlen(child->afterText))) {
+			memcpy(p, child->afterText, length);
+			p += length;
+		}
+	}
+	return p;
+}
+
+
+/* 内部すべてのタグのテキストを取得
+
+テキストはオブジェクトにキャッシュされ、下のテキストやツリーが変わるまで次の呼び出しでそのまま返される
+作るときは長さを先に数えて一度だけ確保し、キャッシュが新しい子のテキストはコピーされる
+object を書き換えるので、複数のスレッドからは HtmlGetObjectTextToBuffer() を使う
+
+@param object テキストを取得するオブジェクト
+@return テキスト、オブジェクトを破棄するか下を変更して再び呼び出すまで有効
+*/
 const char* HtmlGetObjectText(HtmlObject* object) {
 	// checks parameter useable
 	HtmlHandleNullError(object, "");
@@ -1074,81 +1995,59 @@ const char* HtmlGetObjectText(HtmlObject* object) {
 		return ""; // No text to write for not text-containing types
 	}
 
-	// create StreamBuffer that write after object->name
-    HtmlStream stream = HtmlCreateStreamBuffer(128);
-
-    int resultOffset = 1;
-    if (object->name) {
-        resultOffset += strlen(object->name);
-        stream.write(object->name, resultOffset, 1, stream.data);
-    }
-    else {
-        stream.putchar('\0', stream.data);
-    }
-
-    // write string
-    HtmlCode ret = HtmlLibGetObjectText(object, &stream);
-    if (ret != HTML_OK) {
-        HtmlDestroyStream(&stream);
-
-        HtmlHandleError(true, "", "error writing object (%d)", ret);
-    }
-
-    // store result to object->name
-    if (object->name) {
-        free(object->name);
-    }
+	if (HtmlLibHasTextCache(object)) {
+		return object->textCache->text;
+	}
 
-    HtmlStreamString* streamString = (HtmlStreamString*)stream.data;
-    streamString->buffer[streamString->length] = 0;
+	// make the cache at its exact size
+	size_t length = HtmlLibMeasureObjectText(object);
+	HtmlLibTextCache* cache = (HtmlLibTextCache*)realloc(object->textCache, sizeof(HtmlLibTextCache) + length + 1);
+	HtmlHandleOutOfMemoryError(cache, "");
 
-    object->name = streamString->buffer;
+	*HtmlLibCopyObjectText(object, cache->text) = '\0';
+	cache->generation = object->generation;
+	cache->length = length;
 
-    // free HtmlStreamString without its buffer
-    free(stream.data);
-	return object->name + resultOffset; // Return the name as the text content
+	object->textCache = cache;
+	HtmlLibMarkObjectMixed(object);
+	return cache->text;
 }
 
 
 
-const char* HtmlGetObjectAfterText(HtmlObject* object) {
+const char* HtmlGetObjectAfterText(const HtmlObject* object) {
 	HtmlHandleNullError(object, NULL);
 	return object->afterText ? object->afterText : "";
 }
 
-const char* HtmlGetObjectAttrValue(HtmlObject* object, const char* attrName) {
+const char* HtmlGetObjectAttrValue(const HtmlObject* object, const char* attrName) {
 	HtmlHandleNullError(object, NULL);
 	HtmlHandleEmptyStringError(attrName, NULL);
 
 	// Search for the attribute
-	const char* _attrName, *_attrValue;
-	HtmlForeachObjectAttributes(object, _attrName, _attrValue) {
-		if (strcmp(attrName, _attrName) == 0) {
-			return _attrValue;
-		}
-	}
-	return NULL; // Attribute not found
+	HtmlAttribute* attr = HtmlLibFindObjectAttribute(object, HtmlLibLookupAtom(attrName, strlen(attrName)), attrName);
+	return attr ? attr->value : NULL;
 }
 #define HtmlGetObjectAttributeValue(object, attrName) HtmlGetObjectAttrValue(object, attrName)
 
 
-HtmlObject* HtmlGetObjectFirstChild(HtmlObject* object) {
+HtmlObject* HtmlGetObjectFirstChild(const HtmlObject* object) {
 	HtmlHandleNullError(object, NULL);
 	return object->firstChild;
 }
 
-HtmlObject* HtmlGetObjectLastChild(HtmlObject* object) {
+HtmlObject* HtmlGetObjectLastChild(const HtmlObject* object) {
 	HtmlHandleNullError(object, NULL);
 	return object->lastChild;
 }
 
-HtmlObject* HtmlGetObjectParent(HtmlObject* object) {
+HtmlObject* HtmlGetObjectParent(const HtmlObject* object) {
 	HtmlHandleNullError(object, NULL);
 	return object->parent;
 }
 
 
-const char* HtmlGetObjectTypeString(HtmlObject* object) {
+const char* HtmlGetObjectTypeString(const HtmlObject* object) {
 	HtmlHandleNullError(object, "(null)");
 	
 	switch (object->type) {
@@ -1180,37 +2079,31 @@ void HtmlRemoveObjectAttribute(HtmlObject* object, const char* attrName) {
 	HtmlHandleNullError(attrName, );
 
 	// Search for the attribute
-	HtmlAttributeIterator iter = HtmlBeginAttribute(object);
-	
-	while ((iter.now = iter.next)) {
-		if (iter.next) {
-			iter.next = iter.next->next;
-		}
-		if (strcmp(attrName, iter.now->name) != 0) {
-			continue;
-		}
+	unsigned short atom = HtmlLibLookupAtom(attrName, strlen(attrName));
+	HtmlAttribute* attr = HtmlLibFindObjectAttribute(object, atom, attrName);
+	if (attr == NULL) {
+		return;
+	}
 
-		// Remove relationships
-		if (iter.now->prev) {
-			iter.now->prev->next = iter.now->next;
-		}
-		else {
-			object->firstAttribute = iter.next;
-		}
-		if (iter.next) {
-			iter.next->prev = iter.now->prev;
-		}
-		else {
-			object->lastAttribute = iter.now->prev;
-		}
+	if (atom == HTML_ATOM_ID || atom == HTML_ATOM_CLASS) {
+		HtmlLibChangeDocumentTree(HtmlLibGetObjectDocument(object));
+	}
 
-		// Free the attribute memory
-		free(iter.now->name);
-		free(iter.now->value);
-		free(iter.now);
-		return;
+	// Free the attribute memory
+	HtmlLibReleaseString(&attr->name, &attr->flags, HTML_BORROWED_ATTR_NAME);
+	HtmlLibReleaseString(&attr->value, &attr->flags, HTML_BORROWED_ATTR_VALUE);
+
+	// later attributes move down, the order is kept
+	object->attributeCount--;
+	memmove(attr, attr + 1, (size_t)(object->attributes + object->attributeCount - attr) * sizeof(HtmlAttribute));
+
+	// a later class or id attribute takes the place
+	if (atom == HTML_ATOM_CLASS) {
+		HtmlLibSetObjectClassList(HtmlLibGetObjectDocument(object), object);
+	}
+	if (atom == HTML_ATOM_ID || atom == HTML_ATOM_CLASS) {
+		HtmlLibSpreadObjectBloom(object);
 	}
-	return;
 }
 
 
@@ -1219,41 +2112,177 @@ void HtmlRemoveObjectAttribute(HtmlObject* object, const char* attrName) {
 
 // Copy
 
-HtmlObject* HtmlCopyObject(HtmlObject* object) {
+// name of a clone, names of static atoms are shared, dynamic ones get atoms of the new document
+char* HtmlLibCloneName(HtmlDocument* document, bool sameDocument, bool share, const char* name, unsigned short* atom, unsigned short* flags, unsigned short borrowFlag) {
+	if (name == NULL) {
+		return NULL;
+	}
+	if (*atom != HTML_ATOM_NONE && *atom < HTML_ATOM_DYNAMIC) {
+		*flags |= borrowFlag;
+		return (char*)HtmlLibAtomNames[*atom];
+	}
+	if (share && sameDocument) {
+		*flags |= borrowFlag;
+		return (char*)name;
+	}
+
+	size_t length = strlen(name);
+	char* copy = HtmlLibCopyString(document, name, length, flags, borrowFlag);
+	if (copy && sameDocument == false) {
+		*atom = HtmlLibInternAtom(document, copy, length);
+	}
+	return copy;
+}
+
+// string of a clone, shared strings are borrowed from the source
+char* HtmlLibCloneString(HtmlDocument* document, bool share, const char* text, unsigned short* flags, unsigned short borrowFlag) {
+	if (text == NULL) {
+		return NULL;
+	}
+	if (share) {
+		*flags |= borrowFlag;
+		return (char*)text;
+	}
+	return HtmlLibCopyString(document, text, strlen(text), flags, borrowFlag);
+}
+
+// copy fields of object but children to clone, attributes are made in one array of the exact size
+bool HtmlLibFillClone(HtmlDocument* document, bool sameDocument, bool share, const HtmlObject* object, HtmlObject* clone) {
+	clone->atom = object->atom;
+	clone->name = HtmlLibCloneName(document, sameDocument, share, object->name, &clone->atom, &clone->flags, HTML_BORROWED_NAME);
+	clone->innerText = HtmlLibCloneString(document, share, object->innerText, &clone->flags, HTML_BORROWED_INNER_TEXT);
+	clone->afterText = HtmlLibCloneString(document, share, object->afterText, &clone->flags, HTML_BORROWED_AFTER_TEXT);
+	if ((object->name && !clone->name) || (object->innerText && !clone->innerText) || (object->afterText && !clone->afterText)) {
+		return false;
+	}
+
+	if (object->attributeCount) {
+		clone->attributes = (HtmlAttribute*)HtmlLibAllocMemory(document, object->attributeCount * sizeof(HtmlAttribute), sizeof(void*));
+		HtmlHandleOutOfMemoryError(clone->attributes, false);
+		clone->attributeCapacity = object->attributeCount;
+		clone->flags |= document ? HTML_BORROWED_ATTRIBUTES : 0;
+
+		for (unsigned int i = 0; i < object->attributeCount; i++) {
+			const HtmlAttribute* from = &object->attributes[i];
+			HtmlAttribute* attr = &clone->attributes[clone->attributeCount++];
+
+			attr->flags = 0;
+			attr->atom = from->atom;
+			attr->name = HtmlLibCloneName(document, sameDocument, share, from->name, &attr->atom, &attr->flags, HTML_BORROWED_ATTR_NAME);
+			attr->value = HtmlLibCloneString(document, share, from->value, &attr->flags, HTML_BORROWED_ATTR_VALUE);
+			if ((from->name && !attr->name) || (from->value && !attr->value)) {
+				return false;
+			}
+		}
+
+		if (object->classList && HtmlLibSetObjectClassList(document, clone) == false) {
+			return false;
+		}
+	}
+
+	clone->subtreeBloom = object->subtreeBloom;
+	return true;
+}
+
+// clone of object without children as the last child of parent
+HtmlObject* HtmlLibCloneNode(HtmlDocument* document, bool sameDocument, bool share, const HtmlObject* object, HtmlObject* parent) {
+	HtmlObject* clone = HtmlLibAllocObject(document, object->type);
+	HtmlHandleOutOfMemoryError(clone, NULL);
+
+	// a clone under parent is cleaned with the whole clone on failure
+	if (parent) {
+		HtmlLibAddObjectChild(parent, clone);
+	}
+
+	if (HtmlLibFillClone(document, sameDocument, share, object, clone) == false) {
+		if (parent == NULL) {
+			HtmlLibDestroyObject(clone);
+		}
+		return NULL;
+	}
+	return clone;
+}
+
+
+/* サブツリーを複製
+
+object とその下のすべてを一回の走査で複製して parent の最後の子にする
+タイプ、名前、テキスト、属性、クラスがすべて保たれ、メモリは parent のドキュメントから取られる
+ドキュメントを複製すると新しいドキュメントになるので、テンプレートからドキュメントを量産できる
+
+@param object 複製するオブジェクト
+@param parent 複製の親、NULL なら親のない複製 (ドキュメントの複製は NULL のみ)
+@param shareStrings true ならテキストと属性値をコピーせず object のものを共有する、それらは複製より長く有効である必要がある
+@return 複製、失敗すれば NULL
+*/
+HtmlObject* HtmlCloneObject(HtmlObject* object, HtmlObject* parent, bool shareStrings) {
 	HtmlHandleNullError(object, NULL);
+	HtmlHandleError(object->type == HTML_TYPE_DOCUMENT && parent, NULL, "a document can not be cloned under a parent");
 
-	// Create a new object with the same type and name
-	HtmlObject* copy = (HtmlObject*)calloc(1, sizeof(HtmlObject));
-	HtmlHandleOutOfMemoryError(copy, NULL);
+	HtmlDocument* document = HtmlLibGetObjectDocument(parent);
+	bool sameDocument = HtmlLibGetObjectDocument(object) == document;
+	HtmlObject* root;
 
-	// Copy innerText and afterText
-	HtmlSetText(copy->innerText, object->innerText);
-	HtmlSetText(copy->afterText, object->afterText);
+	if (object->type == HTML_TYPE_DOCUMENT) {
+		root = HtmlCreateObjectDocument();
+		HtmlHandleOutOfMemoryError(root, NULL);
+		document = (HtmlDocument*)root;
+		sameDocument = false;
 
-	// Copy attributes
-	const char* attrName, *attrValue;
-	HtmlForeachObjectAttributes(object, attrName, attrValue) {
-		if (HtmlSetObjectAttribute(copy, attrName, attrValue) != HTML_OK) {
-			HtmlDestroyObject(copy);
-			return NULL; // Out of memory error
+		root->innerText = HtmlLibCloneString(document, shareStrings, object->innerText, &root->flags, HTML_BORROWED_INNER_TEXT);
+		root->subtreeBloom = object->subtreeBloom;
+	}
+	else {
+		root = HtmlLibCloneNode(document, sameDocument, shareStrings, object, NULL);
+		if (root == NULL) {
+			return NULL;
 		}
 	}
 
-	// Copy children
-	HtmlObject* child;
-	HtmlForeachObjectChildren(object, child) {
-		HtmlObject* childCopy = HtmlCopyObject(child);
-		if (childCopy == NULL) {
-			HtmlDestroyObject(copy);
-			return NULL; // Out of memory error
+	// walk the source in document order, `to` follows it in the clone
+	const HtmlObject* from = object;
+	HtmlObject* to = root;
+
+	for (;;) {
+		if (from->firstChild) {
+			from = from->firstChild;
+			to = HtmlLibCloneNode(document, sameDocument, shareStrings, from, to);
+		}
+		else {
+			while (from != object && from->next == NULL) {
+				from = from->parent;
+				to = to->parent;
+			}
+			if (from == object) {
+				break;
+			}
+
+			from = from->next;
+			to = HtmlLibCloneNode(document, sameDocument, shareStrings, from, to->parent);
+		}
+
+		if (to == NULL) {
+			HtmlDestroyObject(root);
+			return NULL;
 		}
-		HtmlLibAddObjectChild(copy, childCopy);
 	}
 
-	return copy;
+	// put under parent at last, parent may be in the subtree
+	if (parent) {
+		HtmlLibAddObjectChild(parent, root);
+		HtmlLibChangeDocumentTree(document);
+		HtmlLibChangeObjectText(parent);
+		HtmlLibSpreadObjectBloom(root);
+	}
+	return root;
 }
 
 
+// copy of object and its children without parent, strings are malloc'd
+HtmlObject* HtmlCopyObject(HtmlObject* object) {
+	return HtmlCloneObject(object, NULL, false);
+}
+
 
 
 
@@ -1273,12 +2302,7 @@ size_t HtmlCountObjectChildren(HtmlObject* object) {
 size_t HtmlCountObjectAttributes(HtmlObject* object) {
 	HtmlHandleNullError(object, 0);
 
-	size_t count = 0;
-	const char* attrName, *attrValue;
-	HtmlForeachObjectAttributes(object, attrName, attrValue) {
-		count++;
-	}
-	return count;
+	return object->attributeCount;
 }
 
 
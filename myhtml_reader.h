@@ -8,40 +8,53 @@
 
 #include <ctype.h>
 
+#ifndef _MYHTML_SCAN_H_
+#include "myhtml_scan.h"
+#endif
 
 
+// files are mapped to memory on POSIX systems, define HTML_NO_MMAP to read them instead
+#if !defined(HTML_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+	#define HTML_USE_MMAP
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
 
-#define HtmlLibIsNameChar(c) (isalnum(c) || c == '-' || c == '_' || c == ':' || c == '.')
+// big buffers are parsed by threads on POSIX systems, programs are linked with -pthread
+// define HTML_NO_THREADS to parse them on one thread and link without it
+#if !defined(HTML_NO_THREADS) && (defined(__unix__) || defined(__APPLE__))
+	#define HTML_USE_THREADS
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
 
 
 
-bool HtmlLibIsStringIn(const char* str, ...) {
-    va_list ap;
-    va_start(ap, str);
 
-    const char* cmp;
-    while ((cmp = va_arg(ap, const char*))) {
-        if (strcmp(str, cmp) == 0) {
-            va_end(ap);
-            return true;
-        }
-    }
-    va_end(ap);
-    return false;
-}
+#define HtmlLibIsNameChar(c) (isalnum(c) || c == '-' || c == '_' || c == ':' || c == '.')
 
 
 
-HtmlObjectType HtmlLibDetactObjectType(const char* tagName) {
-    if (HtmlLibIsStringIn(tagName, "meta", "link", "img", "input", "br", "hr", NULL)) {
-        return HTML_TYPE_SINGLE;
+HtmlObjectType HtmlLibGetAtomObjectType(unsigned short atom) {
+    switch (atom) {
+        case HTML_ATOM_META: case HTML_ATOM_LINK: case HTML_ATOM_IMG: case HTML_ATOM_INPUT: case HTML_ATOM_BR: case HTML_ATOM_HR:
+            return HTML_TYPE_SINGLE;
+        case HTML_ATOM_SCRIPT: case HTML_ATOM_STYLE:
+            return HTML_TYPE_SCRIPT;
+        default:
+            return HTML_TYPE_TAG;
     }
-    if (HtmlLibIsStringIn(tagName, "script", "style", NULL)) {
-        return HTML_TYPE_SCRIPT;
-    }
-    return HTML_TYPE_TAG;
 }
 
+#define HtmlLibDetactObjectType(tagName) HtmlLibGetAtomObjectType(HtmlLibLookupAtom(tagName, strlen(tagName)))
+
+
+// open element `object` is closed by end tag `name` of `atom`, names without atom are compared ignoring case
+#define HtmlLibIsClosingTag(object, atom, name, length) \
+    ((atom) != HTML_ATOM_DYNAMIC && (object)->atom != HTML_ATOM_DYNAMIC ? (object)->atom == (atom) \
+        : strncasecmp((object)->name, (name), (length)) == 0 && (object)->name[length] == 0)
+
+
 int HtmlLibHexToInt(char c) {
     if (c >= '0' && c <= '9') {
         return c - '0';
@@ -57,251 +70,530 @@ int HtmlLibHexToInt(char c) {
 
 
 
-char* HtmlLibParseFormatedString(HtmlStream* stream, int symbol) {
-	HtmlStreamString output = (HtmlStreamString){(char*)malloc(64), 0, 0, 64};
+// HtmlStream Window //
+//
+// the reader takes bytes from a window instead of calling getchar per byte,
+// the window is a span of the stream itself (peek / consume) or a block copied by read / getchar
+
+#define HTML_STREAM_WINDOW_SIZE 4096
+
+typedef struct HtmlLibStreamWindow {
+	HtmlStream* stream;
+
+	const char* begin;		// current window
+	const char* p;
+	const char* end;
+	size_t position;		// stream position of `begin`
+
+	char buffer[HTML_STREAM_WINDOW_SIZE];		// window of streams without peek
+} HtmlLibStreamWindow;
+
+
+void HtmlLibInitStreamWindow(HtmlLibStreamWindow* window, HtmlStream* stream) {
+	window->stream = stream;
+	window->begin = window->p = window->end = NULL;
+	window->position = stream->tell ? stream->tell(stream->data) : 0;
+
+	// not seekable streams (pipes) give -1, positions are counted from here
+	if (window->position == (size_t)-1) {
+		window->position = 0;
+	}
+}
+
+
+// move to the next window, return false at the end of stream
+bool HtmlLibFillStreamWindow(HtmlLibStreamWindow* window) {
+	HtmlStream* stream = window->stream;
+	size_t length = 0;
+	int c;
+
+	window->position += window->end - window->begin;
+
+	if (HtmlIsStreamBuffered(stream)) {
+		stream->consume(stream->data, window->end - window->begin);
+		window->begin = stream->peek(stream->data, &length);
+	}
+	else {
+		if (stream->read) {
+			length = stream->read(window->buffer, 1, HTML_STREAM_WINDOW_SIZE, stream->data);
+		}
+		else {
+			// legacy stream having getchar only
+			while (length < HTML_STREAM_WINDOW_SIZE && (c = stream->getchar(stream->data)) != EOF) {
+				window->buffer[length++] = c;
+			}
+		}
+		window->begin = window->buffer;
+	}
+
+	window->p = window->begin;
+	window->end = window->begin + length;
+	return length > 0;
+}
+
+#define HtmlLibGetcharFromWindow(window) \
+	(((window)->p < (window)->end || HtmlLibFillStreamWindow(window)) ? (unsigned char)*(window)->p++ : EOF)
+
+#define HtmlLibTellStreamWindow(window) \
+	((window)->position + ((window)->p - (window)->begin))
+
+
+size_t HtmlLibReadFromWindow(HtmlLibStreamWindow* window, char* buf, size_t n) {
+	size_t length = 0;
+	int c;
+
+	while (length < n && (c = HtmlLibGetcharFromWindow(window)) != EOF) {
+		buf[length++] = c;
+	}
+	return length;
+}
+
+
+// skip spaces by spans and append them to `output`, then take the next char
+int HtmlLibSkipWindowSpaces(HtmlLibStreamWindow* window, HtmlStreamString* output) {
+	do {
+		const char* p = HtmlLibScanSpaces(window->p, window->end);
+
+		HtmlLibWriteStreamString((void*)window->p, p - window->p, 1, output);
+		window->p = p;
+	} while (window->p == window->end && HtmlLibFillStreamWindow(window));
+
+	return HtmlLibGetcharFromWindow(window);
+}
+
+// append the window to `output` untils `str` (see HtmlLibFindStringIgnoreCase), `str` is not kept in `output`
+// return false at the end of stream
+bool HtmlLibReadWindowUntil(HtmlLibStreamWindow* window, const char* str, size_t length, HtmlStreamString* output) {
+	size_t outputBegin = output->length;
+	char joint[32];
+
+	while (window->p < window->end || HtmlLibFillStreamWindow(window)) {
+		size_t spanLength = window->end - window->p;
+
+		// `str` can cross the windows, check the last bytes of output joined with the window
+		size_t tail = output->length - outputBegin;
+		tail = tail < length - 1 ? tail : length - 1;
+
+		if (tail > 0 && length <= sizeof(joint) / 2) {
+			size_t head = spanLength < length - 1 ? spanLength : length - 1;
+
+			memcpy(joint, output->buffer + output->length - tail, tail);
+			memcpy(joint + tail, window->p, head);
+
+			const char* found = HtmlLibFindStringIgnoreCase(joint, joint + tail + head, str, length);
+			if (found && (size_t)(found - joint) < tail) {
+				output->length -= tail - (found - joint);
+				window->p += (found - joint) + length - tail;
+				return true;
+			}
+		}
+
+		// inside the window
+		const char* found = HtmlLibFindStringIgnoreCase(window->p, window->end, str, length);
+		const char* stop = found ? found : window->end;
+
+		HtmlLibWriteStreamString((void*)window->p, stop - window->p, 1, output);
+
+		if (found) {
+			window->p = found + length;
+			return true;
+		}
+		window->p = window->end;
+	}
+	return false;
+}
+
+
+// give back the unread part of window to the stream
+void HtmlLibCloseStreamWindow(HtmlLibStreamWindow* window) {
+	HtmlStream* stream = window->stream;
+
+	if (HtmlIsStreamBuffered(stream)) {
+		stream->consume(stream->data, window->p - window->begin);
+	}
+	else if (window->p != window->end && stream->seek) {
+		stream->seek(stream->data, HtmlLibTellStreamWindow(window), SEEK_SET);
+	}
+	window->begin = window->p = window->end = NULL;
+}
+
+
+
+
+// join `text` after the text at `place` of `owner`, the result is in document memory
+void HtmlLibJoinObjectText(HtmlDocument* document, HtmlObject* owner, char** place, unsigned short borrowFlag, const char* text, size_t length) {
+	size_t placeLength = strlen(*place);
+	char* joined = (char*)HtmlLibAllocMemory(document, placeLength + length + 1, 1);
+	HtmlHandleOutOfMemoryError(joined, );
+
+	memcpy(joined, *place, placeLength);
+	memcpy(joined + placeLength, text, length);
+	joined[placeLength + length] = 0;
+
+	HtmlLibReleaseString(place, &owner->flags, borrowFlag);
+	if (document) {
+		owner->flags |= borrowFlag;
+	}
+	*place = joined;
+}
+
+
+
+
+// read a quoted string and append to `output`
+void HtmlLibParseFormatedString(HtmlLibStreamWindow* window, int symbol, HtmlStreamString* output) {
 	int c;
 	int c1, c2;
 
-	while ((c = stream->getchar(stream->data)) != symbol) {
+	while ((c = HtmlLibGetcharFromWindow(window)) != symbol) {
         if (c == EOF) {
-            output.buffer[output.length] = 0; // Null-terminate the string
-
-			HtmlHandleError(true, output.buffer, "HTML not expected end! (position %lu)", stream->tell(stream->data));
+			HtmlHandleError(true, , "HTML not expected end! (position %lu)", HtmlLibTellStreamWindow(window));
         }
 		if (c != '\\') {
-			HtmlLibPutcharToStreamString(c, &output);
+			HtmlLibPutcharToStreamString(c, output);
 			continue;
 		}
         
-		switch (stream->getchar(stream->data)) {
+		switch (HtmlLibGetcharFromWindow(window)) {
 			case 'a':
-				HtmlLibPutcharToStreamString('\a', &output);
+				HtmlLibPutcharToStreamString('\a', output);
 				break;
 			case 'r':
-				HtmlLibPutcharToStreamString('\r', &output);
+				HtmlLibPutcharToStreamString('\r', output);
 				break;
 			case 'n':
-				HtmlLibPutcharToStreamString('\n', &output);
+				HtmlLibPutcharToStreamString('\n', output);
 				break;
 			case 't':
-				HtmlLibPutcharToStreamString('\t', &output);
+				HtmlLibPutcharToStreamString('\t', output);
 				break;
 			case 'x':
-				c1 = HtmlLibHexToInt(stream->getchar(stream->data));
-				c2 = HtmlLibHexToInt(stream->getchar(stream->data));
+				c1 = HtmlLibHexToInt(HtmlLibGetcharFromWindow(window));
+				c2 = HtmlLibHexToInt(HtmlLibGetcharFromWindow(window));
 
-				HtmlLibPutcharToStreamString((c1 << 4) + c2, &output);
+				HtmlLibPutcharToStreamString((c1 << 4) + c2, output);
 				break;
 			default:
-				HtmlLibPutcharToStreamString(c, &output);
+				HtmlLibPutcharToStreamString(c, output);
 		}
 	}
-	output.buffer[output.length] = 0;
-	return output.buffer;
 }
 
 
 
-int HtmlLibParseAttributes(HtmlObject* object, HtmlStream* stream, int c) {
-	HtmlAttribute* attr;
-	HtmlStream name, value;
 
+// Parse Events //
+//
+// the stream tokenizer gives its tokens to a sink, the sink builds the tree
+// or calls the event handlers of HtmlParseEvents()
+
+typedef void (*HtmlCallbackEvent)(void* userdata, const char* text, size_t length);
+typedef void (*HtmlCallbackAttributeEvent)(void* userdata, const char* name, size_t nameLength, const char* value, size_t valueLength);
+
+// every handler can be NULL, strings are not terminated and valid only in the call
+typedef struct HtmlEventHandlers {
+	HtmlCallbackEvent onStartTag;				// lowered tag name
+	HtmlCallbackAttributeEvent onAttribute;		// attribute of the last start tag, `value` is NULL if no value
+	HtmlCallbackEvent onText;					// text, or content of script / style even if empty
+	HtmlCallbackEvent onEndTag;					// lowered tag name, also given after script / style
+	HtmlCallbackEvent onComment;
+	HtmlCallbackEvent onDoctype;
+} HtmlEventHandlers;
+
+
+typedef struct HtmlLibStreamSink {
+	const HtmlEventHandlers* handlers;		// NULL to build tree
+	void* userdata;
+
+	// tree
+	HtmlDocument* document;
+	HtmlObject* current;
+	HtmlObject* tag;						// the last start tag taking attributes
+
+	HtmlLibPendingAttributes pending;		// attributes of tag, given to it by HtmlLibEmitStartTagEnd()
+} HtmlLibStreamSink;
+
+
+#define HtmlLibCallEvent(sink, event, ...) \
+	{ if ((sink)->handlers->event) (sink)->handlers->event((sink)->userdata, __VA_ARGS__); }
+
+
+void HtmlLibEmitText(HtmlLibStreamSink* sink, const char* text, size_t length) {
+	if (sink->handlers) {
+		HtmlLibCallEvent(sink, onText, text, length);
+		return;
+	}
+
+	// Get insert place
+	HtmlObject* owner = sink->current->lastChild ? sink->current->lastChild : sink->current;
+	char** place = owner == sink->current ? &owner->innerText : &owner->afterText;
+	unsigned short borrowFlag = owner == sink->current ? HTML_BORROWED_INNER_TEXT : HTML_BORROWED_AFTER_TEXT;
+
+	// text split by an ignored end tag, join both parts
+	if (*place) {
+		HtmlLibJoinObjectText(sink->document, owner, place, borrowFlag, text, length);
+	}
+	else {
+		*place = HtmlLibCopyString(sink->document, text, length, &owner->flags, borrowFlag);
+	}
+}
+
+void HtmlLibEmitTextObject(HtmlLibStreamSink* sink, HtmlObjectType type, const char* text, size_t length) {
+	if (sink->handlers) {
+		if (type == HTML_TYPE_COMMENT) {
+			HtmlLibCallEvent(sink, onComment, text, length);
+		}
+		else {
+			HtmlLibCallEvent(sink, onDoctype, text, length);
+		}
+		return;
+	}
+
+	HtmlObject* object = HtmlLibAddObjectChild(sink->current, HtmlLibAllocObject(sink->document, type));
+	object->innerText = HtmlLibCopyString(sink->document, text, length, &object->flags, HTML_BORROWED_INNER_TEXT);
+}
+
+void HtmlLibEmitStartTag(HtmlLibStreamSink* sink, const char* name, size_t length, unsigned short atom, HtmlObjectType type) {
+	if (sink->handlers) {
+		HtmlLibCallEvent(sink, onStartTag, name, length);
+		return;
+	}
+
+	// Create tag, single tag stays outside
+	sink->tag = HtmlLibAddObjectChild(sink->current, HtmlLibAllocObject(sink->document, type));
+	if (atom != HTML_ATOM_DYNAMIC) {
+		sink->tag->name = (char*)HtmlLibAtomNames[atom];
+		sink->tag->flags |= HTML_BORROWED_NAME;
+		sink->tag->atom = atom;
+	}
+	else {
+		sink->tag->name = HtmlLibCopyString(sink->document, name, length, &sink->tag->flags, HTML_BORROWED_NAME);
+		sink->tag->atom = HtmlLibInternAtom(sink->document, sink->tag->name, length);
+	}
+	HtmlLibSpreadObjectBloom(sink->tag);
+
+	if (type != HTML_TYPE_SINGLE) {
+		sink->current = sink->tag;
+	}
+}
+
+void HtmlLibEmitAttribute(HtmlLibStreamSink* sink, const char* name, size_t nameLength, const char* value, size_t valueLength) {
+	if (sink->handlers) {
+		HtmlLibCallEvent(sink, onAttribute, name, nameLength, value, valueLength);
+		return;
+	}
+
+	HtmlAttribute* attr = HtmlLibAddPendingAttribute(sink->document, sink->tag, &sink->pending);
+	HtmlHandleOutOfMemoryError(attr, );
+
+	if (HtmlLibSetAttributeName(sink->document, attr, HtmlLibLookupAtom(name, nameLength), name, nameLength) == false) {
+		sink->pending.count--;
+		return;
+	}
+	attr->value = value ? HtmlLibCopyString(sink->document, value, valueLength, &attr->flags, HTML_BORROWED_ATTR_VALUE) : NULL;
+}
+
+// attributes of the start tag are all read
+void HtmlLibEmitStartTagEnd(HtmlLibStreamSink* sink) {
+	if (sink->handlers || sink->pending.count == 0) {
+		return;
+	}
+
+	HtmlLibFlushPendingAttributes(sink->document, sink->tag, &sink->pending);
+	HtmlLibSetObjectClassList(sink->document, sink->tag);
+	HtmlLibSpreadObjectBloom(sink->tag);
+}
+
+void HtmlLibEmitEndTag(HtmlLibStreamSink* sink, const char* name, size_t length) {
+	if (sink->handlers) {
+		HtmlLibCallEvent(sink, onEndTag, name, length);
+		return;
+	}
+
+	// Find return element
+	HtmlObject* doc = &sink->document->object;
+	HtmlObject* backTag = sink->current;
+	unsigned short atom = HtmlLibFindAtom(sink->document, name, length);
+
+	while (backTag != doc && !HtmlLibIsClosingTag(backTag, atom, name, length)) {
+		backTag = backTag->parent;
+	}
+
+	// warning: Not exists element name
+	if (backTag == doc) {
+		HtmlLogWarning("Tag '%s' without closing! ('%.*s')", HtmlGetObjectName(sink->current), (int)length, name);
+		return;
+	}
+
+	// Return
+	sink->current = backTag->parent;
+}
+
+
+// text read untils a structure, spaces only are not text
+void HtmlLibFlushStreamText(HtmlLibStreamSink* sink, HtmlStreamString* text) {
+	if (HtmlLibScanSpaces(text->buffer, text->buffer + text->length) != text->buffer + text->length) {
+		HtmlLibEmitText(sink, text->buffer, text->length);
+	}
+	text->length = 0;
+}
+
+
+
+
+int HtmlLibParseAttributes(HtmlLibStreamSink* sink, HtmlLibStreamWindow* window, int c, HtmlStreamString* scratch) {
 	while (isspace(c)) {
 		// Clear Spaces
 		while (isspace(c)) {
-			c = stream->getchar(stream->data);
+			c = HtmlLibGetcharFromWindow(window);
 		}
 		if (c == '/') {
-			c = stream->getchar(stream->data);
+			c = HtmlLibGetcharFromWindow(window);
 
 			if (c == '>') {
 				return -1;
 			}
 		}
 
-		// Create attribute
-		attr = (HtmlAttribute*)malloc(sizeof(HtmlAttribute));
-		HtmlHandleOutOfMemoryError(attr, EOF);
-		
-		attr->next = NULL;
-		attr->prev = object->lastAttribute;
-
-		if (object->lastAttribute) {
-			object->lastAttribute->next = attr;
-		}
-		if (!object->firstAttribute) {
-			object->firstAttribute = attr;
-		}
-		object->lastAttribute = attr;
-
-		// Read name
-		name = HtmlCreateStreamBuffer(16);
+		// Read name, value is read after it
+		scratch->length = 0;
 
 		while (HtmlLibIsNameChar(c)) {
-			name.putchar(HtmlLibLowerChar(c), name.data);
-			c = stream->getchar(stream->data);
+			HtmlLibPutcharToStreamString(HtmlLibLowerChar(c), scratch);
+			c = HtmlLibGetcharFromWindow(window);
 		}
-		attr->name = (char*)HtmlGetStreamString(&name);
+		size_t nameLength = scratch->length;
 
 		// Set value (bool)
 		if (c != '=') {
-			attr->value = NULL;
+			HtmlLibEmitAttribute(sink, scratch->buffer, nameLength, NULL, 0);
 			continue;
 		}
 
 		// Next level
-		c = stream->getchar(stream->data);
+		c = HtmlLibGetcharFromWindow(window);
 
 		// Set value (formated string)
 		if (c == '\'' || c == '\"') {
-			attr->value = HtmlLibParseFormatedString(stream, c);
-			c = stream->getchar(stream->data);
-			continue;
+			HtmlLibParseFormatedString(window, c, scratch);
+			c = HtmlLibGetcharFromWindow(window);
 		}
-
 		// Set value (string)
-		value = HtmlCreateStreamBuffer(24);
-
-		while (isalnum(c) || c == '_' || c == '-') {
-			value.putchar(HtmlLibLowerChar(c), value.data);
-			c = stream->getchar(stream->data);
+		else {
+			while (isalnum(c) || c == '_' || c == '-') {
+				HtmlLibPutcharToStreamString(HtmlLibLowerChar(c), scratch);
+				c = HtmlLibGetcharFromWindow(window);
+			}
 		}
 
-		attr->value = (char*)HtmlGetStreamString(&value);
+		HtmlLibEmitAttribute(sink, scratch->buffer, nameLength, scratch->buffer + nameLength, scratch->length - nameLength);
 	}
 	return c;
 }
 
 
-
-
-
-
-HtmlObject* HtmlLibReadObjectFromStream(HtmlStream* stream) {
-	HtmlObject* doc = HtmlCreateObjectDocument();
-	
-	HtmlObject* current = doc;
-	HtmlStreamString buffer1;
+// strings are read to `scratch` and text to `text` in one pass, then given to `sink`
+void HtmlLibParseStream(HtmlLibStreamSink* sink, HtmlLibStreamWindow* window, HtmlStreamString* scratch, HtmlStreamString* text) {
+	HtmlStreamString* buffer1 = scratch;
 	int c;
-	size_t start;
+
+	text->length = 0;
 	
 	while (true) {
 		// Read char
-		start = stream->tell(stream->data);
-		c = stream->getchar(stream->data);
+		c = HtmlLibGetcharFromWindow(window);
 	SkipLoopGetChar:
-		// Clear Spaces
-		while (isspace(c)) {
-			c = stream->getchar(stream->data);
+		// Clear Spaces, they are kept in `text` in case of text follows
+		if (isspace(c)) {
+			HtmlLibPutcharToStreamString(c, text);
+			c = HtmlLibSkipWindowSpaces(window, text);
 		}
-		
+
 		// Exit if end
 		if (c == -1) {
-			return doc;
+			HtmlLibFlushStreamText(sink, text);
+			return;
 		}
 		
-		// Insert Text
+		// Read Text
 		if (c != '<') {
-			stream->seek(stream->data, start, SEEK_SET);
-			goto InsertText;
+			HtmlLibPutcharToStreamString(c, text);
+			goto ReadText;
 		}
 		
-		// Create Buffer to save read
-		buffer1 = (HtmlStreamString){(char*)malloc(24), 0, 0, 24};
+		// Clear Buffer to save read
+		buffer1->length = 0;
 		
 		// Next level detact
-		c = stream->getchar(stream->data);
+		c = HtmlLibGetcharFromWindow(window);
 		
 		if (c == '!') {
 			// HTML_COMMENT
-			stream->read(buffer1.buffer, 1, 2, stream->data);
+			buffer1->length = HtmlLibReadFromWindow(window, buffer1->buffer, 2);
 			
-			if (strcmp(buffer1.buffer, "--") == 0) {
+			if (buffer1->length == 2 && memcmp(buffer1->buffer, "--", 2) == 0) {
+				HtmlLibFlushStreamText(sink, text);
+
 				// Read comment text
-				buffer1.length = 0;
-				c = stream->getchar(stream->data);
-
-				while (true) {
-					if (c == -1) {
-						free(buffer1.buffer);
-						HtmlHandleError(true, doc, "html not expected end! (position %lu)", stream->tell(stream->data));
-					}
-
-					HtmlLibPutcharToStreamString(HtmlLibLowerChar(c), &buffer1);
-					if (buffer1.length >= 3 && memcmp(buffer1.buffer + buffer1.length - 3, "-->", 3) == 0) {
-						break;
-					}
-					c = stream->getchar(stream->data);
+				buffer1->length = 0;
+
+				if (HtmlLibReadWindowUntil(window, "-->", 3, buffer1) == false) {
+					HtmlHandleError(true, , "html not expected end! (position %lu)", HtmlLibTellStreamWindow(window));
+				}
+
+				for (size_t i = 0; i < buffer1->length; i++) {
+					buffer1->buffer[i] = HtmlLibLowerChar(buffer1->buffer[i]);
 				}
-				buffer1.buffer[buffer1.length - 3] = 0;
 
-				// Create Object
-				HtmlObject* tagComment = HtmlLibAddObjectChild(current, (HtmlObject*)calloc(1, sizeof(HtmlObject)));
-				tagComment->type = HTML_TYPE_COMMENT;
-				tagComment->innerText = buffer1.buffer;
+				HtmlLibEmitTextObject(sink, HTML_TYPE_COMMENT, buffer1->buffer, buffer1->length);
 				continue;
 			}
 			
 			/* HTML_DOCTYPE */
-			stream->read(buffer1.buffer + 2, 1, 6, stream->data);
-			buffer1.buffer[8] = 0;
+			buffer1->length += HtmlLibReadFromWindow(window, buffer1->buffer + buffer1->length, 6);
 			
-			if (strcasecmp(buffer1.buffer, "doctype ") == 0) {
+			if (buffer1->length == 8 && strncasecmp(buffer1->buffer, "doctype ", 8) == 0) {
+				HtmlLibFlushStreamText(sink, text);
+
 				// Read text
-				buffer1.length = 0;
-				c = stream->getchar(stream->data);
+				buffer1->length = 0;
+				c = HtmlLibGetcharFromWindow(window);
 
 				while (c != '>' && c != -1) {
-					HtmlLibPutcharToStreamString(HtmlLibLowerChar(c), &buffer1);
-					c = stream->getchar(stream->data);
+					HtmlLibPutcharToStreamString(HtmlLibLowerChar(c), buffer1);
+					c = HtmlLibGetcharFromWindow(window);
 				}
 
-				// Create object
-				HtmlObject* tagDoctype = HtmlLibAddObjectChild(current, (HtmlObject*)calloc(1, sizeof(HtmlObject)));
-				tagDoctype->type = HTML_TYPE_DOCTYPE;
-                
-                buffer1.buffer[buffer1.length] = 0; // Null-terminate the string
-				tagDoctype->innerText = buffer1.buffer;
+				HtmlLibEmitTextObject(sink, HTML_TYPE_DOCTYPE, buffer1->buffer, buffer1->length);
 				continue;
 			}
 			
-			// ERROR: Unknow format "<!XXXXXXXX"
-			free(buffer1.buffer);
-			goto InsertText;
+			// ERROR: Unknow format "<!XXXXXXXX", the part read is text anyway
+			HtmlLibWriteStreamString((void*)"<!", 2, 1, text);
+			HtmlLibWriteStreamString(buffer1->buffer, buffer1->length, 1, text);
+			goto ReadText;
 		}
+
+		// Text ends at structure
+		HtmlLibFlushStreamText(sink, text);
+
 		/* End Tag */
 		if (c == '/') {
 			// read close tag name
-			c = stream->getchar(stream->data);
+			c = HtmlLibGetcharFromWindow(window);
 
 			while (HtmlLibIsNameChar(c)) {
-				HtmlLibPutcharToStreamString(HtmlLibLowerChar(c), &buffer1);
-				c = stream->getchar(stream->data);
+				HtmlLibPutcharToStreamString(HtmlLibLowerChar(c), buffer1);
+				c = HtmlLibGetcharFromWindow(window);
 			}
 
 			// ERROR: Not expected stream end
 			if (c == -1) {
-				fprintf(stderr, "error %s: HTML not expected end! (position: %lu)\n", __func__, stream->tell(stream->data));
-				free(buffer1.buffer);
-				return doc;
-			}
-
-			buffer1.buffer[buffer1.length] = 0; // Null-terminate the string
-			
-			// Find return element
-			HtmlObject* backTag = current;
-			while (backTag != doc && strcmp(backTag->name, buffer1.buffer) != 0) {
-				backTag = backTag->parent;
-			}
-
-			// warning: Not exists element name
-			if (backTag == doc) {
-				HtmlLogWarning("Tag '%s' without closing! (%lu '%s' '%s')", HtmlGetObjectName(current), stream->tell(stream->data), backTag->name, buffer1.buffer);
-				continue;
+				fprintf(stderr, "error %s: HTML not expected end! (position: %lu)\n", __func__, HtmlLibTellStreamWindow(window));
+				return;
 			}
 
-			// Return
-			current = backTag->parent;
+			HtmlLibEmitEndTag(sink, buffer1->buffer, buffer1->length);
 			continue;
 		}
 		
@@ -309,186 +601,1352 @@ HtmlObject* HtmlLibReadObjectFromStream(HtmlStream* stream) {
 
 		// Read tag name
 		while (HtmlLibIsNameChar(c)) {
-			HtmlLibPutcharToStreamString(HtmlLibLowerChar(c), &buffer1);
-			c = stream->getchar(stream->data);
+			HtmlLibPutcharToStreamString(HtmlLibLowerChar(c), buffer1);
+			c = HtmlLibGetcharFromWindow(window);
 		}
+		unsigned short atom = HtmlLibLookupAtom(buffer1->buffer, buffer1->length);
+		HtmlObjectType type = HtmlLibGetAtomObjectType(atom);
 
-		// Create tag
-		current = HtmlLibAddObjectChild(current, (HtmlObject*)calloc(1, sizeof(HtmlObject)));
+		HtmlLibPutcharToStreamString(0, buffer1); // Null-terminate the string
 
-        buffer1.buffer[buffer1.length] = 0; // Null-terminate the string
-		current->name = buffer1.buffer;
-		current->type = HtmlLibDetactObjectType(current->name);
+		// Make string "</tagName>" for end check of script / style, it will never take more than 10 bytes
+		char endText[12];
+		size_t endLength = buffer1->length + 2;
 
-
-		// Read Attributes
-		c = HtmlLibParseAttributes(current, stream, c);
-
-		// Return if new element is single
-		if (current->type == HTML_TYPE_SINGLE) {
-			current = current->parent;
+		if (type == HTML_TYPE_SCRIPT) {
+			sprintf(endText, "</%s>", buffer1->buffer);
 		}
 
-		// Special read text method for script / style
-		if (current->type == HTML_TYPE_SCRIPT) {
-			// Make string "</tagName>" for end check, it will never take more than 10 bytes
-			size_t endLength = strlen(current->name) + 3;
-
-			char endText[12];
-			sprintf(endText, "</%s>", current->name);
-
-			buffer1 = (HtmlStreamString){(char*)malloc(256), 0, 0, 256};			// Bigger start buffer
+		HtmlLibEmitStartTag(sink, buffer1->buffer, buffer1->length - 1, atom, type);
 
-			// Read forever
-			while ((c = stream->getchar(stream->data)) != -1) {
-				HtmlLibPutcharToStreamString(c, &buffer1);
-
-				if (buffer1.length >= endLength && memcmp(buffer1.buffer + buffer1.length - endLength, endText, endLength) == 0) {
-					break;
-				}
-			}
-			buffer1.length -= endLength;
+		// Read Attributes
+		c = HtmlLibParseAttributes(sink, window, c, scratch);
+		HtmlLibEmitStartTagEnd(sink);
 
-			// Store text
-            buffer1.buffer[buffer1.length] = 0; // Null-terminate the string
-			current->innerText = buffer1.buffer;
-			
-			// Leave tag
-			current = current->parent;
+		// Special read text method for script / style
+		if (type == HTML_TYPE_SCRIPT) {
+			// Read untils end tag in any case, or the end of stream
+			buffer1->length = 0;
+			HtmlLibReadWindowUntil(window, endText, endLength, buffer1);
+
+			// Store text and leave tag
+			HtmlLibEmitText(sink, buffer1->buffer, buffer1->length);
+			HtmlLibEmitEndTag(sink, endText + 2, endLength - 3);
 		}
 		
 		continue;
 		
 		
-	InsertText:
-		// Get insert place
-		char** place;
-		if (current->lastChild) {
-			place = &current->lastChild->afterText;
-		}
-		else {
-			place = &current->innerText;
-		}
-		
-		// Setup buffer1 by place result
-		if (*place) {
-			buffer1.buffer = *place;
-			buffer1.length = strlen(buffer1.buffer);
-			buffer1.capacity = buffer1.length + 1;
-		}
-		else {
-			buffer1 = (HtmlStreamString){(char*)malloc(24), 0, 0, 24};
-		}
+	ReadText:
+		// Read spans untils structure detacted
+		while (true) {
+			if (window->p == window->end && HtmlLibFillStreamWindow(window) == false) {
+				c = EOF;
+				break;
+			}
 
-		// Set Standard Read
-		long standardRead = stream->tell(stream->data) - start;
-		stream->seek(stream->data, start, SEEK_SET);
+			const char* markup = HtmlLibScanChar(window->p, window->end, '<');
 
-		// Read untils structure detacted
-		while (true) {
-			c = stream->getchar(stream->data);
+			HtmlLibWriteStreamString((void*)window->p, markup - window->p, 1, text);
+			window->p = markup;
 
-			if ((standardRead--) <= 0 && (c == -1 || c == '<')) {
+			if (markup != window->end) {
+				c = HtmlLibGetcharFromWindow(window);
 				break;
 			}
-			HtmlLibPutcharToStreamString(c, &buffer1);
 		}
-		
-		// Store buffer1
-        buffer1.buffer[buffer1.length] = 0; // Null-terminate the string
-		*place = buffer1.buffer;
 
 		// Next loop but no GetChar
-		start = stream->tell(stream->data) - 1;
 		goto SkipLoopGetChar;
 	}
-
-	return doc;
 }
 
 
+HtmlCode HtmlLibParseStreamToSink(HtmlStream* stream, HtmlLibStreamSink* sink) {
+	HtmlStreamString scratch = (HtmlStreamString){(char*)malloc(256), 0, 0, 256};
+	HtmlStreamString text = (HtmlStreamString){(char*)malloc(256), 0, 0, 256};
+	if (scratch.buffer == NULL || text.buffer == NULL) {
+		free(scratch.buffer);
+		free(text.buffer);
+		HtmlHandleOutOfMemoryError(NULL, HTML_OUT_OF_MEMORY);
+	}
 
+	HtmlLibStreamWindow window;
+	HtmlLibInitStreamWindow(&window, stream);
 
-HtmlObject* HtmlReadObjectFromStream(HtmlStream* stream) {
-	HtmlHandleNullError(stream, NULL);
-    HtmlHandleError(HtmlIsStreamReadable(stream) == false, NULL, "stream is not readable.");
+	HtmlLibParseStream(sink, &window, &scratch, &text);
+	HtmlLibCloseStreamWindow(&window);
 
-    HtmlObject* doc = HtmlLibReadObjectFromStream(stream);
-    if (doc == NULL) {
-        fprintf(stderr, "Error: Failed to parse HTML stream.\n");
-    }
-    return doc;
+	free(scratch.buffer);
+	free(text.buffer);
+	return HTML_OK;
 }
 
-HtmlObject* HtmlReadObjectFromString(const char* str) {
-	HtmlHandleEmptyStringError(str, NULL);
 
-    HtmlStream stream = HtmlCreateStreamString((char*)str);
-    HtmlObject* doc = HtmlLibReadObjectFromStream(&stream);
-    if (doc == NULL) {
-        fprintf(stderr, "Error: Failed to parse HTML stream.\n");
-    }
-    return doc;
-}
+HtmlObject* HtmlLibReadObjectFromStream(HtmlStream* stream) {
+	HtmlObject* doc = HtmlCreateObjectDocument();
+	HtmlHandleOutOfMemoryError(doc, NULL);
 
-HtmlObject* HtmlReadObjectFromFileObject(FILE* file) {
-	HtmlHandleNullError(file, NULL);
+	HtmlLibStreamSink sink = {NULL, NULL, (HtmlDocument*)doc, doc, doc, {{{0}}, 0}};
 
-	HtmlStream stream = HtmlCreateStreamFileObject(file);
-	HtmlObject* doc = HtmlLibReadObjectFromStream(&stream);
-	if (doc == NULL) {
-		fprintf(stderr, "Error: Failed to parse HTML stream.\n");
+	if (HtmlLibParseStreamToSink(stream, &sink) != HTML_OK) {
+		HtmlDestroyObject(doc);
+		return NULL;
 	}
 	return doc;
 }
 
-HtmlObject* HtmlReadObjectFromFile(const char* filename) {
-	HtmlHandleEmptyStringError(filename, NULL);
 
-	FILE* file = fopen(filename, "r");
-	HtmlHandleError(file == NULL, NULL, "failed to open '%s' in read mode", filename);
 
-	HtmlStream stream = HtmlCreateStreamFileObject(file);
-	HtmlObject* doc = HtmlLibReadObjectFromStream(&stream);
-	fclose(file);
 
-    HtmlHandleError(doc == NULL, NULL, "failed to parse html file");
-	return doc;
-}
+// Buffer Parser //
+//
+// Parses a whole buffer in memory by pointers instead of stream callbacks.
+// It reads the same tokens as HtmlLibParseStream() char by char, so the tree is the same as
+// HtmlReadObjectFromString(), only the memory of strings differs.
+// On in-situ mode the strings of objects are terminated inside the buffer
+// and borrowed from it, so nothing is copied.
+// On partial mode (HtmlParser) more input follows, a construct reaching the end
+// is left unparsed and parsed again with more input.
 
+typedef struct HtmlLibBufferParser {
+	HtmlObject* doc;
+	HtmlObject* current;
 
+	char* end;				// end of input
+	bool endWritable;		// *end can be overwritten by a terminator
+	bool inSitu;			// borrow strings from input instead of copying
 
+	bool partial;			// more input follows `end`
+	bool truncated;			// a construct reached `end` on partial input
+	char* textScanned;		// no markup before it, where to resume searching
+	char* endScanned;		// no end of comment / script before it
 
+	char* stop;				// markup from it is left to others, NULL for `end`
+	bool speculative;		// a chunk of parallel parsing, see HtmlLibReadObjectParallel()
+} HtmlLibBufferParser;
 
 
+#define HtmlLibIsSpace(c) isspace((unsigned char)(c))
+#define HtmlLibIsAlpha(c) isalpha((unsigned char)(c))
 
 
-// libcurl extension
 
-#ifdef CURLINC_CURL_H
+// convert escapes of a quoted attribute value as HtmlLibParseFormatedString() does, `dst` can be `src` to convert in place
+// chars of an escape cut by the end of input are read as EOF
+size_t HtmlLibUnescapeString(char* dst, const char* src, size_t length) {
+	const char* end = src + length;
+	char* out = dst;
+	int c1, c2;
 
-HtmlObject* HtmlReadObjectFromCURL(CURL* curl, const char* url) {
-	HtmlHandleNullError(curl, NULL);
-	HtmlHandleEmptyStringError(url, NULL);
+	while (src < end) {
+		if (*src != '\\') {
+			*out++ = *src++;
+			continue;
+		}
+		src++;
 
-	// Set URL
-	HtmlStream stream = HtmlCreateStreamBuffer(1024);
-	HtmlHandleError(stream.data == NULL, NULL, "failed to create stream buffer!");
+		switch (src < end ? *src++ : EOF) {
+			case 'a':
+				*out++ = '\a';
+				break;
+			case 'r':
+				*out++ = '\r';
+				break;
+			case 'n':
+				*out++ = '\n';
+				break;
+			case 't':
+				*out++ = '\t';
+				break;
+			case 'x':
+				c1 = HtmlLibHexToInt(src < end ? *src++ : EOF);
+				c2 = HtmlLibHexToInt(src < end ? *src++ : EOF);
 
-	curl_easy_setopt(curl, CURLOPT_URL, url);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, stream.data);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, HtmlLibWriteStreamString);
+				*out++ = (c1 << 4) + c2;
+				break;
+			default:
+				*out++ = '\\';		// the escaped char is dropped
+		}
+	}
+	return out - dst;
+}
+
+// end of a quoted value from `p` after the quote, or `end`
+// escaped chars are skipped as HtmlLibParseFormatedString() reads them, "\\x" takes 2 chars more
+char* HtmlLibFindQuoteEnd(char* p, char* end, int quote) {
+	while (p < end && *p != quote) {
+		if (*p++ == '\\' && p < end && *p++ == 'x') {
+			p = end - p > 2 ? p + 2 : end;
+		}
+	}
+	return p;
+}
+
+
+// make a object string of [begin, begin + length)
+// in-situ mode terminates it inside the input and sets `borrowFlag` to `*flags`
+char* HtmlLibTakeString(HtmlLibBufferParser* parser, char* begin, size_t length, unsigned short* flags, unsigned short borrowFlag) {
+	char* str;
+
+	if (parser->inSitu && (begin + length < parser->end || parser->endWritable)) {
+		str = begin;
+		*flags |= borrowFlag;
+	}
+	else {
+		str = HtmlLibCopyString((HtmlDocument*)parser->doc, begin, length, flags, borrowFlag);
+		HtmlHandleOutOfMemoryError(str, NULL);
+	}
+	str[length] = 0;
+	return str;
+}
+
+char* HtmlLibTakeLoweredString(HtmlLibBufferParser* parser, char* begin, size_t length, unsigned short* flags, unsigned short borrowFlag) {
+	char* str = HtmlLibTakeString(parser, begin, length, flags, borrowFlag);
+
+	for (size_t i = 0; str && i < length; i++) {
+		str[i] = HtmlLibLowerChar(str[i]);
+	}
+	return str;
+}
+
+// lowered name of a tag or an attribute and its atom, a static atom gives its name and nothing is copied
+char* HtmlLibTakeName(HtmlLibBufferParser* parser, char* begin, size_t length, unsigned short* flags, unsigned short borrowFlag, unsigned short* atom) {
+	*atom = HtmlLibLookupAtomLowered(begin, length);
+
+	if (*atom != HTML_ATOM_DYNAMIC) {
+		*flags |= borrowFlag;
+		return (char*)HtmlLibAtomNames[*atom];
+	}
+
+	char* str = HtmlLibTakeLoweredString(parser, begin, length, flags, borrowFlag);
+	if (str && parser->doc) {
+		*atom = HtmlLibInternDynamicAtom(&((HtmlDocument*)parser->doc)->atoms, str, length);
+	}
+	return str;
+}
+
+
+
+// check the '<' at `p` is likely markup, used to guess where a parallel chunk begins
+bool HtmlLibIsMarkupStart(const char* p, const char* end) {
+	if (end - p < 2) {
+		return false;
+	}
+
+	switch (p[1]) {
+		case '/':
+			return end - p > 2 && HtmlLibIsAlpha(p[2]);
+		case '!':
+			if (end - p >= 4 && p[2] == '-' && p[3] == '-') {
+				return true;
+			}
+			return end - p >= 10 && strncasecmp(p + 2, "doctype ", 8) == 0;
+		default:
+			return HtmlLibIsAlpha(p[1]);
+	}
+}
+
+// find the '<' of a structure from `p`, or `end`, as HtmlLibParseStream() does
+// every '<' is a structure but "<!" not followed by "--" or "doctype ", the 8 bytes read after it are text
+// on partial input NULL if no structure is found, a "<!" needs 10 bytes to be decided
+char* HtmlLibFindMarkup(HtmlLibBufferParser* parser, char* p) {
+	char* end = parser->end;
+
+	if (parser->textScanned > p) {
+		p = parser->textScanned;
+	}
+
+	while ((p = (char*)HtmlLibScanChar(p, end, '<')) != end) {
+		size_t rest = end - p;
+
+		if (rest > 1 && p[1] != '!') {
+			return p;
+		}
+		if (rest > 3 && p[2] == '-' && p[3] == '-') {
+			return p;
+		}
+		if (rest >= 10 && strncasecmp(p + 2, "doctype ", 8) == 0) {
+			return p;
+		}
+
+		// undecided untils more input
+		if (rest < 10 && parser->partial) {
+			parser->textScanned = p;
+			return NULL;
+		}
+		if (rest == 1) {
+			return p;		// '<' at the end is a start tag without name
+		}
+		p += rest < 10 ? rest : 10;
+	}
+
+	if (parser->partial) {
+		parser->textScanned = end;
+		return NULL;
+	}
+	return end;
+}
+
+
+// stop at a construct reaching the end of partial input
+#define HtmlLibTruncateBuffer(parser, scanned, retValue) \
+	{ (parser)->truncated = true; (parser)->endScanned = (scanned); return retValue; }
+
+
+
+HtmlObject* HtmlLibCreateParsedObject(HtmlLibBufferParser* parser, HtmlObjectType type) {
+	HtmlObject* object = HtmlLibAllocObject((HtmlDocument*)parser->doc, type);
+	HtmlHandleOutOfMemoryError(object, NULL);
+
+	return HtmlLibAddObjectChild(parser->current, object);
+}
+
+
+void HtmlLibInsertBufferText(HtmlLibBufferParser* parser, char* text, size_t length) {
+	// spaces between structures are not text
+	if (HtmlLibScanSpaces(text, text + length) == text + length) {
+		return;
+	}
+
+	// Get insert place
+	HtmlObject* owner = parser->current->lastChild ? parser->current->lastChild : parser->current;
+	char** place = owner == parser->current ? &owner->innerText : &owner->afterText;
+	unsigned short borrowFlag = owner == parser->current ? HTML_BORROWED_INNER_TEXT : HTML_BORROWED_AFTER_TEXT;
+
+	if (*place == NULL) {
+		*place = HtmlLibTakeString(parser, text, length, &owner->flags, borrowFlag);
+		return;
+	}
+
+	// text split by an ignored end tag, join both parts
+	HtmlLibJoinObjectText((HtmlDocument*)parser->doc, owner, place, borrowFlag, text, length);
+}
+
+
+char* HtmlLibParseBufferComment(HtmlLibBufferParser* parser, char* p) {
+	char* end = parser->end;
+	char* text = p + 4;		// skip "<!--"
+
+	char* from = parser->endScanned - text > 2 ? parser->endScanned - 2 : text;
+
+	char* close = (char*)HtmlLibFindString(from, end, "-->", 3);
+	if (close == NULL && parser->partial) {
+		HtmlLibTruncateBuffer(parser, end, end);
+	}
+
+	// ERROR: comment without closing stops parsing
+	HtmlHandleError(close == NULL, end, "html not expected end! ('<!--')");
+
+	HtmlObject* comment = HtmlLibCreateParsedObject(parser, HTML_TYPE_COMMENT);
+	HtmlHandleOutOfMemoryError(comment, end);
+
+	comment->innerText = HtmlLibTakeLoweredString(parser, text, close - text, &comment->flags, HTML_BORROWED_INNER_TEXT);
+	return close + 3;
+}
+
+
+char* HtmlLibParseBufferDoctype(HtmlLibBufferParser* parser, char* p) {
+	char* end = parser->end;
+	char* text = p + 10;	// skip "<!doctype "
+
+	char* close = (char*)memchr(text, '>', end - text);
+	if (close == NULL && parser->partial) {
+		HtmlLibTruncateBuffer(parser, end, end);
+	}
+
+	char* next = close ? close + 1 : end;
+	if (close == NULL) {
+		close = end;
+	}
+
+	HtmlObject* doctype = HtmlLibCreateParsedObject(parser, HTML_TYPE_DOCTYPE);
+	HtmlHandleOutOfMemoryError(doctype, end);
+
+	doctype->innerText = HtmlLibTakeLoweredString(parser, text, close - text, &doctype->flags, HTML_BORROWED_INNER_TEXT);
+	return next;
+}
+
+
+// flags of placeholders guessed inside elements of the chunk,
+// checked when stitching as the end tag may close an element before the chunk or nothing
+#define HTML_PLACEHOLDER_CLOSING 0x4000		// closes an element before the chunk
+#define HTML_PLACEHOLDER_IGNORED 0x8000		// closes nothing
+
+
+// elements from `object` to `doc` have end tags can be omitted (<li>, <p>, <td>...)
+bool HtmlLibIsOptionalEndChain(HtmlObject* doc, HtmlObject* object) {
+	for (; object != doc; object = object->parent) {
+		switch (object->atom) {
+			case HTML_ATOM_LI: case HTML_ATOM_DT: case HTML_ATOM_DD: case HTML_ATOM_P:
+			case HTML_ATOM_RT: case HTML_ATOM_RP: case HTML_ATOM_OPTGROUP: case HTML_ATOM_OPTION:
+			case HTML_ATOM_COLGROUP: case HTML_ATOM_CAPTION: case HTML_ATOM_THEAD: case HTML_ATOM_TBODY:
+			case HTML_ATOM_TFOOT: case HTML_ATOM_TR: case HTML_ATOM_TD: case HTML_ATOM_TH:
+				continue;
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+
+// end tag closing nothing in a chunk, kept as an object of HTML_TYPE_NONE at the top of chunk
+// at the top it closes an element before the chunk if any,
+// inside elements it is guessed to close them if their end tags can be omitted, otherwise to be ignored
+HtmlObject* HtmlLibAddEndTagPlaceholder(HtmlLibBufferParser* parser, char* name, size_t length) {
+	HtmlObject* placeholder = HtmlLibAllocObject((HtmlDocument*)parser->doc, HTML_TYPE_NONE);
+	HtmlHandleOutOfMemoryError(placeholder, NULL);
+	HtmlLibAddObjectChild(parser->doc, placeholder);
+
+	if (parser->current != parser->doc && HtmlLibIsOptionalEndChain(parser->doc, parser->current)) {
+		placeholder->flags |= HTML_PLACEHOLDER_CLOSING;
+		parser->current = parser->doc;
+	}
+	else if (parser->current != parser->doc) {
+		placeholder->flags |= HTML_PLACEHOLDER_IGNORED;
+		HtmlLogWarning("Tag '%s' without closing! ('%.*s')", HtmlGetObjectName(parser->current), (int)length, name);
+	}
+
+	placeholder->name = HtmlLibTakeLoweredString(parser, name, length, &placeholder->flags, HTML_BORROWED_NAME);
+	HtmlHandleOutOfMemoryError(placeholder->name, NULL);
+
+	// names not known are compared as strings, ids of the chunk mean nothing outside
+	placeholder->atom = HtmlLibLookupAtom(placeholder->name, length);
+	return placeholder;
+}
+
+char* HtmlLibParseBufferEndTag(HtmlLibBufferParser* parser, char* p) {
+	char* end = parser->end;
+	char* name = p + 2;		// skip "</"
+
+	for (p = name; p < end && HtmlLibIsNameChar((unsigned char)*p); p++);
+	size_t length = p - name;
+
+	// ERROR: Not expected buffer end, the char after name is read in any case
+	if (p == end && parser->partial) {
+		HtmlLibTruncateBuffer(parser, end, end);
+	}
+	HtmlHandleError(p == end, end, "HTML not expected end! ('</%.*s')", (int)length, name);
+	char* close = p;
+
+	// Find return element
+	HtmlObject* backTag = parser->current;
+	unsigned short atom = HtmlLibFindAtom((HtmlDocument*)parser->doc, name, length);
+
+	while (backTag != parser->doc && !HtmlLibIsClosingTag(backTag, atom, name, length)) {
+		backTag = backTag->parent;
+	}
+
+	// warning: Not exists element name
+	if (backTag == parser->doc) {
+		// the element may be opened before the chunk, kept for stitching
+		if (parser->speculative) {
+			return HtmlLibAddEndTagPlaceholder(parser, name, length) ? close + 1 : end;
+		}
+		HtmlLogWarning("Tag '%s' without closing! ('%.*s')", HtmlGetObjectName(parser->current), (int)length, name);
+		return close + 1;
+	}
+
+	// Return
+	parser->current = backTag->parent;
+	return close + 1;
+}
+
+
+// next char of input as HtmlLibGetcharFromWindow(), `p` must be before `end`
+#define HtmlLibGetcharFromBuffer(p, end) (++(p) < (end) ? (unsigned char)*(p) : EOF)
+
+// read attributes as HtmlLibParseAttributes() does, `c` is the char at `p` before a terminator overwrote it
+// return where the last char read is, it is consumed by the tag, or `end`
+char* HtmlLibReadBufferAttributes(HtmlLibBufferParser* parser, HtmlObject* object, HtmlLibPendingAttributes* pending, char* p, int c) {
+	char* end = parser->end;
+	HtmlAttribute* attr;
+
+	while (isspace(c)) {
+		// Clear Spaces
+		while (isspace(c)) {
+			c = HtmlLibGetcharFromBuffer(p, end);
+		}
+		if (c == '/') {
+			c = HtmlLibGetcharFromBuffer(p, end);
+
+			if (c == '>') {
+				return p;
+			}
+		}
+
+		// Read name, value is read after it
+		char* name = p;
+		while (HtmlLibIsNameChar(c)) {
+			c = HtmlLibGetcharFromBuffer(p, end);
+		}
+
+		attr = HtmlLibAddPendingAttribute((HtmlDocument*)parser->doc, object, pending);
+		HtmlHandleOutOfMemoryError(attr, end);
+
+		attr->name = HtmlLibTakeName(parser, name, p - name, &attr->flags, HTML_BORROWED_ATTR_NAME, &attr->atom);
+		HtmlHandleOutOfMemoryError(attr->name, end);
+
+		// Set value (bool)
+		if (c != '=') {
+			continue;
+		}
+
+		// Next level
+		c = HtmlLibGetcharFromBuffer(p, end);
+
+		// Set value (formated string)
+		if (c == '\'' || c == '\"') {
+			char* value = p + 1;
+			p = HtmlLibFindQuoteEnd(value, end, c);
+
+			// ERROR: Not expected buffer end, the value is what is read
+			if (p == end && parser->partial == false) {
+				HtmlLogWarning("HTML not expected end! ('%.*s')", (int)(p - name), name);
+			}
+
+			bool escaped = memchr(value, '\\', p - value) != NULL;
+
+			attr->value = HtmlLibTakeString(parser, value, p - value, &attr->flags, HTML_BORROWED_ATTR_VALUE);
+			if (attr->value && escaped) {
+				attr->value[HtmlLibUnescapeString(attr->value, attr->value, p - value)] = 0;
+			}
+
+			c = p < end ? HtmlLibGetcharFromBuffer(p, end) : EOF;
+		}
+		// Set value (string)
+		else {
+			char* value = p;
+			while (isalnum(c) || c == '_' || c == '-') {
+				c = HtmlLibGetcharFromBuffer(p, end);
+			}
+			attr->value = HtmlLibTakeLoweredString(parser, value, p - value, &attr->flags, HTML_BORROWED_ATTR_VALUE);
+		}
+	}
+	return p;
+}
+
+char* HtmlLibParseBufferAttributes(HtmlLibBufferParser* parser, HtmlObject* object, char* p, int c) {
+	HtmlLibPendingAttributes pending;
+	pending.count = 0;
+
+	p = HtmlLibReadBufferAttributes(parser, object, &pending, p, c);
+	HtmlLibFlushPendingAttributes((HtmlDocument*)parser->doc, object, &pending);
+	return p;
+}
+
+
+// read script / style content untils "</tagName>" in any case or the end, as HtmlLibReadWindowUntil() does
+char* HtmlLibParseBufferRawText(HtmlLibBufferParser* parser, HtmlObject* object, char* p) {
+	char* end = parser->end;
+
+	// "</tagName>", it will never take more than 10 bytes
+	char endText[12];
+	size_t endLength = strlen(object->name) + 3;
+	sprintf(endText, "</%s>", object->name);
+
+	// resume after the part searched on partial input
+	char* from = parser->endScanned - p > (long)(endLength - 1) ? parser->endScanned - (endLength - 1) : p;
+
+	char* close = (char*)HtmlLibFindStringIgnoreCase(from, end, endText, endLength);
+	if (close == NULL && parser->partial) {
+		HtmlLibTruncateBuffer(parser, end, end);
+	}
+
+	// script without closing takes the rest
+	char* next = close ? close + endLength : end;
+	if (close == NULL) {
+		close = end;
+	}
+
+	object->innerText = HtmlLibTakeString(parser, p, close - p, &object->flags, HTML_BORROWED_INNER_TEXT);
+	return next;
+}
+
+
+char* HtmlLibParseBufferTag(HtmlLibBufferParser* parser, char* p) {
+	char* end = parser->end;
+	char* name = p + 1;		// skip '<'
+
+	for (p = name; p < end && HtmlLibIsNameChar((unsigned char)*p); p++);
+	int c = p < end ? (unsigned char)*p : EOF;
+
+	// Create tag
+	HtmlObject* tag = HtmlLibCreateParsedObject(parser, HTML_TYPE_TAG);
+	HtmlHandleOutOfMemoryError(tag, end);
+
+	tag->name = HtmlLibTakeName(parser, name, p - name, &tag->flags, HTML_BORROWED_NAME, &tag->atom);
+	HtmlHandleOutOfMemoryError(tag->name, end);
+	tag->type = HtmlLibGetAtomObjectType(tag->atom);
+
+	// Read Attributes, the char after them is consumed ('>' mostly)
+	p = HtmlLibParseBufferAttributes(parser, tag, p, c);
+
+	if (p == end && parser->partial) {
+		parser->truncated = true;
+		parser->endScanned = name;		// nothing searched for the content yet
+	}
+	p = p < end ? p + 1 : end;
+
+	if (parser->truncated == false) {
+		if (tag->attributeCount) {
+			HtmlLibSetObjectClassList((HtmlDocument*)parser->doc, tag);
+		}
+		HtmlLibSpreadObjectBloom(tag);
+	}
+
+	// Special read text method for script / style, the end tag closes it
+	if (tag->type == HTML_TYPE_SCRIPT && parser->truncated == false) {
+		p = HtmlLibParseBufferRawText(parser, tag, p);
+	}
+
+	// tag not completed yet is parsed again, the memory is left to document
+	if (parser->truncated) {
+		HtmlLibClearObjectRelationship(tag);
+		return end;
+	}
+
+	// Enter tag, single tag stays outside
+	if (tag->type == HTML_TYPE_TAG) {
+		parser->current = tag;
+	}
+	return p;
+}
+
+
+// parse [p, end), return where parsing stopped on partial input or at `stop`
+char* HtmlLibParseBuffer(HtmlLibBufferParser* parser, char* p) {
+	char* end = parser->end;
+	char* stop = parser->stop ? parser->stop : end;
+
+	while (p < stop) {
+		// text untils a structure, the '<' can be overwritten as it is never read again
+		char* markup = HtmlLibFindMarkup(parser, p);
+		if (markup == NULL) {
+			return p;		// text may continue
+		}
+		HtmlLibInsertBufferText(parser, p, markup - p);
+
+		if (markup >= stop) {
+			return markup;
+		}
+
+		// "<!" is a comment or doctype here, '<' at the end is a start tag
+		if (end - markup > 1 && markup[1] == '!') {
+			p = markup[2] == '-' ? HtmlLibParseBufferComment(parser, markup) : HtmlLibParseBufferDoctype(parser, markup);
+		}
+		else if (end - markup > 1 && markup[1] == '/') {
+			p = HtmlLibParseBufferEndTag(parser, markup);
+		}
+		else {
+			p = HtmlLibParseBufferTag(parser, markup);
+		}
+
+		if (parser->truncated) {
+			parser->truncated = false;
+			return markup;
+		}
+	}
+	return p;
+}
+
+
+HtmlObject* HtmlLibReadObjectInSitu(char* buffer, size_t length, bool endWritable) {
+	HtmlObject* doc = HtmlCreateObjectDocument();
+	if (doc == NULL) {
+		free(buffer);
+		HtmlHandleOutOfMemoryError(doc, NULL);
+	}
+
+	// document owns the buffer as objects borrow strings from it
+	((HtmlDocument*)doc)->source = buffer;
+
+	HtmlLibBufferParser parser = {doc, doc, buffer + length, endWritable, true, false, false, buffer, buffer, NULL, false};
+	HtmlLibParseBuffer(&parser, buffer);
+	return doc;
+}
+
+// parse a read only buffer, strings are copied to the document
+HtmlObject* HtmlLibReadObjectFromBuffer(const char* buffer, size_t length) {
+	HtmlObject* doc = HtmlCreateObjectDocument();
+	HtmlHandleOutOfMemoryError(doc, NULL);
+
+	char* begin = (char*)buffer;	// never written as not in-situ
+
+	HtmlLibBufferParser parser = {doc, doc, begin + length, false, false, false, false, begin, begin, NULL, false};
+	HtmlLibParseBuffer(&parser, begin);
+	return doc;
+}
+
+
+
+
+// Parallel Parser //
+//
+// A big buffer is split at markup and the chunks are parsed by threads into own documents.
+// The beginning of a chunk is a guess that the sequential parser reaches it as markup,
+// not inside of a script, comment or attribute value.
+// Chunks are stitched in order, a chunk is taken only when parsing before it stops exactly at
+// its beginning and its end tags close elements open there, otherwise the chunk is parsed again
+// on the main thread, so the tree is always the same as HtmlLibReadObjectFromBuffer().
+
+#ifdef HTML_USE_THREADS
+
+// smaller chunks are not worth a thread
+// measured on one core (2.6 MB page, about 100 MB/s): a chunk costs about 50 us for its thread, document
+// and stitching, 256 KB takes about 2.5 ms to parse, the speedup on several cores is not measured
+#ifndef HTML_PARALLEL_MIN_CHUNK
+#define HTML_PARALLEL_MIN_CHUNK (1 << 18)
+#endif
+
+
+typedef struct HtmlLibParallelChunk {
+	char* begin;			// moved after the script / comment the chunk is guessed to begin in
+	char* stop;				// beginning of next chunk, NULL for the last
+	char* end;
+	char* next;				// where parsing stopped
+
+	HtmlObject* doc;		// own document, NULL if not parsed
+	HtmlObject* current;
+
+	pthread_t thread;
+	bool started;
+} HtmlLibParallelChunk;
+
+
+// after the first end tag of script / style if no start tag of them is before it, or NULL
+char* HtmlLibFindChunkRawTextEnd(char* begin, char* stop) {
+	char name[8];
+
+	for (char* p = begin; (p = (char*)HtmlLibScanChar(p, stop, '<')) != stop; p++) {
+		char* start = p + 1 < stop && p[1] == '/' ? p + 2 : p + 1;
+		size_t length = 0;
+
+		while (start + length < stop && length < sizeof(name) && HtmlLibIsAlpha(start[length])) {
+			name[length] = HtmlLibLowerChar(start[length]);
+			length++;
+		}
+		if (length == sizeof(name) || (start + length < stop && HtmlLibIsNameChar((unsigned char)start[length]))
+				|| HtmlLibGetAtomObjectType(HtmlLibLookupAtom(name, length)) != HTML_TYPE_SCRIPT) {
+			continue;
+		}
+
+		// start tag first, not inside
+		if (start == p + 1) {
+			return NULL;
+		}
+		char* close = (char*)memchr(start + length, '>', stop - (start + length));
+		return close ? close + 1 : NULL;
+	}
+	return NULL;
+}
+
+// a chunk beginning inside of a script, style or comment is guessed by its end before any start,
+// return after the end where the sequential parser continues, or `begin`
+char* HtmlLibSkipChunkRawText(char* begin, char* stop) {
+	char* rawTextEnd = HtmlLibFindChunkRawTextEnd(begin, stop);
+	char* commentEnd = (char*)HtmlLibFindString(begin, stop, "-->", 3);
+
+	if (commentEnd && (rawTextEnd == NULL || commentEnd < rawTextEnd) && HtmlLibFindString(begin, commentEnd, "<!--", 4) == NULL) {
+		return commentEnd + 3;
+	}
+	return rawTextEnd ? rawTextEnd : begin;
+}
+
+
+void* HtmlLibParseParallelChunk(void* data) {
+	HtmlLibParallelChunk* chunk = (HtmlLibParallelChunk*)data;
+	chunk->begin = HtmlLibSkipChunkRawText(chunk->begin, chunk->stop ? chunk->stop : chunk->end);
+
+	HtmlLibBufferParser parser = {chunk->doc, chunk->doc, chunk->end, false, false, false, false, chunk->begin, chunk->begin, chunk->stop, true};
+	chunk->next = HtmlLibParseBuffer(&parser, chunk->begin);
+	chunk->current = parser.current;
+	return NULL;
+}
+
+
+// first markup after '>' or a space from `p` (not the beginning) to begin a chunk, or NULL
+// such markup is less likely in a script or an attribute value
+char* HtmlLibFindChunkBegin(char* p, char* end) {
+	while ((p = (char*)HtmlLibScanChar(p, end, '<')) != end) {
+		if ((p[-1] == '>' || HtmlLibIsSpace(p[-1])) && HtmlLibIsMarkupStart(p, end)) {
+			return p;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+
+// element closed by the end tag of `placeholder` from `current`, or NULL
+// atoms are compared by names as dynamic ids differ between documents
+HtmlObject* HtmlLibFindPlaceholderElement(HtmlObject* placeholder, HtmlObject* doc, HtmlObject* current) {
+	while (current != doc && !HtmlLibIsSameAtom(placeholder->atom, placeholder->name, current->atom, current->name)) {
+		current = current->parent;
+	}
+	return current == doc ? NULL : current;
+}
+
+// placeholders close elements from `current` as guessed by the chunk
+bool HtmlLibIsChunkStitchable(HtmlLibParallelChunk* chunk, HtmlObject* doc, HtmlObject* current) {
+	for (HtmlObject* item = chunk->doc->firstChild; item; item = item->next) {
+		if (item->type != HTML_TYPE_NONE) {
+			continue;
+		}
+
+		HtmlObject* element = HtmlLibFindPlaceholderElement(item, doc, current);
+		if (item->flags & (element ? HTML_PLACEHOLDER_IGNORED : HTML_PLACEHOLDER_CLOSING)) {
+			return false;
+		}
+		if (element) {
+			current = element->parent;
+		}
+	}
+	return true;
+}
+
+
+// give dynamic atoms of the document to objects and attributes from a chunk
+void HtmlLibReinternChunkAtoms(HtmlDocument* document, HtmlObject* root) {
+	HtmlObject* object = root->firstChild;
+
+	while (object) {
+		if (object->atom > HTML_ATOM_DYNAMIC) {
+			object->atom = HtmlLibInternAtom(document, object->name, strlen(object->name));
+		}
+		for (HtmlAttribute* attr = object->attributes; attr < object->attributes + object->attributeCount; attr++) {
+			if (attr->atom > HTML_ATOM_DYNAMIC) {
+				attr->atom = HtmlLibInternAtom(document, attr->name, strlen(attr->name));
+			}
+		}
+
+		// next in pre-order
+		if (object->firstChild) {
+			object = object->firstChild;
+			continue;
+		}
+		while (object != root && object->next == NULL) {
+			object = object->parent;
+		}
+		object = object == root ? NULL : object->next;
+	}
+}
+
+
+// text of chunk top goes where the sequential parser would insert it, it is in document memory
+void HtmlLibStitchText(HtmlDocument* document, HtmlObject* current, char* text) {
+	if (text == NULL) {
+		return;
+	}
+
+	HtmlObject* owner = current->lastChild ? current->lastChild : current;
+	char** place = owner == current ? &owner->innerText : &owner->afterText;
+	unsigned short borrowFlag = owner == current ? HTML_BORROWED_INNER_TEXT : HTML_BORROWED_AFTER_TEXT;
+
+	if (*place == NULL) {
+		*place = text;
+		owner->flags |= borrowFlag;
+		return;
+	}
+	HtmlLibJoinObjectText(document, owner, place, borrowFlag, text, strlen(text));
+}
+
+
+// move the tree and memory of a chunk into the document, return new current
+HtmlObject* HtmlLibStitchChunk(HtmlLibParallelChunk* chunk, HtmlDocument* document, HtmlObject* current) {
+	HtmlDocument* chunkDocument = (HtmlDocument*)chunk->doc;
+	HtmlObject* root = chunk->doc;
+	HtmlObject* next;
+
+	HtmlLibMergeArena(&document->arena, &chunkDocument->arena);
+	if (chunkDocument->atoms.count) {
+		HtmlLibReinternChunkAtoms(document, root);
+	}
+	document->mixed |= chunkDocument->mixed;
+
+	HtmlLibStitchText(document, current, root->innerText);
+
+	for (HtmlObject* item = root->firstChild; item; item = next) {
+		next = item->next;
+
+		if (item->type != HTML_TYPE_NONE) {
+			HtmlLibAddObjectChild(current, item);
+			HtmlLibSpreadObjectBloom(item);
+			continue;
+		}
+
+		// close elements as checked by HtmlLibIsChunkStitchable()
+		HtmlObject* element = HtmlLibFindPlaceholderElement(item, (HtmlObject*)document, current);
+		if (element) {
+			current = element->parent;
+		}
+		else if ((item->flags & (HTML_PLACEHOLDER_CLOSING | HTML_PLACEHOLDER_IGNORED)) == 0) {
+			HtmlLogWarning("Tag '%s' without closing! ('%s')", HtmlGetObjectName(current), item->name);
+		}
+		HtmlLibStitchText(document, current, item->afterText);
+	}
+
+	if (chunk->current != root) {
+		current = chunk->current;
+	}
+
+	// only the document itself is left
+	root->firstChild = root->lastChild = NULL;
+	root->innerText = NULL;
+	HtmlLibDestroyObject(root);
+	chunk->doc = NULL;
+	return current;
+}
+
+
+int HtmlLibCountProcessors() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+}
+
+
+// parse a read only buffer by `threads` (0 for all processors), strings are copied to the document
+HtmlObject* HtmlLibReadObjectParallel(const char* buffer, size_t length, int threads) {
+	size_t count = threads > 0 ? (size_t)threads : (size_t)HtmlLibCountProcessors();
+	count = MIN(count, length / HTML_PARALLEL_MIN_CHUNK);
+	if (count <= 1) {
+		return HtmlLibReadObjectFromBuffer(buffer, length);
+	}
+
+	HtmlObject* doc = HtmlCreateObjectDocument();
+	HtmlHandleOutOfMemoryError(doc, NULL);
+
+	HtmlLibParallelChunk* chunks = (HtmlLibParallelChunk*)calloc(count, sizeof(HtmlLibParallelChunk));
+	if (chunks == NULL) {
+		HtmlDestroyObject(doc);
+		HtmlHandleOutOfMemoryError(chunks, NULL);
+	}
+
+	// split at markup near equal sizes
+	char* begin = (char*)buffer;	// never written as not in-situ
+	char* end = begin + length;
+	size_t n = 1;
+
+	chunks[0].begin = begin;
+	for (size_t i = 1; i < count; i++) {
+		char* target = MAX(begin + length / count * i, chunks[n - 1].begin + 1);
+		char* p = HtmlLibFindChunkBegin(target, end);
+		if (p == NULL) {
+			break;
+		}
+		chunks[n++].begin = p;
+	}
+	for (size_t i = 0; i < n; i++) {
+		chunks[i].stop = i + 1 < n ? chunks[i + 1].begin : NULL;
+		chunks[i].end = end;
+	}
+
+	// chunks after the first are parsed by threads
+	for (size_t i = 1; i < n; i++) {
+		chunks[i].doc = HtmlCreateObjectDocument();
+		if (chunks[i].doc) {
+			chunks[i].started = pthread_create(&chunks[i].thread, NULL, HtmlLibParseParallelChunk, &chunks[i]) == 0;
+		}
+	}
+
+	// the first chunk is parsed into the document meanwhile
+	HtmlLibBufferParser parser = {doc, doc, end, false, false, false, false, begin, begin, chunks[0].stop, false};
+	char* p = HtmlLibParseBuffer(&parser, begin);
+
+	for (size_t i = 1; i < n; i++) {
+		HtmlLibParallelChunk* chunk = &chunks[i];
+
+		if (chunk->started) {
+			pthread_join(chunk->thread, NULL);
+		}
+		else if (chunk->doc) {
+			HtmlLibParseParallelChunk(chunk);
+		}
+
+		if (chunk->doc && p == chunk->begin && HtmlLibIsChunkStitchable(chunk, doc, parser.current)) {
+			parser.current = HtmlLibStitchChunk(chunk, (HtmlDocument*)doc, parser.current);
+			p = chunk->next;
+			continue;
+		}
+
+		// wrong guess, parse again from where parsing stopped
+		HtmlDestroyObject(chunk->doc);
+		parser.stop = chunk->stop;
+		p = HtmlLibParseBuffer(&parser, p);
+	}
+
+	free(chunks);
+	return doc;
+}
+
+#else
+
+#define HtmlLibReadObjectParallel(buffer, length, threads) HtmlLibReadObjectFromBuffer(buffer, length)
+
+#endif
+
+
+// read the rest of file to a malloc'd buffer, one byte after `*length` is left for a terminator
+char* HtmlLibReadFileToBuffer(FILE* file, size_t* length) {
+	size_t capacity = 65536;
+	char* buffer = (char*)malloc(capacity);
+	HtmlHandleOutOfMemoryError(buffer, NULL);
+
+	*length = 0;
+	while (true) {
+		*length += fread(buffer + *length, 1, capacity - *length - 1, file);
+		if (*length < capacity - 1) {
+			return buffer;
+		}
+
+		char* newBuffer = (char*)realloc(buffer, capacity * 2);
+		if (newBuffer == NULL) {
+			free(buffer);
+			HtmlHandleOutOfMemoryError(newBuffer, NULL);
+		}
+		buffer = newBuffer;
+		capacity *= 2;
+	}
+}
+
+
+// a regular file is mapped and parsed without reading it to user memory,
+// others (pipes, devices) are read whole and parsed in-situ
+// more than one of `threads` (0 for all processors) parses it by HtmlLibReadObjectParallel()
+// the tree is the same as HtmlReadObjectFromFileObject() reads by the stream
+HtmlObject* HtmlLibReadObjectFromFile(FILE* file, int threads) {
+#ifdef HTML_USE_MMAP
+	struct stat info;
+	int fd = fileno(file);
+
+	if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+		size_t length = info.st_size;
+		void* map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (map != MAP_FAILED) {
+			madvise(map, length, MADV_SEQUENTIAL);
+
+			HtmlObject* doc = HtmlLibReadObjectParallel((const char*)map, length, threads);
+			munmap(map, length);
+			return doc;
+		}
+	}
+#endif
+
+	size_t length;
+	char* buffer = HtmlLibReadFileToBuffer(file, &length);
+	HtmlHandleError(buffer == NULL, NULL, "failed to read file");
+
+	if (threads == 1) {
+		return HtmlLibReadObjectInSitu(buffer, length, true);
+	}
+
+	HtmlObject* doc = HtmlLibReadObjectParallel(buffer, length, threads);
+	free(buffer);
+	return doc;
+}
+
+
+
+
+// HtmlParser //
+//
+// push parser, the tree is built while chunks are fed
+// bytes of a construct not completed yet are kept untils the next feed
+
+typedef struct HtmlParser {
+	HtmlLibBufferParser parser;
+
+	HtmlStreamString input;		// bytes not parsed yet start at `input.position`
+	size_t textScanned;			// scan progress relative to `input.position`
+	size_t endScanned;
+} HtmlParser;
+
+
+void HtmlLibRunParser(HtmlParser* parser, bool partial) {
+	HtmlStreamString* input = &parser->input;
+	char* begin = input->buffer + input->position;
+
+	parser->parser.end = input->buffer + input->length;
+	parser->parser.partial = partial;
+	parser->parser.textScanned = begin + parser->textScanned;
+	parser->parser.endScanned = begin + parser->endScanned;
+
+	char* stop = HtmlLibParseBuffer(&parser->parser, begin);
+
+	// keep the progress for the bytes left
+	parser->textScanned = parser->parser.textScanned > stop ? parser->parser.textScanned - stop : 0;
+	parser->endScanned = parser->parser.endScanned > stop ? parser->parser.endScanned - stop : 0;
+	input->position = stop - input->buffer;
+}
+
+
+/* プッシュパーサーを作成する
+
+HtmlParserFeed() で受け取ったデータを順に解析し、HtmlParserFinish() でドキュメントを取り出す
+タグ、属性や </script> の途中で分割されたデータでも良い
+
+@return パーサー、HtmlParserFinish() か HtmlParserDestroy() で解放する
+*/
+HtmlParser* HtmlParserCreate() {
+	HtmlParser* parser = (HtmlParser*)calloc(1, sizeof(HtmlParser));
+	HtmlHandleOutOfMemoryError(parser, NULL);
+
+	HtmlObject* doc = HtmlCreateObjectDocument();
+	if (doc == NULL) {
+		free(parser);
+		HtmlHandleOutOfMemoryError(doc, NULL);
+	}
+
+	parser->parser.doc = parser->parser.current = doc;
+	parser->input = (HtmlStreamString){(char*)malloc(4096), 0, 0, 4096};
+	if (parser->input.buffer == NULL) {
+		HtmlDestroyObject(doc);
+		free(parser);
+		HtmlHandleOutOfMemoryError(NULL, NULL);
+	}
+	return parser;
+}
+
+
+/* データを解析する
+
+@param parser パーサー
+@param data データ
+@param length データの長さ
+*/
+HtmlCode HtmlParserFeed(HtmlParser* parser, const char* data, size_t length) {
+	HtmlHandleNullError(parser, HTML_NULL_POINTER);
+	if (length == 0) {
+		return HTML_OK;
+	}
+	HtmlHandleNullError(data, HTML_NULL_POINTER);
+
+	HtmlStreamString* input = &parser->input;
+
+	// drop the parsed part when it takes the half
+	if (input->position > 0 && input->position >= input->length / 2) {
+		memmove(input->buffer, input->buffer + input->position, input->length - input->position);
+		input->length -= input->position;
+		input->position = 0;
+	}
+
+	if (HtmlLibWriteStreamString((void*)data, length, 1, input) != length) {
+		return HTML_OUT_OF_MEMORY;
+	}
+
+	HtmlLibRunParser(parser, true);
+	return HTML_OK;
+}
+
+
+// ドキュメントを取得する (解析途中のものも)
+#define HtmlParserGetDocument(parser) ((parser) ? (parser)->parser.doc : NULL)
+
+
+// パーサーとドキュメントを解放する
+void HtmlParserDestroy(HtmlParser* parser) {
+	if (parser == NULL) {
+		return;
+	}
+
+	HtmlDestroyObject(parser->parser.doc);
+	free(parser->input.buffer);
+	free(parser);
+}
+
+
+/* 残りのデータを解析し、パーサーを解放する
+
+@param parser パーサー
+@return ドキュメントオブジェクト
+*/
+HtmlObject* HtmlParserFinish(HtmlParser* parser) {
+	HtmlHandleNullError(parser, NULL);
+
+	HtmlLibRunParser(parser, false);
+
+	HtmlObject* doc = parser->parser.doc;
+	free(parser->input.buffer);
+	free(parser);
+	return doc;
+}
+
+
+
+
+HtmlObject* HtmlReadObjectFromStream(HtmlStream* stream) {
+	HtmlHandleNullError(stream, NULL);
+    HtmlHandleError(HtmlIsStreamReadable(stream) == false, NULL, "stream is not readable.");
+
+    HtmlObject* doc = HtmlLibReadObjectFromStream(stream);
+    if (doc == NULL) {
+        fprintf(stderr, "Error: Failed to parse HTML stream.\n");
+    }
+    return doc;
+}
+
+HtmlObject* HtmlReadObjectFromString(const char* str) {
+	HtmlHandleEmptyStringError(str, NULL);
+
+    HtmlStream stream = HtmlCreateStreamString((char*)str);
+    HtmlObject* doc = HtmlLibReadObjectFromStream(&stream);
+    free(stream.data);      // string is not owned by the stream, only its state
+    if (doc == NULL) {
+        fprintf(stderr, "Error: Failed to parse HTML stream.\n");
+    }
+    return doc;
+}
+
+/* 文字列をその場で解析する (in-situ)
+
+str の所有権はドキュメントに移り、HtmlDestroyObject() で free() される
+タグ名、テキストや属性の文字列はコピーされず、書き換えられた str の中を直接指す
+
+@param str malloc() で確保した書き換え可能な文字列
+@return ドキュメントオブジェクト
+*/
+HtmlObject* HtmlReadObjectFromStringInSitu(char* str) {
+	HtmlHandleNullError(str, NULL);
+
+	return HtmlLibReadObjectInSitu(str, strlen(str), true);
+}
+
+/* バッファをその場で解析する (in-situ)
+
+HtmlReadObjectFromStringInSitu() と同じだが、NUL 終端は不要
+buffer の最後に届く文字列だけはコピーされる
+
+@param buffer malloc() で確保した書き換え可能なバッファ
+@param length バッファの長さ
+@return ドキュメントオブジェクト
+*/
+HtmlObject* HtmlReadObjectFromBufferInSitu(char* buffer, size_t length) {
+	HtmlHandleNullError(buffer, NULL);
+
+	return HtmlLibReadObjectInSitu(buffer, length, false);
+}
+
+/* ツリーを作らずにストリームを解析する (SAX)
+
+読み取ったトークンごとに handlers のコールバックを呼ぶ、NULL のコールバックは呼ばれない
+渡される文字列は NUL 終端されず、コールバックの中でのみ有効
+トークンごとのメモリ確保はない
+
+@param stream 読み取り可能なストリーム
+@param handlers イベントハンドラー
+@param userdata コールバックに渡されるポインタ
+@return HTML_OK または エラーコード
+*/
+HtmlCode HtmlParseEvents(HtmlStream* stream, const HtmlEventHandlers* handlers, void* userdata) {
+	HtmlHandleNullError(stream, HTML_NULL_POINTER);
+	HtmlHandleNullError(handlers, HTML_NULL_POINTER);
+	HtmlHandleError(HtmlIsStreamReadable(stream) == false, HTML_STREAM_NOT_READABLE, "stream is not readable.");
+
+	HtmlLibStreamSink sink = {handlers, userdata, NULL, NULL, NULL, {{{0}}, 0}};
+	return HtmlLibParseStreamToSink(stream, &sink);
+}
+
+HtmlObject* HtmlReadObjectFromFileObject(FILE* file) {
+	HtmlHandleNullError(file, NULL);
+
+	HtmlStream stream = HtmlCreateStreamFileObject(file);
+	HtmlObject* doc = HtmlLibReadObjectFromStream(&stream);
+	if (doc == NULL) {
+		fprintf(stderr, "Error: Failed to parse HTML stream.\n");
+	}
+	return doc;
+}
+
+HtmlObject* HtmlReadObjectFromFile(const char* filename) {
+	HtmlHandleEmptyStringError(filename, NULL);
+
+	FILE* file = fopen(filename, "r");
+	HtmlHandleError(file == NULL, NULL, "failed to open '%s' in read mode", filename);
+
+	HtmlObject* doc = HtmlLibReadObjectFromFile(file, 1);
+	fclose(file);
+
+    HtmlHandleError(doc == NULL, NULL, "failed to parse html file");
+	return doc;
+}
+
+/* バッファを複数のスレッドで解析する
+
+大きな HTML をタグの位置で分割し、各部分を別のスレッドで解析してからつなぎ合わせる
+結果のツリーは HtmlReadObjectFromString() と同じ (test/test_reader.c で小さな分割と比べている)
+分割が合わなかった部分はメインスレッドで解析し直される
+小さなバッファや HTML_NO_THREADS が定義された場合は一つのスレッドで解析する
+
+@param buffer 読み取り専用のバッファ、文字列はドキュメントにコピーされる
+@param length バッファの長さ
+@param threads スレッド数、0 以下は全プロセッサー
+@return ドキュメントオブジェクト
+*/
+HtmlObject* HtmlReadObjectFromBufferParallel(const char* buffer, size_t length, int threads) {
+	HtmlHandleNullError(buffer, NULL);
+
+	return HtmlLibReadObjectParallel(buffer, length, threads);
+}
+
+/* ファイルを複数のスレッドで解析する
+
+HtmlReadObjectFromBufferParallel() と同じ、POSIX では通常ファイルがメモリにマップされる
+
+@param filename ファイル名
+@param threads スレッド数、0 以下は全プロセッサー
+@return ドキュメントオブジェクト
+*/
+HtmlObject* HtmlReadObjectFromFileParallel(const char* filename, int threads) {
+	HtmlHandleEmptyStringError(filename, NULL);
+
+	FILE* file = fopen(filename, "r");
+	HtmlHandleError(file == NULL, NULL, "failed to open '%s' in read mode", filename);
+
+	HtmlObject* doc = HtmlLibReadObjectFromFile(file, threads > 0 ? threads : 0);
+	fclose(file);
+
+    HtmlHandleError(doc == NULL, NULL, "failed to parse html file");
+	return doc;
+}
+
+
+
+
+
+
+
+
+// libcurl extension
+
+#ifdef CURLINC_CURL_H
+
+size_t HtmlLibFeedParserFromCURL(char* data, size_t size, size_t n, HtmlParser* parser) {
+	return HtmlParserFeed(parser, data, size * n) == HTML_OK ? size * n : 0;
+}
+
+HtmlObject* HtmlReadObjectFromCURL(CURL* curl, const char* url) {
+	HtmlHandleNullError(curl, NULL);
+	HtmlHandleEmptyStringError(url, NULL);
+
+	// Set URL, the response is parsed while downloading,
+	// the push parser builds the same tree as the stream reader from the whole response
+	HtmlParser* parser = HtmlParserCreate();
+	HtmlHandleError(parser == NULL, NULL, "failed to create parser!");
+
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, parser);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, HtmlLibFeedParserFromCURL);
 
 	// perform the request
 	CURLcode res = curl_easy_perform(curl);
 	if (res != CURLE_OK) {
-		HtmlDestroyStream(&stream);
+		HtmlParserDestroy(parser);
 		HtmlHandleError(true, NULL, "failed to request '%s' (%s)", url, curl_easy_strerror(res));
 	}
 
-	// Read HTML object from stream
-	HtmlObject* doc = HtmlLibReadObjectFromStream(&stream);
-	HtmlDestroyStream(&stream);
+	// Parse the rest
+	HtmlObject* doc = HtmlParserFinish(parser);
 
 	// message if failed
 	HtmlHandleError(doc == NULL, NULL, "failed to parse HTML stream from CURL");
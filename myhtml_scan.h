@@ -0,0 +1,256 @@
+#ifndef _MYHTML_SCAN_H_
+#define _MYHTML_SCAN_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+
+
+// Scanning kernels used by the readers
+//
+// every kernel scans [p, end) and has a scalar version, SSE2 / AVX2 versions are
+// chosen at runtime on x86 with GCC or Clang, define HTML_NO_SIMD to use scalar only
+
+
+#if !defined(HTML_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#define HTML_SCAN_X86
+	#include <immintrin.h>
+#endif
+
+
+typedef struct HtmlLibScanKernels {
+	// first `c`, or `end`
+	const char* (*findChar)(const char* p, const char* end, int c);
+
+	// first position having p[0] == first and p[distance] == second, or `end`
+	const char* (*findPair)(const char* p, const char* end, int first, int second, size_t distance);
+
+	// first char not a space of isspace(), or `end`
+	const char* (*skipSpaces)(const char* p, const char* end);
+} HtmlLibScanKernels;
+
+
+
+
+// Scalar //
+
+const char* HtmlLibFindCharScalar(const char* p, const char* end, int c) {
+	const char* found = (const char*)memchr(p, c, end - p);
+	return found ? found : end;
+}
+
+const char* HtmlLibFindPairScalar(const char* p, const char* end, int first, int second, size_t distance) {
+	for (; (size_t)(end - p) > distance; p++) {
+		if (p[0] == (char)first && p[distance] == (char)second) {
+			return p;
+		}
+	}
+	return end;
+}
+
+#define HtmlLibIsSpaceByte(c) ((c) == ' ' || (unsigned)((unsigned char)(c) - '\t') <= '\r' - '\t')
+
+const char* HtmlLibSkipSpacesScalar(const char* p, const char* end) {
+	while (p < end && HtmlLibIsSpaceByte(*p)) {
+		p++;
+	}
+	return p;
+}
+
+
+
+
+#ifdef HTML_SCAN_X86
+
+// SSE2 //
+
+#ifdef __SSE2__
+
+const char* HtmlLibFindCharSSE2(const char* p, const char* end, int c) {
+	__m128i needle = _mm_set1_epi8((char)c);
+
+	for (; end - p >= 16; p += 16) {
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), needle));
+		if (mask) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return HtmlLibFindCharScalar(p, end, c);
+}
+
+const char* HtmlLibFindPairSSE2(const char* p, const char* end, int first, int second, size_t distance) {
+	__m128i needle1 = _mm_set1_epi8((char)first);
+	__m128i needle2 = _mm_set1_epi8((char)second);
+
+	for (; (size_t)(end - p) >= 16 + distance; p += 16) {
+		__m128i block1 = _mm_loadu_si128((const __m128i*)p);
+		__m128i block2 = _mm_loadu_si128((const __m128i*)(p + distance));
+
+		int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block1, needle1), _mm_cmpeq_epi8(block2, needle2)));
+		if (mask) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return HtmlLibFindPairScalar(p, end, first, second, distance);
+}
+
+const char* HtmlLibSkipSpacesSSE2(const char* p, const char* end) {
+	__m128i space = _mm_set1_epi8(' ');
+	__m128i tab = _mm_set1_epi8('\t');
+	__m128i range = _mm_set1_epi8('\r' - '\t');
+
+	for (; end - p >= 16; p += 16) {
+		__m128i block = _mm_loadu_si128((const __m128i*)p);
+
+		// ' ' or '\t' ... '\r'
+		__m128i control = _mm_sub_epi8(block, tab);
+		__m128i isSpace = _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(_mm_min_epu8(control, range), control));
+
+		int mask = ~_mm_movemask_epi8(isSpace) & 0xFFFF;
+		if (mask) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return HtmlLibSkipSpacesScalar(p, end);
+}
+
+#endif
+
+
+// AVX2 //
+
+__attribute__((target("avx2")))
+const char* HtmlLibFindCharAVX2(const char* p, const char* end, int c) {
+	__m256i needle = _mm256_set1_epi8((char)c);
+
+	for (; end - p >= 32; p += 32) {
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), needle));
+		if (mask) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return HtmlLibFindCharScalar(p, end, c);
+}
+
+__attribute__((target("avx2")))
+const char* HtmlLibFindPairAVX2(const char* p, const char* end, int first, int second, size_t distance) {
+	__m256i needle1 = _mm256_set1_epi8((char)first);
+	__m256i needle2 = _mm256_set1_epi8((char)second);
+
+	for (; (size_t)(end - p) >= 32 + distance; p += 32) {
+		__m256i block1 = _mm256_loadu_si256((const __m256i*)p);
+		__m256i block2 = _mm256_loadu_si256((const __m256i*)(p + distance));
+
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block1, needle1), _mm256_cmpeq_epi8(block2, needle2)));
+		if (mask) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return HtmlLibFindPairScalar(p, end, first, second, distance);
+}
+
+__attribute__((target("avx2")))
+const char* HtmlLibSkipSpacesAVX2(const char* p, const char* end) {
+	__m256i space = _mm256_set1_epi8(' ');
+	__m256i tab = _mm256_set1_epi8('\t');
+	__m256i range = _mm256_set1_epi8('\r' - '\t');
+
+	for (; end - p >= 32; p += 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i*)p);
+
+		// ' ' or '\t' ... '\r'
+		__m256i control = _mm256_sub_epi8(block, tab);
+		__m256i isSpace = _mm256_or_si256(_mm256_cmpeq_epi8(block, space), _mm256_cmpeq_epi8(_mm256_min_epu8(control, range), control));
+
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(isSpace);
+		if (mask) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return HtmlLibSkipSpacesScalar(p, end);
+}
+
+#endif // HTML_SCAN_X86
+
+
+
+
+// Dispatch //
+
+const HtmlLibScanKernels HtmlLibScalarKernels = {HtmlLibFindCharScalar, HtmlLibFindPairScalar, HtmlLibSkipSpacesScalar};
+
+#ifdef HTML_SCAN_X86
+
+#ifdef __SSE2__
+const HtmlLibScanKernels HtmlLibSSE2Kernels = {HtmlLibFindCharSSE2, HtmlLibFindPairSSE2, HtmlLibSkipSpacesSSE2};
+#endif
+const HtmlLibScanKernels HtmlLibAVX2Kernels = {HtmlLibFindCharAVX2, HtmlLibFindPairAVX2, HtmlLibSkipSpacesAVX2};
+
+// kernels of this CPU, one pointer to a whole table so threads never see a half written one
+const HtmlLibScanKernels* HtmlLibScan = NULL;
+
+const HtmlLibScanKernels* HtmlLibInitScanKernels() {
+	const HtmlLibScanKernels* kernels = &HtmlLibScalarKernels;
+
+	#ifdef __SSE2__
+	kernels = &HtmlLibSSE2Kernels;
+	#endif
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernels = &HtmlLibAVX2Kernels;
+	}
+
+	// threads choosing at once store the same pointer
+	__atomic_store_n(&HtmlLibScan, kernels, __ATOMIC_RELEASE);
+	return kernels;
+}
+
+const HtmlLibScanKernels* HtmlLibGetScanKernels() {
+	const HtmlLibScanKernels* kernels = __atomic_load_n(&HtmlLibScan, __ATOMIC_ACQUIRE);
+	return kernels ? kernels : HtmlLibInitScanKernels();
+}
+
+#else
+
+#define HtmlLibGetScanKernels() (&HtmlLibScalarKernels)
+
+#endif // HTML_SCAN_X86
+
+
+#define HtmlLibScanChar(p, end, c) (HtmlLibGetScanKernels()->findChar((p), (end), (c)))
+#define HtmlLibScanPair(p, end, first, second, distance) (HtmlLibGetScanKernels()->findPair((p), (end), (first), (second), (distance)))
+#define HtmlLibScanSpaces(p, end) (HtmlLibGetScanKernels()->skipSpaces((p), (end)))
+
+
+
+// find `str` of `length` (> 0), or NULL
+const char* HtmlLibFindString(const char* p, const char* end, const char* str, size_t length) {
+	if (length == 1) {
+		p = HtmlLibScanChar(p, end, str[0]);
+		return p == end ? NULL : p;
+	}
+
+	// candidates by the first and the last char
+	while ((p = HtmlLibScanPair(p, end, str[0], str[length - 1], length - 1)) != end) {
+		if (memcmp(p, str, length) == 0) {
+			return p;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+// same as HtmlLibFindString but ignores case, first and last chars of `str` must not be letters
+const char* HtmlLibFindStringIgnoreCase(const char* p, const char* end, const char* str, size_t length) {
+	while ((p = HtmlLibScanPair(p, end, str[0], str[length - 1], length - 1)) != end) {
+		if (strncasecmp(p, str, length) == 0) {
+			return p;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+
+#endif /* _MYHTML_SCAN_H_ */
@@ -5,19 +5,27 @@
 #include "myhtml_object.h"
 #endif
 
+#ifndef _MYHTML_READER_H_
+#include "myhtml_reader.h"
+#endif
+
 
 #include <ctype.h>
+#include <limits.h>
 
 
 
 typedef struct HtmlSelectPattern HtmlSelectPattern;
-typedef struct HtmlSelectTask HtmlSelectTask;
 
 typedef struct HtmlSelectPattern {
     // word filtering
     char* _name;
+    unsigned short atom;    // HtmlAtom of _name
     char* _class;
+    unsigned int classHash; // HtmlLibHashName() of _class
+    size_t classLength;
     char* _id;
+    unsigned long long bloom;   // keys an element suiting pattern has, see subtreeBloom of HtmlObject
 
     // number [] filtering
     bool targeted;
@@ -29,22 +37,6 @@ typedef struct HtmlSelectPattern {
 } HtmlSelectPattern;
 
 
-typedef struct HtmlSelectTask {
-    HtmlSelectPattern* pattern;
-
-    HtmlObjectIterator iterator;
-    HtmlObject* (*IncreaseMethod)(HtmlObjectIterator*);
-
-    HtmlSelectTask* prev;
-} HtmlSelectTask;
-
-
-typedef struct HtmlSelect {
-    HtmlSelectPattern* patterns;
-    HtmlSelectTask* lastTask;
-} HtmlSelect;
-
-
 typedef struct HtmlArray {
     HtmlObject** values;
     int length;
@@ -61,7 +53,32 @@ int HtmlLibNoChangeChar(int c) {
 // HtmlSelectPattern methods //
 
 
+// keys of name, class and id of a pattern
+unsigned long long HtmlLibGetPatternBloom(const char* name, unsigned short atom, const char* className, const char* id) {
+    unsigned long long bloom = 0;
+
+    if (name) {
+        bloom |= HtmlLibGetKeyBloom(HtmlLibGetNameKey(atom, name));
+    }
+    if (className) {
+        bloom |= HtmlLibGetKeyBloom(HtmlLibHashName(className, strlen(className)));
+    }
+    if (id) {
+        bloom |= HtmlLibGetKeyBloom(HtmlLibHashName(id, strlen(id)));
+    }
+    return bloom;
+}
+
+// false if no element under object can suit pattern of `bloom`
+#define HtmlLibMayContainPattern(object, bloom) (((object)->subtreeBloom & (bloom)) == (bloom))
+
+
+void HtmlLibDestroySelectPatterns(HtmlSelectPattern* selectPattern);
+
+// patterns of a string, NULL with an error if it is not valid or has no pattern
 HtmlSelectPattern* HtmlLibCreateSelectPatterns(const char* patterns) {
+    const char* source = patterns;
+
     // malloc first HtmlSelectPattern
     HtmlSelectPattern* first = NULL;
     HtmlSelectPattern* last = NULL;
@@ -73,20 +90,24 @@ HtmlSelectPattern* HtmlLibCreateSelectPatterns(const char* patterns) {
         // removes spaces //
         while (isspace(c)) {
             c = *(++patterns);
-
-            if (c == 0) {
-                return first;
-            }
+        }
+        if (c == 0) {
+            break;
         }
 
-        // create pattern //
+        // create pattern, linked at once so an error frees it with the others //
         HtmlSelectPattern* selectPattern = (HtmlSelectPattern*)calloc(1, sizeof(HtmlSelectPattern));
-        HtmlHandleOutOfMemoryError(selectPattern, first);
+        if (selectPattern == NULL) {
+            goto OutOfMemory;
+        }
 
         if (first == NULL) {
             first = selectPattern;
         }
-        // the `last` variable will set late
+        if (last) {
+            last->next = selectPattern;
+        }
+        last = selectPattern;
 
         // read pattern //
         char** write = NULL;
@@ -97,8 +118,21 @@ HtmlSelectPattern* HtmlLibCreateSelectPatterns(const char* patterns) {
         for (; c != 0 && !isspace(c); c = *(++patterns)) {
             // special read
             if (c == '[') {
+                // an integer in brackets after a name, class or id, then the end of the pattern
+                char* indexEnd;
+                long index = strtol(patterns + 1, &indexEnd, 10);
+
+                if (write == NULL || indexEnd == patterns + 1 || index > INT_MAX || index < -INT_MAX) {
+                    goto Invalid;
+                }
+                while (isspace(*indexEnd)) indexEnd++;
+
+                if (*indexEnd != ']' || (indexEnd[1] != 0 && !isspace(indexEnd[1]))) {
+                    goto Invalid;
+                }
+
                 // setup target
-                sscanf(++patterns, "%d", &selectPattern->index);
+                selectPattern->index = (int)index;
                 selectPattern->targeted = true;
 
                 if (selectPattern->index < 0) {
@@ -106,9 +140,7 @@ HtmlSelectPattern* HtmlLibCreateSelectPatterns(const char* patterns) {
                     selectPattern->index = -selectPattern->index - 1; // convert to positive index
                 }
 
-                // full lessing words
-                for (; (c = *patterns) != 0 && (isspace(c) || isdigit(c) || c == ']' || c == '-'); patterns++);
-
+                patterns = indexEnd + 1;
                 break;
             }
 
@@ -137,17 +169,13 @@ HtmlSelectPattern* HtmlLibCreateSelectPatterns(const char* patterns) {
 
             // write char to `write`
             if (writeLength + 1 >= writeCapacity) {
-                writeCapacity = writeCapacity + 16;
-                (*write) = (char*)realloc((*write), writeCapacity);
-                
-                if ((*write) == NULL) {
-                    HtmlLibDestroyPointer(selectPattern->_name);
-                    HtmlLibDestroyPointer(selectPattern->_class);
-                    HtmlLibDestroyPointer(selectPattern->_id);
-
-                    free(selectPattern);
-                    return first;
+                char* newWrite = (char*)realloc((*write), writeCapacity + 16);
+                if (newWrite == NULL) {
+                    goto OutOfMemory;
                 }
+
+                (*write) = newWrite;
+                writeCapacity = writeCapacity + 16;
             }
 
             (*write)[writeLength++] = ConvertChar(c);
@@ -158,8 +186,8 @@ HtmlSelectPattern* HtmlLibCreateSelectPatterns(const char* patterns) {
             if ((*write)) {
                 HtmlLogWarning("overwriting text!");
             }
-            else {
-                *write = (char*)malloc(16);
+            else if ((*write = (char*)malloc(16)) == NULL) {
+                goto OutOfMemory;
             }
 
             writeLength = 0;
@@ -169,13 +197,26 @@ HtmlSelectPattern* HtmlLibCreateSelectPatterns(const char* patterns) {
         // completes variables
         (*write)[writeLength] = 0;
 
-        if (last) {
-            last->next = selectPattern;
+        if (selectPattern->_name) {
+            selectPattern->atom = HtmlLibLookupAtom(selectPattern->_name, strlen(selectPattern->_name));
         }
-        last = selectPattern;
+        if (selectPattern->_class) {
+            selectPattern->classLength = strlen(selectPattern->_class);
+            selectPattern->classHash = HtmlLibHashName(selectPattern->_class, selectPattern->classLength);
+        }
+        selectPattern->bloom = HtmlLibGetPatternBloom(selectPattern->_name, selectPattern->atom, selectPattern->_class, selectPattern->_id);
     }
 
+    HtmlHandleError(first == NULL, NULL, "no pattern in '%s'", source);
     return first;
+
+Invalid:
+    HtmlLibDestroySelectPatterns(first);
+    HtmlHandleError(true, NULL, "invalid pattern '%s', [index] is an integer after a name, class or id at the end of a pattern", source);
+
+OutOfMemory:
+    HtmlLibDestroySelectPatterns(first);
+    HtmlHandleOutOfMemoryError(NULL, NULL);
 }
 
 
@@ -194,13 +235,13 @@ void HtmlLibDestroySelectPatterns(HtmlSelectPattern* selectPattern) {
 }
 
 
-bool HtmlLibIsObjectSuitPattern(HtmlObject* object, HtmlSelectPattern* selectPattern) {
-    if (selectPattern->_name && strcmp(selectPattern->_name, object->name) != 0) {
+// check an element by its name, class list and id (NULL if not given)
+bool HtmlLibIsSuitPattern(const HtmlSelectPattern* selectPattern, unsigned short atom, const char* name, const char* classes, const char* id) {
+    if (selectPattern->_name && !HtmlLibIsSameAtom(selectPattern->atom, selectPattern->_name, atom, name)) {
         return false;
     }
     if (selectPattern->_class) {
-        const char* classes = HtmlGetObjectAttributeValue(object, "class");
-        if (*classes == 0) {
+        if (classes == NULL || *classes == 0) {
         	return false;
         }
         
@@ -228,243 +269,2237 @@ bool HtmlLibIsObjectSuitPattern(HtmlObject* object, HtmlSelectPattern* selectPat
         	return false;
         }
     }
-    if (selectPattern->_id && strcmp(selectPattern->_id, HtmlGetObjectAttributeValue(object, "id")) != 0) {
+    if (selectPattern->_id && (id == NULL || strcmp(selectPattern->_id, id) != 0)) {
         return false;
     }
 
     return true;
 }
 
+// check an element, its classes are in its class list
+bool HtmlLibIsObjectSuitPattern(const HtmlObject* object, const HtmlSelectPattern* selectPattern) {
+    if (selectPattern->_name && !HtmlLibIsSameAtom(selectPattern->atom, selectPattern->_name, object->atom, object->name)) {
+        return false;
+    }
+    if (selectPattern->_class && !HtmlLibHasObjectClass(object, selectPattern->classHash, selectPattern->_class, selectPattern->classLength)) {
+        return false;
+    }
+    if (selectPattern->_id) {
+        HtmlAttribute* id = HtmlLibFindObjectAttribute(object, HTML_ATOM_ID, "id");
+        if (id == NULL || id->value == NULL || strcmp(selectPattern->_id, id->value) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+
+// HtmlArray methods //
+
+void HtmlDestroyArray(HtmlArray* array) {
+    if (array == NULL) {
+        return;
+    }
+    if (array->values == NULL) {
+        return; // nothing to destroy
+    }
+    
+    free(array->values);
+    array->values = NULL;
+    array->length = 0;
+}
+
+
+
+
+
+
+// Compiled Select //
+//
+// patterns parsed once into one block that is never changed, so it can be run on any
+// document from any thread, the state of a run is a HtmlCompiledSelectState on the stack
+
+#ifndef HTML_COMPILED_SELECT_MAX_STEPS
+#define HTML_COMPILED_SELECT_MAX_STEPS 16
+#endif
+
 
+typedef struct HtmlCompiledSelectStep {
+    const char* name;           // lowered, NULL for any name
+    unsigned short atom;        // HtmlAtom of name
 
+    const char* className;      // NULL for any class
+    size_t classLength;
+    unsigned int classHash;     // HtmlLibHashName() of className
 
-// HtmlSelectTask methods //
+    const char* id;             // NULL for any id
+    unsigned long long bloom;   // keys an element suiting step has
 
-HtmlSelectTask* HtmlLibCreateSelectTask(HtmlSelectTask* prev, HtmlObject* object, HtmlSelectPattern* selectPattern) {
-    HtmlSelectTask* task = (HtmlSelectTask*)malloc(sizeof(HtmlSelectTask));
-    HtmlHandleOutOfMemoryError(task, NULL);
+    bool targeted;
+    bool reversal;
+    int index;
+} HtmlCompiledSelectStep;
+
+
+typedef struct HtmlCompiledSelect {
+    HtmlCompiledSelectStep* steps;  // in the same block, names follow the steps
+    int length;
+} HtmlCompiledSelect;
+
+
+typedef struct HtmlCompiledSelectState {
+    const HtmlCompiledSelect* compiled;
+    const HtmlObject* node;     // object returned last, or the root before the first run
+    int level;                  // step searching under scopes[level]
+    bool started;
 
-    task->pattern = selectPattern;
+    // elements of the first step's name, id or class from the document index, instead of walking
+    const HtmlLibIndexEntry* candidate;
+    const HtmlLibIndexEntry* candidateEnd;
+    const HtmlObject* blocker;  // last element suiting the first step, its subtree is not checked
 
-    if (selectPattern->reversal == false) {
-        task->iterator = HtmlBeginObject(object);
-        task->IncreaseMethod = HtmlNextObject;
+    const HtmlObject* scopes[HTML_COMPILED_SELECT_MAX_STEPS];
+    int counts[HTML_COMPILED_SELECT_MAX_STEPS];
+} HtmlCompiledSelectState;
+
+
+
+
+bool HtmlLibIsObjectSuitCompiledStep(const HtmlObject* object, const HtmlCompiledSelectStep* step) {
+    if (step->name && !HtmlLibIsSameAtom(step->atom, step->name, object->atom, object->name)) {
+        return false;
     }
-    else {
-        task->iterator = HtmlEndObject(object);
-        task->IncreaseMethod = HtmlPrevObject;
+    if (step->className && !HtmlLibHasObjectClass(object, step->classHash, step->className, step->classLength)) {
+        return false;
+    }
+    if (step->id) {
+        HtmlAttribute* id = HtmlLibFindObjectAttribute(object, HTML_ATOM_ID, "id");
+        if (id == NULL || id->value == NULL || strcmp(step->id, id->value) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// copy `str` to `*write` in the block of HtmlCompiledSelect
+const char* HtmlLibCopyCompiledString(char** write, const char* str) {
+    if (str == NULL) {
+        return NULL;
     }
 
-    task->prev = prev;
-    return task;
+    size_t size = strlen(str) + 1;
+    char* copy = (char*)memcpy(*write, str, size);
+    *write += size;
+    return copy;
 }
 
 
-#define HtmlLibDestroySelectTask(task) (free(task))
 
 
+/* パターンを一度だけ解析して、使い回せる形にする
 
+結果は一つのメモリブロックで、実行しても変更されないので、
+複数のドキュメントや複数のスレッドで同時に使える
+パターンの書式は HtmlCreateSelect() と同じ
 
+@param patterns 検索パターン、HTML_COMPILED_SELECT_MAX_STEPS 個まで
+@return コンパイルされたパターン、HtmlDestroyCompiledSelect() で解放する、失敗したら NULL
+*/
+HtmlCompiledSelect* HtmlCompileSelect(const char* patterns) {
+    HtmlHandleEmptyStringError(patterns, NULL);
 
+    HtmlSelectPattern* selectPatterns = HtmlLibCreateSelectPatterns(patterns);
+    if (selectPatterns == NULL) {
+        return NULL;
+    }
 
+    // size of block
+    int length = 0;
+    size_t stringSize = 0;
 
-// HtmlSelect methods //
+    for (HtmlSelectPattern* pattern = selectPatterns; pattern; pattern = pattern->next) {
+        length++;
+        stringSize += (pattern->_name ? strlen(pattern->_name) + 1 : 0) + (pattern->_class ? strlen(pattern->_class) + 1 : 0) + (pattern->_id ? strlen(pattern->_id) + 1 : 0);
+    }
 
-/*
-create a select to select objects by patterns
-patterns format be: "tag1.class1#id1[index1] tag2.class2#id2[index2] ..."
+    if (length > HTML_COMPILED_SELECT_MAX_STEPS) {
+        HtmlLibDestroySelectPatterns(selectPatterns);
+        HtmlHandleError(true, NULL, "too many patterns in '%s' (max %d)", patterns, HTML_COMPILED_SELECT_MAX_STEPS);
+    }
 
-- `tag` : tag name
-- `class` : class name by operator `.`
-- `id` : id name by operator `#`
-- `index` : index of result that suit to that pattern, if negative, it reverses search direction
+    HtmlCompiledSelect* compiled = (HtmlCompiledSelect*)malloc(sizeof(HtmlCompiledSelect) + length * sizeof(HtmlCompiledSelectStep) + stringSize);
+    if (compiled == NULL) {
+        HtmlLibDestroySelectPatterns(selectPatterns);
+        HtmlHandleOutOfMemoryError(NULL, NULL);
+    }
 
-you can use multiple patterns, separated by spaces. every pattern needs tag, class or id, you can use more than one, and optional index.
+    compiled->steps = (HtmlCompiledSelectStep*)(compiled + 1);
+    compiled->length = length;
 
-*/
-HtmlSelect HtmlCreateSelect(HtmlObject* object, const char* patterns) {
-    HtmlSelect select = {0};
+    // fill steps
+    char* write = (char*)(compiled->steps + length);
+    HtmlCompiledSelectStep* step = compiled->steps;
 
-    HtmlHandleNullError(object, select);
-    HtmlHandleEmptyStringError(patterns, select);
+    for (HtmlSelectPattern* pattern = selectPatterns; pattern; pattern = pattern->next, step++) {
+        step->name = HtmlLibCopyCompiledString(&write, pattern->_name);
+        step->atom = pattern->atom;
 
-    // create patterns
-    select.patterns = HtmlLibCreateSelectPatterns(patterns);
-    HtmlHandleOutOfMemoryError(select.patterns, select);
+        step->className = HtmlLibCopyCompiledString(&write, pattern->_class);
+        step->classLength = pattern->classLength;
+        step->classHash = pattern->classHash;
+
+        step->id = HtmlLibCopyCompiledString(&write, pattern->_id);
+        step->bloom = pattern->bloom;
 
-    // set last task
-    select.lastTask = HtmlLibCreateSelectTask(NULL, object, select.patterns);
-    if (select.lastTask == NULL) {
-        HtmlLibDestroySelectPatterns(select.patterns);
-        return (HtmlSelect){0};
+        step->targeted = pattern->targeted;
+        step->reversal = pattern->reversal;
+        step->index = pattern->index;
     }
 
-    return select;
+    HtmlLibDestroySelectPatterns(selectPatterns);
+    return compiled;
 }
 
-void HtmlDestroySelect(HtmlSelect* select) {
-    if (select == NULL) {
-        return;
+
+void HtmlDestroyCompiledSelect(HtmlCompiledSelect* compiled) {
+    free(compiled);
+}
+
+
+
+// Document Index //
+//
+// elements by name, id and class for patterns starting with them, a select takes only the
+// elements of the shortest list instead of walking the document, changes make the index stale
+//
+// the index is not updated by changes on purpose: a change only marks it stale and the next select
+// builds it again in one O(n) walk, so a run of changes costs one rebuild and the lists stay sorted
+// arrays without per-entry removal, documents changed between every select are better not indexed
+
+
+int HtmlLibCompareIndexEntry(const void* a, const void* b) {
+    const HtmlLibIndexEntry* entry1 = (const HtmlLibIndexEntry*)a;
+    const HtmlLibIndexEntry* entry2 = (const HtmlLibIndexEntry*)b;
+
+    if (entry1->key != entry2->key) {
+        return entry1->key < entry2->key ? -1 : 1;
     }
+    return entry1->order < entry2->order ? -1 : entry1->order > entry2->order;
+}
+
 
-    HtmlLibDestroySelectPatterns(select->patterns);
+bool HtmlLibAddIndexEntry(HtmlLibIndexList* list, const HtmlObject* object, unsigned int order, unsigned int key) {
+    if (list->count == list->capacity) {
+        size_t newCapacity = list->capacity ? list->capacity * 2 : 256;
+        HtmlLibIndexEntry* newEntries = (HtmlLibIndexEntry*)realloc(list->entries, newCapacity * sizeof(HtmlLibIndexEntry));
+        HtmlHandleOutOfMemoryError(newEntries, false);
 
-    HtmlSelectTask* prev;
-    while (select->lastTask) {
-        prev = select->lastTask->prev;
-        HtmlLibDestroySelectTask(select->lastTask);
-        select->lastTask = prev;
+        list->entries = newEntries;
+        list->capacity = newCapacity;
     }
+
+    list->entries[list->count++] = (HtmlLibIndexEntry){(HtmlObject*)object, order, key};
+    return true;
 }
 
+// entries by key then order, an empty list has no entries (NULL) and is not passed to qsort
+void HtmlLibSortIndexList(HtmlLibIndexList* list) {
+    if (list->count > 1) {
+        qsort(list->entries, list->count, sizeof(HtmlLibIndexEntry), HtmlLibCompareIndexEntry);
+    }
+}
 
+// every class token of object once
+bool HtmlLibAddIndexClasses(HtmlLibIndexList* list, const HtmlObject* object, unsigned int order) {
+    const HtmlLibClassList* classList = object->classList;
+    size_t first = list->count;
 
-HtmlObject* HtmlNextSelect(HtmlSelect* select) {
-    if (select->lastTask == NULL) {
-        return NULL;
+    for (unsigned int i = 0; classList && i < classList->count; i++) {
+        // a token repeated in the list is found once
+        unsigned int key = classList->tokens[i].hash;
+        size_t j = first;
+
+        while (j < list->count && list->entries[j].key != key) {
+            j++;
+        }
+        if (j == list->count && HtmlLibAddIndexEntry(list, object, order, key) == false) {
+            return false;
+        }
     }
+    return true;
+}
 
-    // run tasks //
-    HtmlSelectTask* task;
 
-    while ((task = select->lastTask)) {
-        HtmlObject* child = NULL;
+// next object of `object` in document order under `root`, or NULL
+const HtmlObject* HtmlLibNextIndexObject(const HtmlObject* object, const HtmlObject* root) {
+    if (object->firstChild) {
+        return object->firstChild;
+    }
+    while (object != root) {
+        if (object->next) {
+            return object->next;
+        }
+        object = object->parent;
+    }
+    return NULL;
+}
 
-        while (true) {
-            child = task->IncreaseMethod(&task->iterator);
 
-            // if object are no child lessing, remove the task
-            if (child == NULL) {
-                select->lastTask = task->prev;
-                HtmlLibDestroySelectTask(task);
-                break;
-            }
+// names, ids and classes in one walk, then sort lists by key
+HtmlCode HtmlLibBuildDocumentIndex(HtmlDocument* document) {
+    HtmlLibDocumentIndex* index = document->index;
+    const HtmlObject* root = &document->object;
+    unsigned int order = 0;
 
-            // if DOCUMENT object, check children //
-            if (child->type == HTML_TYPE_DOCUMENT) {
-                goto CheckObjectsUnderChild;
-            }
+    index->names.count = 0;
+    index->ids.count = 0;
+    index->classes.count = 0;
+    index->uninterned = false;
 
-            // filtering objects who types not TAG, SINGLE or SCRIPT //
-            if (child->type != HTML_TYPE_TAG && child->type != HTML_TYPE_SINGLE && child->type != HTML_TYPE_SCRIPT) {
-                continue;
-            }
+    for (const HtmlObject* object = root; object; object = HtmlLibNextIndexObject(object, root)) {
+        if (object->name == NULL || !HtmlLibIsIntegerIn(object->type, HTML_TYPE_TAG, HTML_TYPE_SINGLE, HTML_TYPE_SCRIPT, -1)) {
+            continue;
+        }
 
-            // check patterns //
-            if (HtmlLibIsObjectSuitPattern(child, task->pattern)) {
-                // object suit patterns, but not target index
-                if (task->pattern->index != 0) {
-                    task->pattern->index--;
-                    continue;
-                }
+        HtmlAttribute* id = HtmlLibFindObjectAttribute(object, HTML_ATOM_ID, "id");
 
-                // not final pattern, make task to forward select
-                if (task->pattern->next) {
-                    if (child->type != HTML_TYPE_TAG) {
-                        return NULL;
-                    }
+        if (HtmlLibAddIndexEntry(&index->names, object, order, object->atom) == false ||
+                (id && id->value && HtmlLibAddIndexEntry(&index->ids, object, order, HtmlLibHashName(id->value, strlen(id->value))) == false) ||
+                HtmlLibAddIndexClasses(&index->classes, object, order) == false) {
+            index->stale = true;
+            return HTML_OUT_OF_MEMORY;
+        }
 
-                    select->lastTask = HtmlLibCreateSelectTask(task, child, task->pattern->next);
+        index->uninterned |= object->atom == HTML_ATOM_DYNAMIC;
+        order++;
+    }
 
-                    if (task->pattern->targeted) {
-                        select->lastTask->prev = task->prev;
-                        HtmlLibDestroySelectTask(task);
-                    }
-                    break;
-                }
+    HtmlLibSortIndexList(&index->names);
+    HtmlLibSortIndexList(&index->ids);
+    HtmlLibSortIndexList(&index->classes);
 
-                // return object also remove current task
-                if (task->pattern->targeted) {
-                    select->lastTask = task->prev;
-                    HtmlLibDestroySelectTask(task);
-                }
-                return child;
-            }
-            
-            // if object not suit pattern, SINGLE and SCRIPT types go to next loop, TAG types check its children
-            if (child->type != HTML_TYPE_TAG) {
-                continue;
-            }
+    index->stale = false;
+    return HTML_OK;
+}
 
-            // goto method to check document
-        CheckObjectsUnderChild:
-            select->lastTask = HtmlLibCreateSelectTask(task, child, task->pattern);
-            break;
+
+// entries of `key` in `list`, `*end` gets the end of range
+const HtmlLibIndexEntry* HtmlLibFindIndexEntries(const HtmlLibIndexList* list, unsigned int key, const HtmlLibIndexEntry** end) {
+    size_t low = 0, high = list->count;
+
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (list->entries[middle].key < key) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
         }
     }
 
-    // no more result
-    return NULL;
+    const HtmlLibIndexEntry* begin = list->entries + low;
+    for (*end = begin; *end < list->entries + list->count && (*end)->key == key; (*end)++);
+    return begin;
 }
 
 
-// HtmlArray methods //
+/* ドキュメントの索引を作る
 
-void HtmlDestroyArray(HtmlArray* array) {
-    if (array == NULL) {
-        return;
+タグ名、ID やクラスで始まるパターンの検索は、ドキュメント全体を辿らずに
+その名前、ID やクラスを持つ要素だけを調べるようになる (一番少ないものを使う)
+ツリーや id、class 属性を変更すると索引は古くなり、次の検索で作り直される
+作り直しはドキュメントを変更するので、複数のスレッドで検索する前に呼んでおく
+
+@param document ドキュメントオブジェクト
+@return HTML_OK、失敗したらエラーコード
+*/
+HtmlCode HtmlIndexDocument(HtmlObject* document) {
+    HtmlHandleNullError(document, HTML_NULL_POINTER);
+    HtmlHandleError(document->type != HTML_TYPE_DOCUMENT, HTML_NULL_POINTER, "object is not a document");
+
+    HtmlDocument* doc = (HtmlDocument*)document;
+    if (doc->index == NULL) {
+        doc->index = (HtmlLibDocumentIndex*)calloc(1, sizeof(HtmlLibDocumentIndex));
+        HtmlHandleOutOfMemoryError(doc->index, HTML_OUT_OF_MEMORY);
     }
-    if (array->values == NULL) {
-        return; // nothing to destroy
+    return HtmlLibBuildDocumentIndex(doc);
+}
+
+
+// take candidates of the first step from the shortest list of index, when the step has no [index]
+// index of the document of object, rebuilt if stale, or NULL if not indexed
+HtmlLibDocumentIndex* HtmlLibGetFreshIndex(const HtmlObject* object) {
+    HtmlDocument* document = HtmlLibGetObjectDocument((HtmlObject*)object);
+    if (document == NULL || document->index == NULL) {
+        return NULL;
     }
-    
-    free(array->values);
-    array->values = NULL;
-    array->length = 0;
+    if (document->index->stale && HtmlLibBuildDocumentIndex(document) != HTML_OK) {
+        return NULL;
+    }
+    return document->index;
 }
 
 
+// key of name in the index, names not known are interned by the document, HTML_ATOM_NONE if no element has it
+unsigned short HtmlLibGetIndexNameKey(const HtmlObject* object, const HtmlLibDocumentIndex* index, unsigned short atom, const char* name) {
+    if (atom != HTML_ATOM_DYNAMIC) {
+        return atom;
+    }
+    return index->uninterned ? HTML_ATOM_NONE : HtmlLibFindAtom(HtmlLibGetObjectDocument((HtmlObject*)object), name, strlen(name));
+}
 
 
+// take the entries of `key` as candidates if there are fewer of them
+void HtmlLibTakeFewerEntries(const HtmlLibIndexList* list, unsigned int key, const HtmlLibIndexEntry** candidate, const HtmlLibIndexEntry** candidateEnd) {
+    const HtmlLibIndexEntry* end;
+    const HtmlLibIndexEntry* begin = HtmlLibFindIndexEntries(list, key, &end);
 
+    if (*candidate == NULL || end - begin < *candidateEnd - *candidate) {
+        *candidate = begin;
+        *candidateEnd = end;
+    }
+}
 
-HtmlArray HtmlFindAllObjects(HtmlObject* object, const char* patterns, int maxCount) {
-    HtmlArray array = {0};
 
-    HtmlHandleNullError(object, array);
-    HtmlHandleEmptyStringError(patterns, array);
+void HtmlLibBeginIndexedSelect(HtmlCompiledSelectState* state, const HtmlObject* object) {
+    const HtmlCompiledSelectStep* step = &state->compiled->steps[0];
+    if (step->targeted || (step->name == NULL && step->className == NULL && step->id == NULL)) {
+        return;
+    }
 
-    // create array //
-    array.values = (HtmlObject**)malloc(sizeof(HtmlObject*) * (maxCount > 0 ? maxCount : 20));
-    if (array.values == NULL) {
-        return array;
+    HtmlLibDocumentIndex* index = HtmlLibGetFreshIndex(object);
+    if (index == NULL) {
+        return;
     }
 
-    // select objects //
-    HtmlSelect select = HtmlCreateSelect(object, patterns);
-    HtmlObject* result;
+    unsigned short atom = step->name ? HtmlLibGetIndexNameKey(object, index, step->atom, step->name) : HTML_ATOM_NONE;
 
-    while ((result = HtmlNextSelect(&select))) {
-        if (maxCount <= 0 && array.length%20 == 19) {
-            // increase array size
-            HtmlObject** newValues = (HtmlObject**)realloc(array.values, sizeof(HtmlObject*) * (array.length + 21));
-            if (newValues == NULL) {
-                HtmlDestroySelect(&select);
-                HtmlHandleOutOfMemoryError(newValues, array);
-            }
-            array.values = newValues;
-        }
-        
-        array.values[array.length++] = result;
+    if (atom != HTML_ATOM_NONE) {
+        HtmlLibTakeFewerEntries(&index->names, atom, &state->candidate, &state->candidateEnd);
+    }
+    if (step->id) {
+        HtmlLibTakeFewerEntries(&index->ids, HtmlLibHashName(step->id, strlen(step->id)), &state->candidate, &state->candidateEnd);
+    }
+    if (step->className) {
+        HtmlLibTakeFewerEntries(&index->classes, step->classHash, &state->candidate, &state->candidateEnd);
+    }
+}
 
-        if (maxCount > 0 && array.length >= maxCount) {
-            break; // stop if reached max count
+
+// walking from root finds `object` as the first step, it is not under the blocker
+bool HtmlLibIsIndexedCandidate(const HtmlObject* object, const HtmlCompiledSelectState* state) {
+    const HtmlObject* root = state->scopes[0];
+
+    for (const HtmlObject* parent = object->parent; parent != root; parent = parent->parent) {
+        if (parent == NULL || parent == state->blocker) {
+            return false;
+        }
+        if (parent->type != HTML_TYPE_TAG && parent->type != HTML_TYPE_DOCUMENT) {
+            return false;
         }
     }
+    return true;
+}
+
+
+
+
+/* コンパイルされたパターンの実行を始める
+
+状態は呼び出し側 (スタックなど) に置かれ、実行中にメモリを確保しない
+
+@param state 実行の状態
+@param object 検索するオブジェクト
+@param compiled HtmlCompileSelect() の結果
+*/
+void HtmlBeginCompiledSelect(HtmlCompiledSelectState* state, const HtmlObject* object, const HtmlCompiledSelect* compiled) {
+    state->compiled = compiled;
+    state->node = object && compiled ? object : NULL;
+    state->level = 0;
+    state->started = false;
+    state->scopes[0] = object;
+
+    state->candidate = NULL;
+    state->candidateEnd = NULL;
+    state->blocker = NULL;
+
+    for (int i = 0; compiled && i < compiled->length; i++) {
+        state->counts[i] = compiled->steps[i].index;
+    }
 
-    HtmlDestroySelect(&select);
-    return array;
+    if (state->node) {
+        HtmlLibBeginIndexedSelect(state, object);
+    }
 }
 
 
-HtmlObject* HtmlFindObject(HtmlObject* object, const char* patterns) {
-    HtmlHandleNullError(object, NULL);
-    HtmlHandleEmptyStringError(patterns, NULL);
+/* 次の結果を返す
 
-    HtmlSelect select = HtmlCreateSelect(object, patterns);
-    HtmlObject* result = HtmlNextSelect(&select);
-    HtmlDestroySelect(&select);
-    return result;
+HtmlNextSelect() も同じ処理で、タスクを作らずに親のポインターで戻るので、メモリを確保しない
+
+@param state HtmlBeginCompiledSelect() で始めた状態
+@return 次のオブジェクト、なければ NULL
+*/
+HtmlObject* HtmlNextCompiledSelect(HtmlCompiledSelectState* state) {
+    const HtmlObject* node = state->node;
+    const HtmlObject* next;
+    int level = state->level;
+    const HtmlCompiledSelectStep* step;
+
+    if (node == NULL) {
+        return NULL;
+    }
+    step = &state->compiled->steps[level];
+
+    if (state->started == false) {
+        state->started = true;
+
+        if (state->candidate) {
+            goto NextCandidate;
+        }
+        goto EnterChildren;
+    }
+    goto LeaveMatched;
+
+    // check children of node by step, in reversed order for negative index
+EnterChildren:
+    next = step->reversal ? node->lastChild : node->firstChild;
+    if (next == NULL) {
+        goto FinishChildren;
+    }
+    node = next;
+
+    // check node
+CheckNode:
+    if (node->type == HTML_TYPE_DOCUMENT) {
+        goto EnterChildren;
+    }
+    if (node->type != HTML_TYPE_TAG && node->type != HTML_TYPE_SINGLE && node->type != HTML_TYPE_SCRIPT) {
+        goto NextSibling;
+    }
+
+    if (HtmlLibIsObjectSuitCompiledStep(node, step)) {
+        // suits but not target index, its subtree is not checked
+        if (state->counts[level] != 0) {
+            state->counts[level]--;
+            goto NextSibling;
+        }
+
+    SuitNode:
+        // not final step, check children by next step
+        if (level + 1 < state->compiled->length) {
+            if (node->type != HTML_TYPE_TAG) {
+                goto NextSibling;
+            }
+            // nothing under node suits next step, same as checking all
+            if (!HtmlLibMayContainPattern(node, step[1].bloom)) {
+                goto LeaveMatched;
+            }
+            state->scopes[++level] = node;
+            step++;
+            goto EnterChildren;
+        }
+
+        state->node = node;
+        state->level = level;
+        return (HtmlObject*)node;
+    }
+
+    if (node->type == HTML_TYPE_TAG && HtmlLibMayContainPattern(node, step->bloom)) {
+        goto EnterChildren;
+    }
+
+    // next sibling of node, or finish its parent, the first step takes the next candidate
+NextSibling:
+    if (level == 0 && state->candidate) {
+        goto NextCandidate;
+    }
+    next = step->reversal ? node->prev : node->next;
+    if (next) {
+        node = next;
+        goto CheckNode;
+    }
+    node = node->parent;
+
+    // all children of node are checked
+FinishChildren:
+    if (node != state->scopes[level]) {
+        goto NextSibling;
+    }
+    if (level == 0) {
+        state->node = NULL;
+        return NULL;
+    }
+    level--;
+    step--;
+
+    // node suited step, a targeted step stops at the first result, so its siblings are not checked
+LeaveMatched:
+    if (step->targeted) {
+        node = node->parent;
+        goto FinishChildren;
+    }
+    goto NextSibling;
+
+    // next element of the first step from the index
+NextCandidate:
+    while (state->candidate < state->candidateEnd) {
+        node = (state->candidate++)->object;
+
+        if (HtmlLibIsIndexedCandidate(node, state) && HtmlLibIsObjectSuitCompiledStep(node, step)) {
+            state->blocker = node;
+            goto SuitNode;
+        }
+    }
+    state->node = NULL;
+    return NULL;
+}
+
+
+
+// HtmlSelect methods //
+//
+// a HtmlSelect is a compiled select with its own state, selecting walks by parent pointers
+// and allocates nothing, however many objects it checks
+
+// patterns are not changed by selecting, the position and objects left to skip for [index] are in `state`
+typedef struct HtmlSelect {
+    HtmlCompiledSelect* compiled;
+    HtmlCompiledSelectState state;
+} HtmlSelect;
+
+
+/*
+create a select to select objects by patterns
+patterns format be: "tag1.class1#id1[index1] tag2.class2#id2[index2] ..."
+
+- `tag` : tag name
+- `class` : class name by operator `.`
+- `id` : id name by operator `#`
+- `index` : index of result that suit to that pattern, if negative, it reverses search direction
+
+you can use multiple patterns (up to HTML_COMPILED_SELECT_MAX_STEPS), separated by spaces. every pattern needs tag, class or id, you can use more than one, and optional index.
+
+selecting only reads the tree, threads can select on the same tree with their own HtmlSelect
+*/
+HtmlSelect HtmlCreateSelect(const HtmlObject* object, const char* patterns) {
+    HtmlSelect select = {0};
+
+    HtmlHandleNullError(object, select);
+    HtmlHandleEmptyStringError(patterns, select);
+
+    select.compiled = HtmlCompileSelect(patterns);
+    if (select.compiled == NULL) {
+        return select;
+    }
+
+    HtmlBeginCompiledSelect(&select.state, object, select.compiled);
+    return select;
+}
+
+void HtmlDestroySelect(HtmlSelect* select) {
+    if (select == NULL) {
+        return;
+    }
+
+    HtmlDestroyCompiledSelect(select->compiled);
+    select->compiled = NULL;
+    select->state.node = NULL;
+}
+
+
+HtmlObject* HtmlNextSelect(HtmlSelect* select) {
+    return HtmlNextCompiledSelect(&select->state);
+}
+
+
+
+HtmlArray HtmlFindAllCompiledObjects(const HtmlObject* object, const HtmlCompiledSelect* compiled, int maxCount) {
+    HtmlArray array = {0};
+
+    HtmlHandleNullError(object, array);
+    HtmlHandleNullError(compiled, array);
+
+    // create array //
+    int capacity = maxCount > 0 ? maxCount : 20;
+    array.values = (HtmlObject**)malloc(sizeof(HtmlObject*) * capacity);
+    HtmlHandleOutOfMemoryError(array.values, array);
+
+    // select objects //
+    HtmlCompiledSelectState state;
+    HtmlBeginCompiledSelect(&state, object, compiled);
+    HtmlObject* result;
+
+    while ((result = HtmlNextCompiledSelect(&state))) {
+        if (array.length == capacity) {
+            // increase array size
+            HtmlObject** newValues = (HtmlObject**)realloc(array.values, sizeof(HtmlObject*) * capacity * 2);
+            HtmlHandleOutOfMemoryError(newValues, array);
+
+            array.values = newValues;
+            capacity *= 2;
+        }
+
+        array.values[array.length++] = result;
+
+        if (maxCount > 0 && array.length >= maxCount) {
+            break; // stop if reached max count
+        }
+    }
+    return array;
+}
+
+
+HtmlObject* HtmlFindCompiledObject(const HtmlObject* object, const HtmlCompiledSelect* compiled) {
+    HtmlHandleNullError(object, NULL);
+    HtmlHandleNullError(compiled, NULL);
+
+    HtmlCompiledSelectState state;
+    HtmlBeginCompiledSelect(&state, object, compiled);
+    return HtmlNextCompiledSelect(&state);
+}
+
+
+
+HtmlArray HtmlFindAllObjects(const HtmlObject* object, const char* patterns, int maxCount) {
+    HtmlArray array = {0};
+
+    HtmlHandleNullError(object, array);
+    HtmlHandleEmptyStringError(patterns, array);
+
+    HtmlCompiledSelect* compiled = HtmlCompileSelect(patterns);
+    if (compiled == NULL) {
+        return array;
+    }
+
+    array = HtmlFindAllCompiledObjects(object, compiled, maxCount);
+    HtmlDestroyCompiledSelect(compiled);
+    return array;
+}
+
+
+HtmlObject* HtmlFindObject(const HtmlObject* object, const char* patterns) {
+    HtmlHandleNullError(object, NULL);
+    HtmlHandleEmptyStringError(patterns, NULL);
+
+    HtmlCompiledSelect* compiled = HtmlCompileSelect(patterns);
+    if (compiled == NULL) {
+        return NULL;
+    }
+
+    HtmlObject* result = HtmlFindCompiledObject(object, compiled);
+    HtmlDestroyCompiledSelect(compiled);
+    return result;
+}
+
+
+
+// CSS Selectors //
+//
+// a selector list like "ul > li.item:not(.hidden), a[href^='https']" is compiled into one block
+// of HtmlCssOp, an element is checked by running the ops of each selector from its rightmost
+// compound to the left, combinators move to the parent or a previous sibling
+//
+// - `tag`, `*`, `.class`, `#id`
+// - `[attr]`, `[attr=value]`, `~=`, `|=`, `^=`, `$=`, `*=`, and `i` before `]` to ignore case of value
+// - `:first-child`, `:last-child`, `:only-child`, `:first-of-type`, `:last-of-type`, `:only-of-type`
+// - `:nth-child()`, `:nth-last-child()`, `:nth-of-type()`, `:nth-last-of-type()` by `an+b`, `odd` or `even`
+// - `:not()`, `:is()` and `:where()` by selector lists, `:empty`, `:root`
+// - combinators ` `, `>`, `+`, `~`, and `,` between selectors
+//
+// unlike HtmlSelect, every element matched is a result, also the ones under another result
+
+
+typedef enum HtmlCssOpCode {
+    HTML_CSS_MATCH,             // end of a selector, the element matched
+    HTML_CSS_SELECTOR,          // start of a selector in a list, `a` ops of it follow
+
+    // simple selectors
+    HTML_CSS_NAME,              // `atom` and lowered name `string`
+    HTML_CSS_CLASS,             // `string` of `b` bytes, `a` is HtmlLibHashName() of it
+    HTML_CSS_ID,                // `string`
+    HTML_CSS_ATTRIBUTE,         // attribute of `atom` and lowered name `string`, kept for value ops
+    HTML_CSS_VALUE_EQUAL,       // value of the kept attribute and `string` of `b` bytes
+    HTML_CSS_VALUE_INCLUDE,     // ~=
+    HTML_CSS_VALUE_DASH,        // |=
+    HTML_CSS_VALUE_PREFIX,      // ^=
+    HTML_CSS_VALUE_SUFFIX,      // $=
+    HTML_CSS_VALUE_SUBSTRING,   // *=
+    HTML_CSS_NTH_CHILD,         // position is `a` n + `b`
+    HTML_CSS_NTH_LAST_CHILD,
+    HTML_CSS_NTH_OF_TYPE,
+    HTML_CSS_NTH_LAST_OF_TYPE,
+    HTML_CSS_EMPTY,
+    HTML_CSS_ROOT,
+    HTML_CSS_NOT,               // no selector of the list in the next `a` ops matches
+    HTML_CSS_IS,                // a selector of the list in the next `a` ops matches
+
+    // combinators, the ops after them check another element
+    HTML_CSS_PARENT,            // >
+    HTML_CSS_ANCESTOR,          // ' ', tries every ancestor
+    HTML_CSS_PREV,              // +
+    HTML_CSS_PREV_ANY,          // ~, tries every previous sibling
+} HtmlCssOpCode;
+
+
+#define HTML_CSS_IGNORE_CASE 1
+
+
+typedef struct HtmlCssOp {
+    unsigned char code;         // HtmlCssOpCode
+    unsigned char flags;        // HTML_CSS_IGNORE_CASE
+    unsigned short atom;        // HtmlAtom of a name
+    int a, b;
+    unsigned int string;        // offset in strings of HtmlCssSelector
+} HtmlCssOp;
+
+
+// keys of a selector, see subtreeBloom of HtmlObject
+typedef struct HtmlLibCssBlooms {
+    unsigned long long subject;     // the rightmost compound
+    unsigned long long ancestors;   // compounds matched by ancestors of the subject
+} HtmlLibCssBlooms;
+
+
+typedef struct HtmlCssSelector {
+    const HtmlLibCssBlooms* blooms;     // of each selector
+    int count;                          // selectors in the list
+    bool filtered;                      // a selector has ancestors keys
+
+    const HtmlCssOp* ops;               // the list, every selector starts with HTML_CSS_SELECTOR
+    int length;
+    const char* strings;
+} HtmlCssSelector;
+
+
+#ifndef HTML_CSS_FILTER_DEPTH
+#define HTML_CSS_FILTER_DEPTH 64
+#endif
+
+
+typedef struct HtmlCssSelectState {
+    const HtmlCssSelector* selector;
+    const HtmlObject* root;
+    const HtmlObject* node;     // object returned last, or the root before the first run
+
+    // elements of the rightmost compound's name, id or class from the document index, instead of walking
+    const HtmlLibIndexEntry* candidate;
+    const HtmlLibIndexEntry* candidateEnd;
+
+    // keys of the ancestors of the elements at depth + 1 under root while walking, deeper ones are not filtered
+    int depth;
+    unsigned long long filters[HTML_CSS_FILTER_DEPTH];
+} HtmlCssSelectState;
+
+
+
+
+// Compiling //
+
+typedef struct HtmlLibCssCompiler {
+    const char* begin;
+    const char* p;
+
+    HtmlCssOp* ops;
+    int length;
+    int capacity;
+
+    char* strings;
+    size_t stringLength;
+    size_t stringCapacity;
+
+    HtmlLibCssBlooms* blooms;
+    int count;
+    int bloomCapacity;
+} HtmlLibCssCompiler;
+
+
+#define HtmlLibIsCssNameChar(c) (isalnum((unsigned char)(c)) || (c) == '-' || (c) == '_' || (unsigned char)(c) >= 0x80 || (c) == '\\')
+
+#define HtmlLibSkipCssSpaces(compiler) \
+    while (isspace((unsigned char)*(compiler)->p)) (compiler)->p++
+
+
+// index of the new op, or -1
+int HtmlLibAddCssOp(HtmlLibCssCompiler* compiler, HtmlCssOpCode code) {
+    if (compiler->length == compiler->capacity) {
+        int capacity = compiler->capacity ? compiler->capacity * 2 : 32;
+        HtmlCssOp* ops = (HtmlCssOp*)realloc(compiler->ops, capacity * sizeof(HtmlCssOp));
+        HtmlHandleOutOfMemoryError(ops, -1);
+
+        compiler->ops = ops;
+        compiler->capacity = capacity;
+    }
+
+    compiler->ops[compiler->length] = (HtmlCssOp){(unsigned char)code, 0, 0, 0, 0, 0};
+    return compiler->length++;
+}
+
+
+bool HtmlLibPutCssChar(HtmlLibCssCompiler* compiler, int c) {
+    if (compiler->stringLength == compiler->stringCapacity) {
+        size_t capacity = compiler->stringCapacity ? compiler->stringCapacity * 2 : 64;
+        char* strings = (char*)realloc(compiler->strings, capacity);
+        HtmlHandleOutOfMemoryError(strings, false);
+
+        compiler->strings = strings;
+        compiler->stringCapacity = capacity;
+    }
+
+    compiler->strings[compiler->stringLength++] = (char)c;
+    return true;
+}
+
+
+// read a name (a quoted string if `quoted`) to strings, false if it is empty
+bool HtmlLibReadCssString(HtmlLibCssCompiler* compiler, bool lower, bool quoted, unsigned int* offset, int* length) {
+    int quote = quoted && (*compiler->p == '"' || *compiler->p == '\'') ? *compiler->p++ : 0;
+    int c;
+
+    *offset = (unsigned int)compiler->stringLength;
+
+    while ((c = *compiler->p) != 0 && (quote ? c != quote : HtmlLibIsCssNameChar(c))) {
+        // escaped char as it is
+        if (c == '\\' && compiler->p[1]) {
+            c = *(++compiler->p);
+        }
+        if (HtmlLibPutCssChar(compiler, lower ? HtmlLibLowerChar(c) : c) == false) {
+            return false;
+        }
+        compiler->p++;
+    }
+
+    if (quote) {
+        if (c != quote) {
+            return false;
+        }
+        compiler->p++;
+    }
+
+    *length = (int)(compiler->stringLength - *offset);
+    return HtmlLibPutCssChar(compiler, 0) && (*length > 0 || quote);
+}
+
+
+// read `an+b`, `odd` or `even`
+bool HtmlLibReadCssNth(HtmlLibCssCompiler* compiler, int* a, int* b) {
+    const char* p = compiler->p;
+    int sign = 1, number = -1;
+
+    while (isspace((unsigned char)*p)) p++;
+
+    if (strncasecmp(p, "odd", 3) == 0 || strncasecmp(p, "even", 4) == 0) {
+        *a = 2;
+        *b = tolower((unsigned char)*p) == 'o';
+        compiler->p = p + (*b ? 3 : 4);
+        return true;
+    }
+
+    if (*p == '+' || *p == '-') {
+        sign = *p++ == '-' ? -1 : 1;
+    }
+    if (isdigit((unsigned char)*p)) {
+        number = (int)strtol(p, (char**)&p, 10);
+    }
+
+    // b only
+    if (*p != 'n' && *p != 'N') {
+        *a = 0;
+        *b = sign * number;
+        compiler->p = p;
+        return number >= 0;
+    }
+
+    *a = sign * (number >= 0 ? number : 1);
+    *b = 0;
+
+    for (p++; isspace((unsigned char)*p); p++);
+    if (*p == '+' || *p == '-') {
+        sign = *p++ == '-' ? -1 : 1;
+
+        while (isspace((unsigned char)*p)) p++;
+        if (!isdigit((unsigned char)*p)) {
+            return false;
+        }
+        *b = sign * (int)strtol(p, (char**)&p, 10);
+    }
+
+    compiler->p = p;
+    return true;
+}
+
+
+// [first, middle) and [middle, last) change places
+void HtmlLibRotateCssOps(HtmlCssOp* first, HtmlCssOp* middle, HtmlCssOp* last) {
+    HtmlCssOp* ranges[3][2] = {{first, middle}, {middle, last}, {first, last}};
+    HtmlCssOp temp;
+
+    for (int i = 0; i < 3; i++) {
+        for (HtmlCssOp* begin = ranges[i][0], *end = ranges[i][1]; begin < --end; begin++) {
+            temp = *begin;
+            *begin = *end;
+            *end = temp;
+        }
+    }
+}
+
+
+// keys an element of the compound starting at `op` has, see subtreeBloom of HtmlObject
+unsigned long long HtmlLibGetCssCompoundBloom(const HtmlCssOp* op, const char* strings) {
+    unsigned long long bloom = 0;
+
+    for (;; op++) {
+        switch (op->code) {
+            case HTML_CSS_NAME:
+                bloom |= HtmlLibGetKeyBloom(HtmlLibGetNameKey(op->atom, strings + op->string));
+                break;
+            case HTML_CSS_CLASS:
+                bloom |= HtmlLibGetKeyBloom((unsigned int)op->a);
+                break;
+            case HTML_CSS_ID:
+                bloom |= HtmlLibGetKeyBloom((unsigned int)op->a);
+                break;
+            case HTML_CSS_NOT:
+            case HTML_CSS_IS:
+                op += op->a;
+                break;
+            case HTML_CSS_MATCH:
+            case HTML_CSS_PARENT:
+            case HTML_CSS_ANCESTOR:
+            case HTML_CSS_PREV:
+            case HTML_CSS_PREV_ANY:
+                return bloom;
+            default:
+                break;
+        }
+    }
+}
+
+
+// keys of the selector starting at `op`, compounds after `>` and ` ` are matched by ancestors
+HtmlLibCssBlooms HtmlLibGetCssBlooms(const HtmlCssOp* op, const char* strings) {
+    HtmlLibCssBlooms blooms = {HtmlLibGetCssCompoundBloom(op, strings), 0};
+
+    for (; op->code != HTML_CSS_MATCH; op++) {
+        if (op->code == HTML_CSS_NOT || op->code == HTML_CSS_IS) {
+            op += op->a;
+        }
+        else if (op->code == HTML_CSS_PARENT || op->code == HTML_CSS_ANCESTOR) {
+            blooms.ancestors |= HtmlLibGetCssCompoundBloom(op + 1, strings);
+        }
+    }
+    return blooms;
+}
+
+
+bool HtmlLibCompileCssList(HtmlLibCssCompiler* compiler, bool top);
+
+
+bool HtmlLibCompileCssPseudo(HtmlLibCssCompiler* compiler) {
+    const char* name = compiler->p;
+    while (HtmlLibIsCssNameChar(*compiler->p) && *compiler->p != '\\') {
+        compiler->p++;
+    }
+    size_t length = compiler->p - name;
+    bool function = *compiler->p == '(';
+
+    #define HtmlLibIsCssPseudo(str) (length == sizeof(str) - 1 && strncasecmp(name, str, length) == 0)
+
+    static const struct {
+        const char* name;
+        HtmlCssOpCode codes[2];
+    } positions[] = {
+        {"first-child", {HTML_CSS_NTH_CHILD}},
+        {"last-child", {HTML_CSS_NTH_LAST_CHILD}},
+        {"only-child", {HTML_CSS_NTH_CHILD, HTML_CSS_NTH_LAST_CHILD}},
+        {"first-of-type", {HTML_CSS_NTH_OF_TYPE}},
+        {"last-of-type", {HTML_CSS_NTH_LAST_OF_TYPE}},
+        {"only-of-type", {HTML_CSS_NTH_OF_TYPE, HTML_CSS_NTH_LAST_OF_TYPE}},
+        {"nth-child", {HTML_CSS_NTH_CHILD}},
+        {"nth-last-child", {HTML_CSS_NTH_LAST_CHILD}},
+        {"nth-of-type", {HTML_CSS_NTH_OF_TYPE}},
+        {"nth-last-of-type", {HTML_CSS_NTH_LAST_OF_TYPE}},
+    };
+
+    // positions, the first six are `an+b` of 0n+1
+    for (int i = 0; i < (int)(sizeof(positions) / sizeof(positions[0])); i++) {
+        if (strlen(positions[i].name) != length || strncasecmp(name, positions[i].name, length) != 0) {
+            continue;
+        }
+
+        int a = 0, b = 1;
+        if (i >= 6) {
+            compiler->p++;
+            if (function == false || HtmlLibReadCssNth(compiler, &a, &b) == false) {
+                return false;
+            }
+            HtmlLibSkipCssSpaces(compiler);
+            if (*compiler->p++ != ')') {
+                return false;
+            }
+        }
+        else if (function) {
+            return false;
+        }
+
+        for (int j = 0; j < 2 && (j == 0 || positions[i].codes[j]); j++) {
+            int op = HtmlLibAddCssOp(compiler, positions[i].codes[j]);
+            if (op < 0) {
+                return false;
+            }
+            compiler->ops[op].a = a;
+            compiler->ops[op].b = b;
+        }
+        return true;
+    }
+
+    if (function == false) {
+        if (HtmlLibIsCssPseudo("empty")) {
+            return HtmlLibAddCssOp(compiler, HTML_CSS_EMPTY) >= 0;
+        }
+        if (HtmlLibIsCssPseudo("root")) {
+            return HtmlLibAddCssOp(compiler, HTML_CSS_ROOT) >= 0;
+        }
+        return false;
+    }
+
+    // selector lists
+    HtmlCssOpCode code;
+    if (HtmlLibIsCssPseudo("not")) {
+        code = HTML_CSS_NOT;
+    }
+    else if (HtmlLibIsCssPseudo("is") || HtmlLibIsCssPseudo("where")) {
+        code = HTML_CSS_IS;
+    }
+    else {
+        return false;
+    }
+    #undef HtmlLibIsCssPseudo
+
+    int op = HtmlLibAddCssOp(compiler, code);
+    if (op < 0) {
+        return false;
+    }
+
+    compiler->p++;
+    if (HtmlLibCompileCssList(compiler, false) == false || *compiler->p++ != ')') {
+        return false;
+    }
+    compiler->ops[op].a = compiler->length - op - 1;
+    return true;
+}
+
+
+bool HtmlLibCompileCssAttribute(HtmlLibCssCompiler* compiler) {
+    static const char operators[] = "=~|^$*";
+    static const HtmlCssOpCode codes[] = {
+        HTML_CSS_VALUE_EQUAL, HTML_CSS_VALUE_INCLUDE, HTML_CSS_VALUE_DASH,
+        HTML_CSS_VALUE_PREFIX, HTML_CSS_VALUE_SUFFIX, HTML_CSS_VALUE_SUBSTRING,
+    };
+    unsigned int offset;
+    int length;
+
+    HtmlLibSkipCssSpaces(compiler);
+    int op = HtmlLibAddCssOp(compiler, HTML_CSS_ATTRIBUTE);
+    if (op < 0 || HtmlLibReadCssString(compiler, true, false, &offset, &length) == false) {
+        return false;
+    }
+    compiler->ops[op].atom = HtmlLibLookupAtom(compiler->strings + offset, length);
+    compiler->ops[op].string = offset;
+
+    HtmlLibSkipCssSpaces(compiler);
+    if (*compiler->p == ']') {
+        compiler->p++;
+        return true;
+    }
+
+    // operator and value
+    const char* found = *compiler->p ? strchr(operators, *compiler->p) : NULL;
+    if (found == NULL || (found != operators && *(++compiler->p) != '=')) {
+        return false;
+    }
+    compiler->p++;
+
+    HtmlLibSkipCssSpaces(compiler);
+    op = HtmlLibAddCssOp(compiler, codes[found - operators]);
+    if (op < 0 || HtmlLibReadCssString(compiler, false, true, &offset, &length) == false) {
+        return false;
+    }
+    compiler->ops[op].string = offset;
+    compiler->ops[op].b = length;
+
+    HtmlLibSkipCssSpaces(compiler);
+    if (*compiler->p == 'i' || *compiler->p == 'I' || *compiler->p == 's' || *compiler->p == 'S') {
+        compiler->ops[op].flags = tolower((unsigned char)*compiler->p++) == 'i' ? HTML_CSS_IGNORE_CASE : 0;
+        HtmlLibSkipCssSpaces(compiler);
+    }
+    return *compiler->p++ == ']';
+}
+
+
+bool HtmlLibCompileCssCompound(HtmlLibCssCompiler* compiler) {
+    unsigned int offset;
+    int length;
+    int op;
+    bool empty = true;
+
+    // type
+    if (*compiler->p == '*') {
+        compiler->p++;
+        empty = false;
+    }
+    else if (HtmlLibIsCssNameChar(*compiler->p)) {
+        if ((op = HtmlLibAddCssOp(compiler, HTML_CSS_NAME)) < 0 || HtmlLibReadCssString(compiler, true, false, &offset, &length) == false) {
+            return false;
+        }
+        compiler->ops[op].atom = HtmlLibLookupAtom(compiler->strings + offset, length);
+        compiler->ops[op].string = offset;
+        empty = false;
+    }
+
+    // classes, ids, attributes and pseudo classes
+    while (true) {
+        switch (*compiler->p) {
+            case '.':
+            case '#':
+                op = HtmlLibAddCssOp(compiler, *compiler->p++ == '.' ? HTML_CSS_CLASS : HTML_CSS_ID);
+                if (op < 0 || HtmlLibReadCssString(compiler, false, false, &offset, &length) == false) {
+                    return false;
+                }
+                compiler->ops[op].a = (int)HtmlLibHashName(compiler->strings + offset, length);
+                compiler->ops[op].b = length;
+                compiler->ops[op].string = offset;
+                break;
+
+            case '[':
+                compiler->p++;
+                if (HtmlLibCompileCssAttribute(compiler) == false) {
+                    return false;
+                }
+                break;
+
+            case ':':
+                compiler->p++;
+                if (HtmlLibCompileCssPseudo(compiler) == false) {
+                    return false;
+                }
+                break;
+
+            default:
+                return empty == false;
+        }
+        empty = false;
+    }
+}
+
+
+// compounds are read from the left, the ops are kept from the right: "a > b c" is c, ANCESTOR, b, PARENT, a
+bool HtmlLibCompileCssComplex(HtmlLibCssCompiler* compiler) {
+    int first = compiler->length;
+
+    if (HtmlLibCompileCssCompound(compiler) == false) {
+        return false;
+    }
+
+    while (true) {
+        const char* end = compiler->p;
+        HtmlCssOpCode code = HTML_CSS_ANCESTOR;
+
+        HtmlLibSkipCssSpaces(compiler);
+        switch (*compiler->p) {
+            case 0:
+            case ',':
+            case ')':
+                return true;
+
+            case '>':
+                code = HTML_CSS_PARENT;
+                break;
+            case '+':
+                code = HTML_CSS_PREV;
+                break;
+            case '~':
+                code = HTML_CSS_PREV_ANY;
+                break;
+
+            default:
+                if (compiler->p == end) {
+                    return false;
+                }
+        }
+        if (code != HTML_CSS_ANCESTOR) {
+            compiler->p++;
+            HtmlLibSkipCssSpaces(compiler);
+        }
+
+        int middle = compiler->length;
+        if (HtmlLibCompileCssCompound(compiler) == false || HtmlLibAddCssOp(compiler, code) < 0) {
+            return false;
+        }
+        HtmlLibRotateCssOps(compiler->ops + first, compiler->ops + middle, compiler->ops + compiler->length);
+    }
+}
+
+
+// selectors separated by `,` until the end, or `)` for `top` false
+bool HtmlLibCompileCssList(HtmlLibCssCompiler* compiler, bool top) {
+    while (true) {
+        HtmlLibSkipCssSpaces(compiler);
+
+        int op = HtmlLibAddCssOp(compiler, HTML_CSS_SELECTOR);
+        if (op < 0 || HtmlLibCompileCssComplex(compiler) == false || HtmlLibAddCssOp(compiler, HTML_CSS_MATCH) < 0) {
+            return false;
+        }
+        compiler->ops[op].a = compiler->length - op - 1;
+
+        // bloom of the selector, strings may move so it is made here
+        if (top) {
+            if (compiler->count == compiler->bloomCapacity) {
+                int capacity = compiler->bloomCapacity ? compiler->bloomCapacity * 2 : 4;
+                HtmlLibCssBlooms* blooms = (HtmlLibCssBlooms*)realloc(compiler->blooms, capacity * sizeof(HtmlLibCssBlooms));
+                HtmlHandleOutOfMemoryError(blooms, false);
+
+                compiler->blooms = blooms;
+                compiler->bloomCapacity = capacity;
+            }
+            compiler->blooms[compiler->count++] = HtmlLibGetCssBlooms(compiler->ops + op + 1, compiler->strings);
+        }
+
+        HtmlLibSkipCssSpaces(compiler);
+        if (*compiler->p != ',') {
+            return *compiler->p == (top ? 0 : ')');
+        }
+        compiler->p++;
+    }
+}
+
+
+void HtmlLibDestroyCssCompiler(HtmlLibCssCompiler* compiler) {
+    free(compiler->ops);
+    free(compiler->strings);
+    free(compiler->blooms);
+}
+
+
+
+
+/* CSS セレクターをコンパイルする
+
+結果は一つのメモリブロックで、実行しても変更されないので、複数のドキュメントや複数のスレッドで同時に使える
+対応する書式はこのセクションの最初を参照
+
+@param selector CSS セレクター ("ul > li.item:not(.hidden), a[href^='https']" など)
+@return コンパイルされたセレクター、HtmlDestroyCssSelector() で解放する、書式が違うなら NULL
+*/
+HtmlCssSelector* HtmlCompileCssSelector(const char* selector) {
+    HtmlHandleEmptyStringError(selector, NULL);
+
+    HtmlLibCssCompiler compiler = {0};
+    compiler.begin = selector;
+    compiler.p = selector;
+
+    if (HtmlLibCompileCssList(&compiler, true) == false) {
+        HtmlLibDestroyCssCompiler(&compiler);
+        HtmlHandleError(true, NULL, "bad selector '%s' at %d", selector, (int)(compiler.p - compiler.begin));
+    }
+
+    // one block of selector, blooms, ops and strings
+    size_t bloomSize = compiler.count * sizeof(HtmlLibCssBlooms);
+    size_t opSize = compiler.length * sizeof(HtmlCssOp);
+
+    HtmlCssSelector* css = (HtmlCssSelector*)malloc(sizeof(HtmlCssSelector) + bloomSize + opSize + compiler.stringLength);
+    if (css == NULL) {
+        HtmlLibDestroyCssCompiler(&compiler);
+        HtmlHandleOutOfMemoryError(NULL, NULL);
+    }
+
+    char* block = (char*)(css + 1);
+    css->blooms = (const HtmlLibCssBlooms*)memcpy(block, compiler.blooms, bloomSize);
+    css->count = compiler.count;
+    css->filtered = false;
+
+    for (int i = 0; i < css->count; i++) {
+        css->filtered |= css->blooms[i].ancestors != 0;
+    }
+    css->ops = (const HtmlCssOp*)memcpy(block + bloomSize, compiler.ops, opSize);
+    css->length = compiler.length;
+    css->strings = block + bloomSize + opSize;
+
+    if (compiler.strings) {
+        memcpy(block + bloomSize + opSize, compiler.strings, compiler.stringLength);
+    }
+
+    HtmlLibDestroyCssCompiler(&compiler);
+    return css;
+}
+
+
+void HtmlDestroyCssSelector(HtmlCssSelector* selector) {
+    free(selector);
+}
+
+
+
+
+// Matching //
+
+#define HtmlLibIsCssElement(object) \
+    ((object)->type == HTML_TYPE_TAG || (object)->type == HTML_TYPE_SINGLE || (object)->type == HTML_TYPE_SCRIPT)
+
+
+// parent element of object, documents between are passed through
+const HtmlObject* HtmlLibGetCssParent(const HtmlObject* object) {
+    for (object = object->parent; object; object = object->parent) {
+        if (object->type == HTML_TYPE_TAG) {
+            return object;
+        }
+    }
+    return NULL;
+}
+
+const HtmlObject* HtmlLibGetCssSibling(const HtmlObject* object, bool previous) {
+    do {
+        object = previous ? object->prev : object->next;
+    } while (object && !HtmlLibIsCssElement(object));
+
+    return object;
+}
+
+
+// position of object from 1 in its sibling elements, the ones of its name if `ofType`
+int HtmlLibGetCssPosition(const HtmlObject* object, bool last, bool ofType) {
+    int position = 1;
+
+    for (const HtmlObject* sibling = object; (sibling = HtmlLibGetCssSibling(sibling, !last)); ) {
+        if (!ofType || HtmlLibIsSameAtom(object->atom, object->name, sibling->atom, sibling->name)) {
+            position++;
+        }
+    }
+    return position;
+}
+
+// position is a n + b for some n >= 0
+#define HtmlLibIsCssNth(position, a, b) \
+    ((a) == 0 ? (position) == (b) : ((position) - (b)) / (a) >= 0 && ((position) - (b)) % (a) == 0)
+
+
+int HtmlLibCompareCssValue(const char* s1, const char* s2, size_t length, bool ignoreCase) {
+    return ignoreCase ? strncasecmp(s1, s2, length) : memcmp(s1, s2, length);
+}
+
+// attribute value by HTML_CSS_VALUE_*
+bool HtmlLibIsCssValueSuit(const HtmlCssOp* op, const char* value, const char* expected) {
+    size_t length = (size_t)op->b;
+    size_t valueLength = strlen(value);
+    bool ignoreCase = op->flags & HTML_CSS_IGNORE_CASE;
+
+    switch (op->code) {
+        case HTML_CSS_VALUE_EQUAL:
+            return valueLength == length && HtmlLibCompareCssValue(value, expected, length, ignoreCase) == 0;
+
+        case HTML_CSS_VALUE_DASH:
+            return valueLength >= length && HtmlLibCompareCssValue(value, expected, length, ignoreCase) == 0 &&
+                (value[length] == 0 || value[length] == '-');
+
+        case HTML_CSS_VALUE_PREFIX:
+            return length && valueLength >= length && HtmlLibCompareCssValue(value, expected, length, ignoreCase) == 0;
+
+        case HTML_CSS_VALUE_SUFFIX:
+            return length && valueLength >= length && HtmlLibCompareCssValue(value + valueLength - length, expected, length, ignoreCase) == 0;
+
+        case HTML_CSS_VALUE_SUBSTRING:
+            for (size_t i = 0; length && i + length <= valueLength; i++) {
+                if (HtmlLibCompareCssValue(value + i, expected, length, ignoreCase) == 0) {
+                    return true;
+                }
+            }
+            return false;
+
+        case HTML_CSS_VALUE_INCLUDE:
+            // words separated by spaces
+            while (length) {
+                while (isspace((unsigned char)*value)) value++;
+
+                const char* word = value;
+                while (*value && !isspace((unsigned char)*value)) value++;
+
+                if (value == word) {
+                    return false;
+                }
+                if ((size_t)(value - word) == length && HtmlLibCompareCssValue(word, expected, length, ignoreCase) == 0) {
+                    return true;
+                }
+            }
+            return false;
+
+        default:
+            return false;
+    }
+}
+
+
+// result of running ops, a failure tells the combinators on the right how far trying others can help
+typedef enum HtmlLibCssResult {
+    HTML_CSS_MATCHED,
+    HTML_CSS_FAILED_HERE,       // another ancestor or previous sibling may match
+    HTML_CSS_FAILED_SIBLINGS,   // no previous sibling can match, an upper ancestor may
+    HTML_CSS_FAILED_ALL,        // no upper ancestor can match either
+} HtmlLibCssResult;
+
+
+bool HtmlLibRunCssList(const HtmlCssOp* op, const HtmlCssOp* end, const HtmlObject* object, const char* strings);
+
+// run ops of a selector on an element until HTML_CSS_MATCH
+HtmlLibCssResult HtmlLibRunCssOps(const HtmlCssOp* op, const HtmlObject* object, const char* strings) {
+    const HtmlAttribute* attr = NULL;
+    const HtmlObject* child;
+    HtmlLibCssResult result;
+
+    for (;; op++) {
+        switch (op->code) {
+            case HTML_CSS_MATCH:
+                return HTML_CSS_MATCHED;
+
+            case HTML_CSS_NAME:
+                if (!HtmlLibIsSameAtom(op->atom, strings + op->string, object->atom, object->name)) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+
+            case HTML_CSS_CLASS:
+                if (!HtmlLibHasObjectClass(object, (unsigned int)op->a, strings + op->string, (size_t)op->b)) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+
+            case HTML_CSS_ID:
+                attr = HtmlLibFindObjectAttribute(object, HTML_ATOM_ID, "id");
+                if (attr == NULL || attr->value == NULL || strcmp(attr->value, strings + op->string) != 0) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+
+            case HTML_CSS_ATTRIBUTE:
+                attr = HtmlLibFindObjectAttribute(object, op->atom, strings + op->string);
+                if (attr == NULL) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+
+            case HTML_CSS_VALUE_EQUAL:
+            case HTML_CSS_VALUE_INCLUDE:
+            case HTML_CSS_VALUE_DASH:
+            case HTML_CSS_VALUE_PREFIX:
+            case HTML_CSS_VALUE_SUFFIX:
+            case HTML_CSS_VALUE_SUBSTRING:
+                if (!HtmlLibIsCssValueSuit(op, attr->value ? attr->value : "", strings + op->string)) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+
+            case HTML_CSS_NTH_CHILD:
+            case HTML_CSS_NTH_LAST_CHILD:
+            case HTML_CSS_NTH_OF_TYPE:
+            case HTML_CSS_NTH_LAST_OF_TYPE: {
+                int position = HtmlLibGetCssPosition(object,
+                    op->code == HTML_CSS_NTH_LAST_CHILD || op->code == HTML_CSS_NTH_LAST_OF_TYPE,
+                    op->code == HTML_CSS_NTH_OF_TYPE || op->code == HTML_CSS_NTH_LAST_OF_TYPE);
+
+                if (!HtmlLibIsCssNth(position, op->a, op->b)) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+            }
+
+            case HTML_CSS_EMPTY:
+                // no text and no children but comments
+                if (object->innerText && object->innerText[0]) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                for (child = object->firstChild; child; child = child->next) {
+                    if (child->type != HTML_TYPE_COMMENT || (child->afterText && child->afterText[0])) {
+                        return HTML_CSS_FAILED_HERE;
+                    }
+                }
+                break;
+
+            case HTML_CSS_ROOT:
+                if (HtmlLibGetCssParent(object)) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                break;
+
+            case HTML_CSS_NOT:
+                if (HtmlLibRunCssList(op + 1, op + 1 + op->a, object, strings)) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                op += op->a;
+                break;
+
+            case HTML_CSS_IS:
+                if (!HtmlLibRunCssList(op + 1, op + 1 + op->a, object, strings)) {
+                    return HTML_CSS_FAILED_HERE;
+                }
+                op += op->a;
+                break;
+
+            case HTML_CSS_PARENT:
+                if ((object = HtmlLibGetCssParent(object)) == NULL) {
+                    return HTML_CSS_FAILED_ALL;
+                }
+                break;
+
+            case HTML_CSS_PREV:
+                if ((object = HtmlLibGetCssSibling(object, true)) == NULL) {
+                    return HTML_CSS_FAILED_SIBLINGS;
+                }
+                break;
+
+            // when the left part fails for every upper ancestor, or every previous sibling,
+            // trying the next one cannot help, so chains like "div div div span" stay linear
+            case HTML_CSS_ANCESTOR:
+                while ((object = HtmlLibGetCssParent(object))) {
+                    result = HtmlLibRunCssOps(op + 1, object, strings);
+                    if (result == HTML_CSS_MATCHED || result == HTML_CSS_FAILED_ALL) {
+                        return result;
+                    }
+                }
+                return HTML_CSS_FAILED_ALL;
+
+            case HTML_CSS_PREV_ANY:
+                while ((object = HtmlLibGetCssSibling(object, true))) {
+                    result = HtmlLibRunCssOps(op + 1, object, strings);
+                    if (result != HTML_CSS_FAILED_HERE) {
+                        return result;
+                    }
+                }
+                return HTML_CSS_FAILED_SIBLINGS;
+
+            default:
+                return HTML_CSS_FAILED_ALL;
+        }
+    }
+}
+
+
+// true if a selector in [op, end) matches
+bool HtmlLibRunCssList(const HtmlCssOp* op, const HtmlCssOp* end, const HtmlObject* object, const char* strings) {
+    for (; op < end; op += op->a + 1) {
+        if (HtmlLibRunCssOps(op + 1, object, strings) == HTML_CSS_MATCHED) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// false if no element under object can match a selector of the list
+bool HtmlLibMayContainCss(const HtmlObject* object, const HtmlCssSelector* selector) {
+    for (int i = 0; i < selector->count; i++) {
+        if (HtmlLibMayContainPattern(object, selector->blooms[i].subject)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// false if no selector of the list can match an element whose ancestors have keys of `filter`
+bool HtmlLibPassCssFilter(unsigned long long filter, const HtmlCssSelector* selector) {
+    for (int i = 0; i < selector->count; i++) {
+        if ((filter & selector->blooms[i].ancestors) == selector->blooms[i].ancestors) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// keys of object and its ancestors
+unsigned long long HtmlLibGetCssAncestorsBloom(const HtmlObject* object) {
+    unsigned long long bloom = 0;
+
+    for (; object; object = object->parent) {
+        bloom |= HtmlLibGetObjectBloom(object);
+    }
+    return bloom;
+}
+
+
+/* オブジェクトが CSS セレクターに合うかどうか
+
+祖先と兄弟はドキュメント全体から調べる (検索の開始オブジェクトより上も)
+
+@param object 調べるオブジェクト、要素 (タグ、単一タグ、スクリプト) 以外は合わない
+@param selector HtmlCompileCssSelector() の結果
+@return 合えば true
+*/
+bool HtmlMatchCssSelector(const HtmlObject* object, const HtmlCssSelector* selector) {
+    HtmlHandleNullError(object, false);
+    HtmlHandleNullError(selector, false);
+
+    return HtmlLibIsCssElement(object) && HtmlLibRunCssList(selector->ops, selector->ops + selector->length, object, selector->strings);
+}
+
+
+
+
+// Selecting //
+//
+// elements are found by walking the subtree, or from the document index by the rightmost compound,
+// an element whose ancestors lack keys of the compounds on the left is rejected before running ops
+
+
+// candidates by name, id or class of the rightmost compound, for a list of one selector
+void HtmlLibBeginIndexedCssSelect(HtmlCssSelectState* state, const HtmlObject* object) {
+    const HtmlCssSelector* selector = state->selector;
+    if (selector->count != 1) {
+        return;
+    }
+
+    HtmlLibDocumentIndex* index = HtmlLibGetFreshIndex(object);
+    if (index == NULL) {
+        return;
+    }
+
+    for (const HtmlCssOp* op = selector->ops + 1; op->code != HTML_CSS_MATCH && op->code < HTML_CSS_PARENT; op++) {
+        switch (op->code) {
+            case HTML_CSS_NAME: {
+                unsigned short atom = HtmlLibGetIndexNameKey(object, index, op->atom, selector->strings + op->string);
+                if (atom != HTML_ATOM_NONE) {
+                    HtmlLibTakeFewerEntries(&index->names, atom, &state->candidate, &state->candidateEnd);
+                }
+                break;
+            }
+            case HTML_CSS_ID:
+                HtmlLibTakeFewerEntries(&index->ids, (unsigned int)op->a, &state->candidate, &state->candidateEnd);
+                break;
+            case HTML_CSS_CLASS:
+                HtmlLibTakeFewerEntries(&index->classes, (unsigned int)op->a, &state->candidate, &state->candidateEnd);
+                break;
+            case HTML_CSS_NOT:
+            case HTML_CSS_IS:
+                op += op->a;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+
+// candidate from the index is under root, and its ancestors have the keys
+bool HtmlLibIsCssCandidate(const HtmlObject* object, const HtmlCssSelectState* state) {
+    unsigned long long filter = 0;
+    bool under = false;
+
+    for (const HtmlObject* parent = object->parent; parent; parent = parent->parent) {
+        under |= parent == state->root;
+        if (under && state->selector->filtered == false) {
+            return true;
+        }
+        filter |= HtmlLibGetObjectBloom(parent);
+    }
+    return under && HtmlLibPassCssFilter(filter, state->selector);
+}
+
+
+/* CSS セレクターで検索を始める
+
+object の下の要素から、合うものをすべてドキュメントの順で返す
+ドキュメントに索引があれば (HtmlIndexDocument())、一番右の部分のタグ名、ID やクラスを持つ要素だけを調べる
+状態は呼び出し側 (スタックなど) に置かれ、実行中にメモリを確保しない
+
+@param state 実行の状態
+@param object 検索するオブジェクト
+@param selector HtmlCompileCssSelector() の結果
+*/
+void HtmlBeginCssSelect(HtmlCssSelectState* state, const HtmlObject* object, const HtmlCssSelector* selector) {
+    state->selector = selector;
+    state->root = object;
+    state->node = object && selector ? object : NULL;
+
+    state->candidate = NULL;
+    state->candidateEnd = NULL;
+    state->depth = 0;
+
+    if (state->node) {
+        if (selector->filtered) {
+            state->filters[0] = HtmlLibGetCssAncestorsBloom(object);
+        }
+        HtmlLibBeginIndexedCssSelect(state, object);
+    }
+}
+
+
+/* 次の結果を返す
+
+@param state HtmlBeginCssSelect() で始めた状態
+@return 次のオブジェクト、なければ NULL
+*/
+HtmlObject* HtmlNextCssSelect(HtmlCssSelectState* state) {
+    const HtmlCssSelector* selector = state->selector;
+    const HtmlObject* node = state->node;
+    int depth = state->depth;
+
+    // elements from the index are in document order
+    if (state->candidate) {
+        while (state->candidate < state->candidateEnd) {
+            node = (state->candidate++)->object;
+
+            if (HtmlLibIsCssCandidate(node, state) && HtmlLibRunCssList(selector->ops, selector->ops + selector->length, node, selector->strings)) {
+                state->node = node;
+                return (HtmlObject*)node;
+            }
+        }
+        state->node = NULL;
+        return NULL;
+    }
+
+    while (node) {
+        // next object in document order, subtrees without keys of any selector are passed
+        if (node->firstChild && HtmlLibMayContainCss(node, selector)) {
+            if (selector->filtered && depth > 0 && depth < HTML_CSS_FILTER_DEPTH) {
+                state->filters[depth] = state->filters[depth - 1] | HtmlLibGetObjectBloom(node);
+            }
+            node = node->firstChild;
+            depth++;
+        }
+        else {
+            while (node != state->root && node->next == NULL) {
+                node = node->parent;
+                depth--;
+            }
+            node = node == state->root ? NULL : node->next;
+        }
+
+        if (node == NULL || !HtmlLibIsCssElement(node)) {
+            continue;
+        }
+        if (selector->filtered && depth <= HTML_CSS_FILTER_DEPTH && !HtmlLibPassCssFilter(state->filters[depth - 1], selector)) {
+            continue;
+        }
+        if (HtmlLibRunCssList(selector->ops, selector->ops + selector->length, node, selector->strings)) {
+            state->node = node;
+            state->depth = depth;
+            return (HtmlObject*)node;
+        }
+    }
+
+    state->node = NULL;
+    return NULL;
+}
+
+
+
+HtmlArray HtmlFindAllCssSelectorObjects(const HtmlObject* object, const HtmlCssSelector* selector, int maxCount) {
+    HtmlArray array = {0};
+
+    HtmlHandleNullError(object, array);
+    HtmlHandleNullError(selector, array);
+
+    // create array //
+    int capacity = maxCount > 0 ? maxCount : 20;
+    array.values = (HtmlObject**)malloc(sizeof(HtmlObject*) * capacity);
+    HtmlHandleOutOfMemoryError(array.values, array);
+
+    // select objects //
+    HtmlCssSelectState state;
+    HtmlBeginCssSelect(&state, object, selector);
+    HtmlObject* result;
+
+    while ((result = HtmlNextCssSelect(&state))) {
+        if (array.length == capacity) {
+            // increase array size
+            HtmlObject** newValues = (HtmlObject**)realloc(array.values, sizeof(HtmlObject*) * capacity * 2);
+            HtmlHandleOutOfMemoryError(newValues, array);
+
+            array.values = newValues;
+            capacity *= 2;
+        }
+
+        array.values[array.length++] = result;
+
+        if (maxCount > 0 && array.length >= maxCount) {
+            break; // stop if reached max count
+        }
+    }
+    return array;
+}
+
+
+HtmlObject* HtmlFindCssSelectorObject(const HtmlObject* object, const HtmlCssSelector* selector) {
+    HtmlHandleNullError(object, NULL);
+    HtmlHandleNullError(selector, NULL);
+
+    HtmlCssSelectState state;
+    HtmlBeginCssSelect(&state, object, selector);
+    return HtmlNextCssSelect(&state);
+}
+
+
+
+HtmlArray HtmlFindAllCssObjects(const HtmlObject* object, const char* selector, int maxCount) {
+    HtmlArray array = {0};
+
+    HtmlHandleNullError(object, array);
+    HtmlHandleEmptyStringError(selector, array);
+
+    HtmlCssSelector* css = HtmlCompileCssSelector(selector);
+    if (css == NULL) {
+        return array;
+    }
+
+    array = HtmlFindAllCssSelectorObjects(object, css, maxCount);
+    HtmlDestroyCssSelector(css);
+    return array;
+}
+
+
+HtmlObject* HtmlFindCssObject(const HtmlObject* object, const char* selector) {
+    HtmlHandleNullError(object, NULL);
+    HtmlHandleEmptyStringError(selector, NULL);
+
+    HtmlCssSelector* css = HtmlCompileCssSelector(selector);
+    if (css == NULL) {
+        return NULL;
+    }
+
+    HtmlObject* result = HtmlFindCssSelectorObject(object, css);
+    HtmlDestroyCssSelector(css);
+    return result;
+}
+
+
+
+// Filtered Reading //
+//
+// only the elements suiting patterns are made with their subtrees, other elements
+// are kept as names in a stack of open elements, so the memory is as much as the result
+
+typedef struct HtmlLibFilterElement {
+    size_t name;                    // offset in names
+    unsigned short atom;            // static atom of name
+    HtmlSelectPattern* pattern;     // pattern checking the descendants, or NULL
+    HtmlObject* object;             // object made inside a result, or NULL
+} HtmlLibFilterElement;
+
+
+typedef struct HtmlLibSelectFilter {
+    HtmlLibStreamSink builder;      // makes results into the document
+
+    HtmlLibFilterElement* elements; // open elements, elements[0] is the document
+    size_t depth;
+    size_t capacity;
+    HtmlStreamString names;
+
+    // start tag waiting for its attributes
+    bool pending;
+    size_t name;                    // offset in names
+    unsigned short atom;
+    HtmlObjectType type;
+    HtmlStreamString attributes;    // {hasValue, name, 0, value, 0}...
+
+    bool afterResult;               // the last result is the last child of the open element, text goes after it
+} HtmlLibSelectFilter;
+
+
+#define HtmlLibGetFilterTop(filter) (&(filter)->elements[(filter)->depth - 1])
+
+
+bool HtmlLibPushFilterElement(HtmlLibSelectFilter* filter, HtmlSelectPattern* pattern, HtmlObject* object) {
+    if (filter->depth == filter->capacity) {
+        size_t newCapacity = filter->capacity * 2;
+        HtmlLibFilterElement* newElements = (HtmlLibFilterElement*)realloc(filter->elements, newCapacity * sizeof(HtmlLibFilterElement));
+        HtmlHandleOutOfMemoryError(newElements, false);
+
+        filter->elements = newElements;
+        filter->capacity = newCapacity;
+    }
+
+    filter->elements[filter->depth++] = (HtmlLibFilterElement){filter->name, filter->atom, pattern, object};
+    return true;
+}
+
+
+// value of pending attribute `name`, or NULL
+const char* HtmlLibGetFilterAttribute(HtmlLibSelectFilter* filter, const char* name) {
+    const char* p = filter->attributes.buffer;
+    const char* end = p + filter->attributes.length;
+
+    while (p < end) {
+        bool hasValue = *p++;
+        const char* value = p + strlen(p) + 1;
+
+        if (strcmp(p, name) == 0) {
+            return hasValue ? value : NULL;
+        }
+        p = hasValue ? value + strlen(value) + 1 : value;
+    }
+    return NULL;
+}
+
+
+// make the pending tag with its attributes under builder.current
+HtmlObject* HtmlLibMakeFilterTag(HtmlLibSelectFilter* filter, const char* name, size_t nameLength) {
+    HtmlLibEmitStartTag(&filter->builder, name, nameLength, filter->atom, filter->type);
+
+    const char* p = filter->attributes.buffer;
+    const char* end = p + filter->attributes.length;
+
+    while (p < end) {
+        bool hasValue = *p++;
+        size_t attrNameLength = strlen(p);
+        const char* value = p + attrNameLength + 1;
+        size_t valueLength = hasValue ? strlen(value) : 0;
+
+        HtmlLibEmitAttribute(&filter->builder, p, attrNameLength, hasValue ? value : NULL, valueLength);
+        p = hasValue ? value + valueLength + 1 : value;
+    }
+    HtmlLibEmitStartTagEnd(&filter->builder);
+    return filter->builder.tag;
+}
+
+
+// decide the pending tag when its attributes are all read
+void HtmlLibFlushFilterTag(HtmlLibSelectFilter* filter) {
+    if (filter->pending == false) {
+        return;
+    }
+    filter->pending = false;
+
+    HtmlLibFilterElement* parent = HtmlLibGetFilterTop(filter);
+    size_t nameOffset = filter->name;
+    const char* name = filter->names.buffer + nameOffset;
+    size_t nameLength = filter->names.length - nameOffset - 1;
+
+    HtmlSelectPattern* pattern = parent->pattern;
+    HtmlObject* object = NULL;
+
+    filter->afterResult = false;
+
+    // inside a result, make everything
+    if (parent->object) {
+        object = HtmlLibMakeFilterTag(filter, name, nameLength);
+        pattern = NULL;
+    }
+    // [index] counts every suiting element in document order like HtmlNextSelect(), the count is not reset
+    else if (pattern &&
+            HtmlLibIsSuitPattern(pattern, filter->atom, name, HtmlLibGetFilterAttribute(filter, "class"), HtmlLibGetFilterAttribute(filter, "id"))) {
+        // suits but not target index, its subtree is not checked
+        if (pattern->index > 0) {
+            pattern->index--;
+            pattern = NULL;
+        }
+        else {
+            // a targeted pattern stops at the result, siblings after it are not checked
+            // (a single tag of not final pattern is passed like HtmlNextSelect())
+            if (pattern->targeted && (pattern->next == NULL || filter->type == HTML_TYPE_TAG)) {
+                parent->pattern = NULL;
+            }
+
+            // not final pattern, check descendants by next pattern
+            if (pattern->next) {
+                pattern = filter->type == HTML_TYPE_TAG ? pattern->next : NULL;
+            }
+            // final pattern, make result
+            else {
+                filter->builder.current = &filter->builder.document->object;
+                object = HtmlLibMakeFilterTag(filter, name, nameLength);
+                pattern = NULL;
+            }
+        }
+    }
+
+    // single tag is not opened
+    if (filter->type == HTML_TYPE_SINGLE) {
+        filter->names.length = nameOffset;
+        filter->builder.current = parent->object ? parent->object : &filter->builder.document->object;
+        filter->afterResult = object && parent->object == NULL;
+        return;
+    }
+
+    HtmlLibPushFilterElement(filter, pattern, object);
+}
+
+
+void HtmlLibFilterStartTag(HtmlLibSelectFilter* filter, const char* name, size_t length) {
+    HtmlLibFlushFilterTag(filter);
+
+    filter->name = filter->names.length;
+    HtmlLibWriteStreamString((void*)name, length, 1, &filter->names);
+    HtmlLibPutcharToStreamString(0, &filter->names);
+
+    filter->pending = true;
+    filter->atom = HtmlLibLookupAtom(name, length);
+    filter->type = HtmlLibGetAtomObjectType(filter->atom);
+    filter->attributes.length = 0;
+}
+
+void HtmlLibFilterAttribute(HtmlLibSelectFilter* filter, const char* name, size_t nameLength, const char* value, size_t valueLength) {
+    HtmlLibPutcharToStreamString(value != NULL, &filter->attributes);
+    HtmlLibWriteStreamString((void*)name, nameLength, 1, &filter->attributes);
+    HtmlLibPutcharToStreamString(0, &filter->attributes);
+
+    if (value) {
+        HtmlLibWriteStreamString((void*)value, valueLength, 1, &filter->attributes);
+        HtmlLibPutcharToStreamString(0, &filter->attributes);
+    }
+}
+
+void HtmlLibFilterText(HtmlLibSelectFilter* filter, const char* text, size_t length) {
+    HtmlLibFlushFilterTag(filter);
+
+    // text after a result is its after text
+    if (HtmlLibGetFilterTop(filter)->object || filter->afterResult) {
+        HtmlLibEmitText(&filter->builder, text, length);
+    }
+}
+
+void HtmlLibFilterComment(HtmlLibSelectFilter* filter, const char* text, size_t length) {
+    HtmlLibFlushFilterTag(filter);
+    filter->afterResult = false;
+
+    if (HtmlLibGetFilterTop(filter)->object) {
+        HtmlLibEmitTextObject(&filter->builder, HTML_TYPE_COMMENT, text, length);
+    }
+}
+
+void HtmlLibFilterDoctype(HtmlLibSelectFilter* filter, const char* text, size_t length) {
+    HtmlLibFlushFilterTag(filter);
+    filter->afterResult = false;
+
+    if (HtmlLibGetFilterTop(filter)->object) {
+        HtmlLibEmitTextObject(&filter->builder, HTML_TYPE_DOCTYPE, text, length);
+    }
+}
+
+void HtmlLibFilterEndTag(HtmlLibSelectFilter* filter, const char* name, size_t length) {
+    HtmlLibFlushFilterTag(filter);
+
+    // Find return element
+    unsigned short atom = HtmlLibLookupAtom(name, length);
+    size_t depth = filter->depth - 1;
+
+    while (depth > 0) {
+        HtmlLibFilterElement* element = &filter->elements[depth];
+        const char* openName = filter->names.buffer + element->name;
+
+        if (element->atom == atom && (atom != HTML_ATOM_DYNAMIC || (strncmp(openName, name, length) == 0 && openName[length] == 0))) {
+            break;
+        }
+        depth--;
+    }
+
+    // warning: Not exists element name
+    if (depth == 0) {
+        HtmlLogWarning("Tag '%s' without closing! ('%.*s')",
+            filter->depth > 1 ? filter->names.buffer + HtmlLibGetFilterTop(filter)->name : "(document)", (int)length, name);
+        return;
+    }
+
+    // Return, the result closed is the last child of the open element
+    HtmlObject* closed = filter->elements[depth].object;
+
+    filter->names.length = filter->elements[depth].name;
+    filter->depth = depth;
+
+    HtmlObject* object = HtmlLibGetFilterTop(filter)->object;
+    filter->builder.current = object ? object : &filter->builder.document->object;
+    filter->afterResult = closed && object == NULL;
+}
+
+
+
+
+/* パターンに合うオブジェクトだけを作りながらストリームを読み込む
+
+HtmlFindAllObjects() と同じ結果をドキュメントの子として返すが、
+結果以外のオブジェクトは作られないので、メモリと時間は結果の大きさに比例する
+ページ全体を読み込んでから探すより速い
+[index] も HtmlFindAllObjects() と同じく文書順に数える (負の index は使えない)
+
+@param stream 読み取り可能なストリーム
+@param patterns HtmlCreateSelect() と同じパターン
+@return 結果を子に持つドキュメントオブジェクト
+*/
+HtmlObject* HtmlReadSelectFromStream(HtmlStream* stream, const char* patterns) {
+    HtmlHandleNullError(stream, NULL);
+    HtmlHandleEmptyStringError(patterns, NULL);
+    HtmlHandleError(HtmlIsStreamReadable(stream) == false, NULL, "stream is not readable.");
+
+    // create patterns
+    HtmlSelectPattern* selectPatterns = HtmlLibCreateSelectPatterns(patterns);
+    if (selectPatterns == NULL) {
+        return NULL;
+    }
+
+    for (HtmlSelectPattern* pattern = selectPatterns; pattern; pattern = pattern->next) {
+        if (pattern->reversal) {
+            HtmlLibDestroySelectPatterns(selectPatterns);
+            HtmlHandleError(true, NULL, "negative index is not supported while reading");
+        }
+    }
+
+    // create filter
+    HtmlObject* doc = HtmlCreateObjectDocument();
+    HtmlLibSelectFilter filter = {{NULL, NULL, (HtmlDocument*)doc, doc, doc, {{{0}}, 0}}, NULL, 0, 0, {NULL, 0, 0, 0}, false, 0, HTML_ATOM_NONE, HTML_TYPE_NONE, {NULL, 0, 0, 0}, false};
+
+    filter.capacity = 32;
+    filter.elements = (HtmlLibFilterElement*)malloc(filter.capacity * sizeof(HtmlLibFilterElement));
+    filter.names = (HtmlStreamString){(char*)malloc(256), 0, 0, 256};
+    filter.attributes = (HtmlStreamString){(char*)malloc(256), 0, 0, 256};
+
+    HtmlCode code = HTML_OUT_OF_MEMORY;
+
+    if (doc && filter.elements && filter.names.buffer && filter.attributes.buffer) {
+        filter.elements[filter.depth++] = (HtmlLibFilterElement){0, HTML_ATOM_NONE, selectPatterns, NULL};
+
+        HtmlEventHandlers handlers = {
+            (HtmlCallbackEvent)HtmlLibFilterStartTag,
+            (HtmlCallbackAttributeEvent)HtmlLibFilterAttribute,
+            (HtmlCallbackEvent)HtmlLibFilterText,
+            (HtmlCallbackEvent)HtmlLibFilterEndTag,
+            (HtmlCallbackEvent)HtmlLibFilterComment,
+            (HtmlCallbackEvent)HtmlLibFilterDoctype
+        };
+
+        code = HtmlParseEvents(stream, &handlers, &filter);
+        HtmlLibFlushFilterTag(&filter);
+    }
+
+    free(filter.elements);
+    free(filter.names.buffer);
+    free(filter.attributes.buffer);
+    HtmlLibDestroySelectPatterns(selectPatterns);
+
+    if (code != HTML_OK) {
+        HtmlDestroyObject(doc);
+        HtmlHandleError(true, NULL, "failed to read html stream (%d)", code);
+    }
+    return doc;
+}
+
+HtmlObject* HtmlReadSelectFromString(const char* str, const char* patterns) {
+    HtmlHandleNullError(str, NULL);
+
+    HtmlStream stream = HtmlCreateStreamString((char*)str);
+    HtmlObject* doc = HtmlReadSelectFromStream(&stream, patterns);
+    free(stream.data);      // string is not owned by the stream, only its state
+    return doc;
+}
+
+HtmlObject* HtmlReadSelectFromFile(const char* filename, const char* patterns) {
+    HtmlHandleEmptyStringError(filename, NULL);
+
+    FILE* file = fopen(filename, "r");
+    HtmlHandleError(file == NULL, NULL, "failed to open '%s' in read mode", filename);
+
+    HtmlStream stream = HtmlCreateStreamFileObject(file);
+    HtmlObject* doc = HtmlReadSelectFromStream(&stream, patterns);
+    fclose(file);
+    return doc;
 }
 
 
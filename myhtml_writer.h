@@ -47,7 +47,7 @@ HtmlCode HtmlLibWriteFormattedStringToStream(const char* s, HtmlStream* stream)
 
 
 // Write Attributes
-HtmlCode HtmlLibWriteAttributesToStream(HtmlObject* object, HtmlStream* stream) {
+HtmlCode HtmlLibWriteAttributesToStream(const HtmlObject* object, HtmlStream* stream) {
 	const char* attrName, *attrValue;
 
     HtmlForeachObjectAttributes(object, attrName, attrValue) {
@@ -63,7 +63,7 @@ HtmlCode HtmlLibWriteAttributesToStream(HtmlObject* object, HtmlStream* stream)
 }
 
 
-HtmlCode HtmlLibWriteObjectToStream(HtmlObject* object, HtmlStream* stream) {
+HtmlCode HtmlLibWriteObjectToStream(const HtmlObject* object, HtmlStream* stream) {
     HtmlObject* child;
     const char* innerText;
 	
@@ -74,6 +74,11 @@ HtmlCode HtmlLibWriteObjectToStream(HtmlObject* object, HtmlStream* stream) {
         stream->write((void*)innerText, strlen(innerText), 1, stream->data);
 		
 		stream->write((void*)"-->", 3, 1, stream->data);
+
+        // text after the comment or doctype
+        if (object->afterText) {
+            stream->write((void*)object->afterText, strlen(object->afterText), 1, stream->data);
+        }
         return HTML_OK;
     }
     if (object->type == HTML_TYPE_DOCTYPE) {
@@ -83,6 +88,11 @@ HtmlCode HtmlLibWriteObjectToStream(HtmlObject* object, HtmlStream* stream) {
         stream->write((void*)innerText, strlen(innerText), 1, stream->data);
 		
 		stream->putchar('>', stream->data);
+
+        // text after the comment or doctype
+        if (object->afterText) {
+            stream->write((void*)object->afterText, strlen(object->afterText), 1, stream->data);
+        }
         return HTML_OK;
     }
     if (object->type == HTML_TYPE_DOCUMENT) {
@@ -142,7 +152,7 @@ HtmlCode HtmlLibWriteObjectToStream(HtmlObject* object, HtmlStream* stream) {
 
 
 
-HtmlCode HtmlWriteObjectToStream(HtmlObject* object, HtmlStream* stream) {
+HtmlCode HtmlWriteObjectToStream(const HtmlObject* object, HtmlStream* stream) {
     HtmlHandleNullError(object, HTML_NULL_POINTER);
     HtmlHandleNullError(stream, HTML_NULL_POINTER);
 
@@ -150,7 +160,7 @@ HtmlCode HtmlWriteObjectToStream(HtmlObject* object, HtmlStream* stream) {
 }
 
 
-HtmlCode HtmlWriteObjectToFileObject(HtmlObject* object, FILE* file) {
+HtmlCode HtmlWriteObjectToFileObject(const HtmlObject* object, FILE* file) {
     HtmlHandleNullError(object, HTML_NULL_POINTER);
     HtmlHandleNullError(file, HTML_NULL_POINTER);
 
@@ -160,7 +170,7 @@ HtmlCode HtmlWriteObjectToFileObject(HtmlObject* object, FILE* file) {
 }
 
 
-HtmlCode HtmlWriteObjectToFile(HtmlObject* object, const char* filename) {
+HtmlCode HtmlWriteObjectToFile(const HtmlObject* object, const char* filename) {
     HtmlHandleNullError(object, HTML_NULL_POINTER);
     HtmlHandleEmptyStringError(filename, HTML_EMPTY_STRING);
 
@@ -174,8 +184,30 @@ HtmlCode HtmlWriteObjectToFile(HtmlObject* object, const char* filename) {
 }
 
 
+/* HtmlObject を HTML としてバッファに書き込む
+
+HtmlWriteObjectToString() と違ってオブジェクトを変更しないので、複数のスレッドから同じツリーに使える
+snprintf() と同じく size - 1 文字までで切られ、size が 0 でなければ NUL 終端される
+
+@param object 書き込むオブジェクト
+@param buffer 呼び出し側のバッファ、size が 0 なら NULL でも良い
+@param size buffer のサイズ
+@return HTML 全体の長さ、size 以上なら切られている
+*/
+size_t HtmlWriteObjectToBuffer(const HtmlObject* object, char* buffer, size_t size) {
+    HtmlLibFixedBuffer fixed = {buffer, size, 0};
+    HtmlStream stream = HtmlLibInitStreamFixedBuffer(&fixed);
+
+    if (object) {
+        HtmlLibWriteObjectToStream(object, &stream);
+    }
+    return HtmlLibFinishFixedBuffer(&fixed);
+}
+
+
 // convert HtmlObject to html string
 // you don't need to destroy the result string as it will destroy with object destroying
+// the result is kept in object, use HtmlWriteObjectToBuffer() from threads
 const char* HtmlWriteObjectToString(HtmlObject* object) {
     HtmlHandleNullError(object, "");
 
@@ -200,9 +232,8 @@ const char* HtmlWriteObjectToString(HtmlObject* object) {
     }
 
     // store result to object->name
-    if (object->name) {
-        free(object->name);
-    }
+    HtmlLibReleaseString(&object->name, &object->flags, HTML_BORROWED_NAME);
+    HtmlLibMarkObjectMixed(object);
 
     HtmlStreamString* streamString = (HtmlStreamString*)stream.data;
     streamString->buffer[streamString->length] = 0;
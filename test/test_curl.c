@@ -0,0 +1,73 @@
+// Cross-check of the libcurl reader
+//
+// HtmlReadObjectFromCURL() feeds the push parser with the pieces libcurl gives,
+// the tree must be the same as the stream reader builds from the same bytes.
+// Documents are written to a file and downloaded by a file:// URL in small pieces.
+//
+//   cc -I.. -o test_curl test_curl.c -lpthread -lcurl && ./test_curl
+
+#include <curl/curl.h>
+#include "myhtml.h"
+
+
+static const char* pieces[] = {
+	"<div class=A>", "</div>", "<p>", "</p   >", "<br/>", "<!x>", "<!-- Comment -->", "<!DOCTYPE HTML>",
+	"<script>a < b</SCRIPT >", "</script>", "<a HREF=Value title='x\\ty'>", "</a>", "text ", " ", "<", "\"",
+};
+
+static unsigned int seed = 1;
+
+static int Random(int n) {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % n;
+}
+
+
+static char* WriteHtml(HtmlObject* doc) {
+	size_t length = HtmlWriteObjectToBuffer(doc, NULL, 0);
+	char* html = (char*)malloc(length + 1);
+	HtmlWriteObjectToBuffer(doc, html, length + 1);
+	HtmlDestroyObject(doc);
+	return html;
+}
+
+
+int main() {
+	const char* fileName = "test_curl.tmp";
+	char url[4096] = "file://";
+	int failures = 0;
+
+	if (realpath(".", url + 7) == NULL) {
+		return 1;
+	}
+	strcat(url, "/");
+	strcat(url, fileName);
+
+	CURL* curl = curl_easy_init();
+	curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, 1024L);
+
+	for (int i = 0; i < 200; i++) {
+		FILE* file = fopen(fileName, "wb");
+		for (int j = Random(2000); j >= 0; j--) {
+			fputs(pieces[Random(sizeof(pieces) / sizeof(pieces[0]))], file);
+		}
+		fclose(file);
+
+		file = fopen(fileName, "rb");
+		char* expected = WriteHtml(HtmlReadObjectFromFileObject(file));
+		fclose(file);
+
+		char* actual = WriteHtml(HtmlReadObjectFromCURL(curl, url));
+		if (strcmp(expected, actual) != 0) {
+			failures++;
+		}
+		free(expected);
+		free(actual);
+	}
+
+	curl_easy_cleanup(curl);
+	remove(fileName);
+
+	printf("%d failures / 200 documents\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+// Setters of object strings
+//
+// Strings of parsed objects are borrowed from document memory or the input of in-situ parsing,
+// setters must not free them. Run with a memory checker to see invalid frees.
+// Every change must drop the cached texts of HtmlGetObjectText() above it.
+//
+//   cc -fsanitize=address -I.. -o test_object test_object.c -lpthread && ./test_object
+
+#include "myhtml.h"
+
+
+static int failures = 0;
+
+static void Expect(const char* what, const char* actual, const char* expected) {
+	if (strcmp(actual, expected) != 0) {
+		failures++;
+		printf("FAIL %s\nexpected: %s\nactual:   %s\n\n", what, expected, actual);
+	}
+}
+
+static void SetStrings(HtmlObject* doc, const char* reader) {
+	HtmlObject* p = HtmlFindObject(doc, "p");
+	HtmlObject* custom = HtmlFindObject(doc, "my-tag");
+
+	HtmlSetObjectName(p, "DIV");
+	HtmlSetObjectName(custom, "Other-Tag");
+	HtmlSetObjectInnerText(p, "inner");
+	HtmlSetObjectAfterText(p, "after");
+	HtmlSetObjectAfterText(custom, NULL);
+
+	Expect(reader, HtmlWriteObjectToString(doc), "<body><div>inner<b>b</b></div>after<other-tag>x</other-tag></body>");
+	Expect(reader, HtmlGetObjectText(HtmlFindObject(doc, "body")), "innerbafterx");
+
+	if (HtmlFindObject(doc, "p") || HtmlFindObject(doc, "div") != p || HtmlFindObject(doc, "other-tag") != custom) {
+		failures++;
+		printf("FAIL %s: renamed objects are not found\n\n", reader);
+	}
+	HtmlDestroyObject(doc);
+}
+
+
+// cached text of object is the same as a text made again, and is cached for the next change
+static void ExpectText(HtmlObject* object, const char* what) {
+	char buffer[256];
+
+	HtmlGetObjectTextToBuffer(object, buffer, sizeof(buffer));
+	Expect(what, HtmlGetObjectText(object), buffer);
+}
+
+static void Changed(HtmlObject* div, HtmlObject* p, const char* what) {
+	ExpectText(div, what);
+	ExpectText(p, what);
+}
+
+static void ChangeText() {
+	HtmlObject* doc = HtmlReadObjectFromString("<div><p>a<span>s</span>b<i>i</i></p>c<q>q</q>d</div>");
+	HtmlObject* div = HtmlFindObject(doc, "div");
+	HtmlObject* p = HtmlFindObject(doc, "p");
+	HtmlObject* span = HtmlFindObject(doc, "span");
+	HtmlObject* i = HtmlFindObject(doc, "i");
+	Changed(div, p, "parsed");
+
+	HtmlSetObjectInnerText(span, "S");
+	Changed(div, p, "inner text");
+	HtmlSetObjectAfterText(span, "B");
+	Changed(div, p, "after text");
+	HtmlCreateObjectTagEx(span, "u", "new", "after");
+	Changed(div, p, "create with parent");
+
+	HtmlAddObjectChild(p, HtmlFindObject(doc, "q"));
+	Changed(div, p, "move child");
+	HtmlInsertObjectChildBefore(p, span, HtmlCreateObjectTagEx(NULL, "em", "e", NULL));
+	Changed(div, p, "insert before");
+	HtmlInsertObjectChildAfter(p, span, HtmlCreateObjectSingle(NULL, "br"));
+	Changed(div, p, "insert after");
+
+	HtmlSetObjectName(span, "br");
+	Changed(div, p, "rename to br");
+	HtmlSetObjectName(i, "hr");
+	Changed(div, p, "rename to hr");
+	HtmlSetObjectName(span, "my-tag");
+	Changed(div, p, "rename from br");
+
+	HtmlDestroyObject(i);
+	Changed(div, p, "destroy");
+	HtmlClearObjectChildren(p);
+	Changed(div, p, "clear children");
+
+	HtmlDestroyObject(doc);
+}
+
+
+int main() {
+	const char* html = "<body><p>a<b>b</b></p>c<my-tag>x</my-tag>y</body>";
+
+	SetStrings(HtmlReadObjectFromString(html), "stream");
+	SetStrings(HtmlReadObjectFromStringInSitu(strdup(html)), "in-situ");
+
+	HtmlParser* parser = HtmlParserCreate();
+	HtmlParserFeed(parser, html, strlen(html));
+	SetStrings(HtmlParserFinish(parser), "push");
+
+	// objects without document own their strings
+	HtmlObject* tag = HtmlCreateObjectTagEx(NULL, "my-tag", "a", "b");
+	HtmlSetObjectName(tag, "p");
+	HtmlSetObjectInnerText(tag, "c");
+	HtmlSetObjectAfterText(tag, "d");
+	Expect("no document", HtmlWriteObjectToString(tag), "<p>c</p>d");
+	HtmlDestroyObject(tag);
+
+	ChangeText();
+
+	printf("%d failures\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,261 @@
+// Cross-check of the readers
+//
+// Every reader must build the same tree as the stream reader (HtmlReadObjectFromString),
+// the file readers the same as HtmlReadObjectFromFileObject().
+// A corpus of corner cases and random documents is parsed by each of them and compared
+// by the written HTML and a dump of the tree.
+//
+//   cc -I.. -o test_reader test_reader.c -lpthread && ./test_reader
+
+// small chunks to split the random documents
+#define HTML_PARALLEL_MIN_CHUNK 64
+
+#include "myhtml.h"
+
+
+static const char* corpus[] = {
+	"<br/>",
+	"<br />text",
+	"<p>a</p   >b",
+	"<p>a</ p>b",
+	"<div></>x</div>",
+	"<!x>text",
+	"<!xyzabcdefgh>text",
+	"a<!-",
+	"a<!",
+	"<!-- Mixed CASE Comment -->",
+	"<!--> <!-- -->",
+	"<!DOCTYPE HTML PUBLIC \"X\">",
+	"<!doctypehtml>",
+	"<!doctype",
+	"<script>if (a < b) x = '</div>';</script >x</SCRIPT>",
+	"<script></script>",
+	"<style>A{}</STYLE>",
+	"<script src=x>",
+	"<script",
+	"<a HREF=Value TITLE='Keep Case' data-x=a.b>x</A>",
+	"<a b=x\"y\">",
+	"<a b = c>",
+	"<a =x>",
+	"<a / b>",
+	"<a b='\\n\\t\\x41\\\\\\'\\q'>",
+	"<a b=\"\\x4\">",
+	"<a b=\"\\x\">",
+	"<a b=\"\\",
+	"<a b=\"unterminated",
+	"<a b=",
+	"<a b",
+	"</a",
+	"</",
+	"<",
+	"a < b > c",
+	"x<>y",
+	"<ul><li>1<li>2</ul>",
+	"<p>a<b>b</p>c</b>",
+	"<html><body><p>text</p><!-- c --> after</body></html>",
+	"  \n\t  ",
+	"<div>  </div>  <span> x </span>",
+	"<\xe3\x81\x82>\xe3\x81\x82</\xe3\x81\x82>",
+	"<a b=\xe3\x81\x82>",
+	"<my-tag><MY-TAG>x</my-tag></My-Tag>",
+};
+
+
+// random documents from pieces of markup
+static const char* pieces[] = {
+	"<", ">", "/", "!", "-", "--", "=", "\"", "'", "\\", "\\x4", " ", "\n", "a", "B", "text ",
+	"<div", "</div>", "<p>", "</p", "<li>", "<br/>", "<img src=x>", "<SCRIPT>", "</script>", "</script",
+	"<style>", "</STYLE>", "<!--", "-->", "<!DOCTYPE ", "<!doctype", "<!x", "<a href='", "<a b=\"",
+	"<my-tag", "</my-tag>", "<span class=x>", "</span>", "\xe3\x81\x82",
+};
+
+static unsigned int seed = 1;
+
+static int Random(int n) {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % n;
+}
+
+static char* MakeDocument(size_t count) {
+	HtmlStream stream = HtmlCreateStreamBuffer(256);
+
+	for (size_t i = 0; i < count; i++) {
+		const char* piece = pieces[Random(sizeof(pieces) / sizeof(pieces[0]))];
+		stream.write((void*)piece, strlen(piece), 1, stream.data);
+	}
+	stream.putchar('\0', stream.data);
+
+	char* html = strdup(HtmlGetStreamString(&stream));
+	HtmlDestroyStream(&stream);
+	return html;
+}
+
+
+// types, names, NULL or not of strings, and text of the tree
+static void DumpObject(const HtmlObject* object, HtmlStream* stream) {
+	char line[64];
+	const char* name, *value;
+
+	sprintf(line, "(%d %s ", object->type, object->name ? "n" : "-");
+	stream->write(line, strlen(line), 1, stream->data);
+	if (object->name) {
+		stream->write((void*)object->name, strlen(object->name), 1, stream->data);
+	}
+
+	HtmlForeachObjectAttributes(object, name, value) {
+		stream->write((void*)" @", 2, 1, stream->data);
+		stream->write((void*)name, strlen(name), 1, stream->data);
+		stream->write(value ? (void*)"=" : (void*)"-", 1, 1, stream->data);
+		if (value) {
+			stream->write((void*)value, strlen(value), 1, stream->data);
+		}
+	}
+
+	stream->write(object->innerText ? (void*)" [" : (void*)" -[", object->innerText ? 2 : 3, 1, stream->data);
+	if (object->innerText) {
+		stream->write((void*)object->innerText, strlen(object->innerText), 1, stream->data);
+	}
+	stream->putchar(']', stream->data);
+
+	for (HtmlObject* child = object->firstChild; child; child = child->next) {
+		DumpObject(child, stream);
+	}
+	stream->putchar(')', stream->data);
+
+	if (object->afterText) {
+		stream->putchar('[', stream->data);
+		stream->write((void*)object->afterText, strlen(object->afterText), 1, stream->data);
+		stream->putchar(']', stream->data);
+	}
+}
+
+static char* WriteTree(HtmlObject* doc) {
+	if (doc == NULL) {
+		return strdup("(null)");
+	}
+
+	HtmlStream stream = HtmlCreateStreamBuffer(256);
+	DumpObject(doc, &stream);
+	stream.putchar('\n', stream.data);
+
+	size_t length = HtmlWriteObjectToBuffer(doc, NULL, 0);
+	char* html = (char*)malloc(length + 1);
+	HtmlWriteObjectToBuffer(doc, html, length + 1);
+	stream.write(html, length, 1, stream.data);
+	stream.putchar('\0', stream.data);
+	free(html);
+
+	char* tree = strdup(HtmlGetStreamString(&stream));
+	HtmlDestroyStream(&stream);
+	HtmlDestroyObject(doc);
+	return tree;
+}
+
+
+static HtmlObject* ReadInSitu(const char* html, size_t length, bool terminated) {
+	char* copy = (char*)malloc(length + 1);
+	memcpy(copy, html, length + 1);
+	return terminated ? HtmlReadObjectFromStringInSitu(copy) : HtmlReadObjectFromBufferInSitu(copy, length);
+}
+
+static HtmlObject* ReadPushed(const char* html, size_t length, int maxSplit) {
+	HtmlParser* parser = HtmlParserCreate();
+
+	for (size_t i = 0; i < length; ) {
+		size_t n = 1 + Random(maxSplit);
+		n = n < length - i ? n : length - i;
+		HtmlParserFeed(parser, html + i, n);
+		i += n;
+	}
+	return HtmlParserFinish(parser);
+}
+
+
+// the document written to a file is read by name, mapped or through a pipe
+static const char* fileName = "test_reader.tmp";
+
+static HtmlObject* ReadFileObject(int threads) {
+	FILE* file = fopen(fileName, "rb");
+	HtmlObject* doc = threads ? HtmlLibReadObjectFromFile(file, threads) : HtmlReadObjectFromFileObject(file);
+	fclose(file);
+	return doc;
+}
+
+static HtmlObject* ReadPipe() {
+	char command[64];
+	sprintf(command, "cat %s", fileName);
+
+	FILE* pipe = popen(command, "r");
+	HtmlObject* doc = HtmlLibReadObjectFromFile(pipe, 1);
+	pclose(pipe);
+	return doc;
+}
+
+
+static int failures = 0;
+
+static void Check(const char* reader, const char* html, const char* expected, HtmlObject* doc) {
+	char* tree = WriteTree(doc);
+
+	if (strcmp(tree, expected) != 0) {
+		failures++;
+		if (failures <= 10) {
+			printf("FAIL %s\ninput: %s\nexpected: %s\nactual:   %s\n\n", reader, html, expected, tree);
+		}
+	}
+	free(tree);
+}
+
+static void CheckReaders(const char* html) {
+	size_t length = strlen(html);
+	char* expected = WriteTree(HtmlReadObjectFromString(html));
+
+	Check("buffer", html, expected, HtmlLibReadObjectFromBuffer(html, length));
+	Check("string in-situ", html, expected, ReadInSitu(html, length, true));
+	Check("buffer in-situ", html, expected, ReadInSitu(html, length, false));
+	Check("push by 1 byte", html, expected, ReadPushed(html, length, 1));
+	Check("push by random", html, expected, ReadPushed(html, length, 16));
+	Check("parallel", html, expected, HtmlReadObjectFromBufferParallel(html, length, 4));
+
+	free(expected);
+}
+
+static void CheckFileReaders(const char* html) {
+	FILE* file = fopen(fileName, "wb");
+	fwrite(html, 1, strlen(html), file);
+	fclose(file);
+
+	// FILE* is read by the stream reader
+	char* expected = WriteTree(ReadFileObject(0));
+
+	Check("file", html, expected, HtmlReadObjectFromFile(fileName));
+	Check("file parallel", html, expected, HtmlReadObjectFromFileParallel(fileName, 4));
+	Check("file mapped", html, expected, ReadFileObject(1));
+	Check("pipe", html, expected, ReadPipe());
+
+	free(expected);
+}
+
+
+int main() {
+	int count = 0;
+
+	for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); i++, count++) {
+		CheckReaders(corpus[i]);
+	}
+	for (int i = 0; i < 3000; i++, count++) {
+		char* html = MakeDocument(1 + Random(400));
+		CheckReaders(html);
+		if (i % 10 == 0) {
+			CheckFileReaders(html);
+		}
+		free(html);
+	}
+	for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); i++) {
+		CheckFileReaders(corpus[i]);
+	}
+	remove(fileName);
+
+	printf("%d failures / %d documents\n", failures, count);
+	return failures ? 1 : 0;
+}
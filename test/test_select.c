@@ -0,0 +1,207 @@
+// Cross-check of selecting while reading
+//
+// HtmlReadSelectFromString() must give the same results as HtmlFindAllObjects() on the whole tree,
+// also for [index] patterns. Random documents and patterns are compared by the written HTML.
+// Patterns not valid must be refused with NULL, not crash.
+// Elements moved from another document must be found with and without an index.
+//
+//   cc -I.. -o test_select test_select.c -lpthread && ./test_select
+
+#include "myhtml.h"
+
+
+static const char* pieces[] = {
+	"<div>", "</div>", "<p>", "</p>", "<p class=a>", "<div class=b>", "<span id=x>", "</span>",
+	"<ul>", "</ul>", "<li>", "</li>", "<br>", "<img class=a>", "<b>", "</b>", "text ",
+};
+
+static const char* steps[] = {
+	"div", "p", "span", "li", "ul", "b", "img", ".a", ".b", "#x", "p.a", "div.b",
+};
+
+static unsigned int seed = 1;
+
+static int Random(int n) {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % n;
+}
+
+
+static char* MakeDocument(size_t count) {
+	HtmlStream stream = HtmlCreateStreamBuffer(256);
+
+	for (size_t i = 0; i < count; i++) {
+		const char* piece = pieces[Random(sizeof(pieces) / sizeof(pieces[0]))];
+		stream.write((void*)piece, strlen(piece), 1, stream.data);
+	}
+	stream.putchar('\0', stream.data);
+
+	char* html = strdup(HtmlGetStreamString(&stream));
+	HtmlDestroyStream(&stream);
+	return html;
+}
+
+// 1 to 3 steps, some with [index]
+static void MakePatterns(char* patterns) {
+	patterns[0] = 0;
+
+	for (int i = Random(3); i >= 0; i--) {
+		strcat(patterns, steps[Random(sizeof(steps) / sizeof(steps[0]))]);
+		if (Random(2)) {
+			sprintf(patterns + strlen(patterns), "[%d]", Random(3));
+		}
+		if (i > 0) {
+			strcat(patterns, " ");
+		}
+	}
+}
+
+
+// results one after another
+static char* WriteResults(HtmlObject** results, size_t count) {
+	HtmlStream stream = HtmlCreateStreamBuffer(256);
+
+	for (size_t i = 0; i < count; i++) {
+		HtmlWriteObjectToStream(results[i], &stream);
+		stream.putchar('|', stream.data);
+	}
+	stream.putchar('\0', stream.data);
+
+	char* html = strdup(HtmlGetStreamString(&stream));
+	HtmlDestroyStream(&stream);
+	return html;
+}
+
+
+static const char* invalidPatterns[] = {
+	"[", "[0]", "[-1] div", "div [1]", "div[", "div[]", "div[x]", "div[1", "div[1]x", "div[1]]",
+	"div[- 1]", "div[99999999999]", ".a[", "   ", "div p[",
+};
+
+static const char* validPatterns[] = {
+	"div[0]", "div[ 1 ]", "body[-1]", "p.a[2] span", "#x[0]\t", "div  p",
+};
+
+static int CheckPatterns() {
+	int failures = 0;
+	HtmlObject* doc = HtmlReadObjectFromString("<div><p class=a>x</p></div>");
+
+	for (size_t i = 0; i < sizeof(invalidPatterns) / sizeof(invalidPatterns[0]); i++) {
+		const char* patterns = invalidPatterns[i];
+		HtmlCompiledSelect* compiled = HtmlCompileSelect(patterns);
+		HtmlArray array = HtmlFindAllObjects(doc, patterns, 0);
+		HtmlObject* selected = HtmlReadSelectFromString("<div></div>", patterns);
+
+		if (compiled || array.length || HtmlFindObject(doc, patterns) || selected) {
+			printf("FAIL invalid pattern accepted: '%s'\n", patterns);
+			failures++;
+		}
+		HtmlDestroyCompiledSelect(compiled);
+		HtmlDestroyArray(&array);
+		HtmlDestroyObject(selected);
+	}
+
+	for (size_t i = 0; i < sizeof(validPatterns) / sizeof(validPatterns[0]); i++) {
+		HtmlCompiledSelect* compiled = HtmlCompileSelect(validPatterns[i]);
+
+		if (compiled == NULL) {
+			printf("FAIL valid pattern refused: '%s'\n", validPatterns[i]);
+			failures++;
+		}
+		HtmlDestroyCompiledSelect(compiled);
+	}
+
+	HtmlDestroyObject(doc);
+	return failures;
+}
+
+
+// results of "foo" in b, found by patterns and CSS selectors
+static int CountFoo(HtmlObject* b, int expected, const char* when) {
+	HtmlArray array = HtmlFindAllObjects(b, "foo", 0);
+	HtmlArray css = HtmlFindAllCssObjects(b, "foo[data-x]", 0);
+	int failures = 0;
+
+	if (array.length != expected || css.length != expected - (expected > 1) || HtmlFindCssObject(b, "foo") == NULL) {
+		printf("FAIL moved element %s: %d patterns, %d css results, %d expected\n", when, array.length, css.length, expected);
+		failures++;
+	}
+	HtmlDestroyArray(&array);
+	HtmlDestroyArray(&css);
+	return failures;
+}
+
+// <foo> has dynamic atoms of document a, the index of b must find it by the names b knows
+static int CheckMovedObjects() {
+	int failures = 0;
+	HtmlObject* a = HtmlReadObjectFromString("<p data-y=1></p><foo data-x=1></foo>");
+	HtmlObject* b = HtmlReadObjectFromString("<div></div>");
+	HtmlObject* div = HtmlFindObject(b, "div");
+
+	HtmlAddObjectChild(div, HtmlFindObject(a, "foo"));
+	failures += CountFoo(b, 1, "without index");
+
+	HtmlIndexDocument(b);
+	failures += CountFoo(b, 1, "with index");
+
+	// b knows the name after making its own
+	HtmlCreateObjectTag(div, "foo");
+	failures += CountFoo(b, 2, "with index and a new one");
+
+	HtmlAddObjectChild(div, HtmlFindObject(a, "p"));
+	HtmlArray array = HtmlFindAllCssObjects(b, "div > [data-y]", 0);
+	if (array.length != 1) {
+		printf("FAIL moved attribute: %d results\n", array.length);
+		failures++;
+	}
+	HtmlDestroyArray(&array);
+
+	// strings of moved objects are in the memory of a
+	HtmlDestroyObject(b);
+	HtmlDestroyObject(a);
+	return failures;
+}
+
+
+int main() {
+	int failures = 0;
+	int count = 0;
+	char patterns[64];
+
+	for (int i = 0; i < 20000; i++, count++) {
+		char* html = MakeDocument(1 + Random(60));
+		MakePatterns(patterns);
+
+		// whole tree
+		HtmlObject* doc = HtmlReadObjectFromString(html);
+		HtmlArray array = HtmlFindAllObjects(doc, patterns, 0);
+		char* expected = WriteResults(array.values, array.length);
+		HtmlDestroyArray(&array);
+		HtmlDestroyObject(doc);
+
+		// while reading, the results are children of the document
+		HtmlObject* selected = HtmlReadSelectFromString(html, patterns);
+		HtmlObject* results[1024];
+		size_t length = 0;
+		for (HtmlObject* child = selected->firstChild; child && length < 1024; child = child->next) {
+			results[length++] = child;
+		}
+		char* actual = WriteResults(results, length);
+		HtmlDestroyObject(selected);
+
+		if (strcmp(expected, actual) != 0) {
+			if (++failures <= 10) {
+				printf("FAIL %s\ninput: %s\nexpected: %s\nactual:   %s\n\n", patterns, html, expected, actual);
+			}
+		}
+		free(expected);
+		free(actual);
+		free(html);
+	}
+
+	failures += CheckPatterns();
+	failures += CheckMovedObjects();
+
+	printf("%d failures / %d documents\n", failures, count);
+	return failures ? 1 : 0;
+}